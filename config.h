@@ -3,5 +3,25 @@
 /* hostname */
 #define HOSTNAME "container"
 
-/* file system path */
-#define FILE_SYSTEM_PATH "../root_fs"
\ No newline at end of file
+/* file system path, used when no image is given */
+#define FILE_SYSTEM_PATH "../root_fs"
+
+/* layer store holding the images (see src/image/image.h) */
+#define LAYER_STORE_PATH "/var/lib/mydocker"
+
+/* runtime state (locks, pools) */
+#define RUN_DIR "/run/mydocker"
+
+/* unix socket the zygote server listens on, in a directory only root can
+ * write to */
+#define ZYGOTE_SOCKET_PATH RUN_DIR "/zygote.sock"
+
+/* mount point of the tmpfs holding the writable layer of each container,
+ * every container mounts its own one in its mount namespace */
+#define ROOTFS_SCRATCH_PATH RUN_DIR "/scratch"
+
+/* max size of the writable layer of a container */
+#define ROOTFS_SCRATCH_SIZE "512m"
+
+/* compiled seccomp programs (see src/seccomp/seccomp_config.h) */
+#define SECCOMP_CACHE_PATH RUN_DIR "/seccomp"
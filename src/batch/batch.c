@@ -0,0 +1,275 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "batch.h"
+#include "../helpers/helpers.h"
+#include "../namespaces/cgroup/cgroup.h"
+
+#define BATCH_MAX_ARGS  64      /* max entrypoint argv length */
+
+/* shared by the workers and the reaper, protected by lock */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+static struct batch *current = NULL;
+static struct cgroup_args *template = NULL;
+static int userns = 0;
+static int seccomp = 0;
+static char *batch_image = NULL;
+static size_t next_container = 0;       /* first container not started */
+static size_t n_alive = 0;              /* started and not reaped yet */
+static size_t n_running = 0;            /* started or starting, not reaped */
+static size_t max_running = 0;
+
+static void batch_grow(struct batch *batch)
+{
+    size_t size = (batch->n_containers + 1) * sizeof(struct batch_container);
+
+    if (batch->n_containers == BATCH_MAX_CONTAINERS) {
+        fprintf(stderr, "=> more than %d containers in the batch\n",
+            BATCH_MAX_CONTAINERS);
+        exit(EXIT_FAILURE);
+    }
+
+    batch->containers = realloc(batch->containers, size);
+    if (!batch->containers)
+        printErr("realloc at batch_grow");
+
+    memset(&batch->containers[batch->n_containers], 0,
+        sizeof(struct batch_container));
+    ++batch->n_containers;
+}
+
+void batch_repeat(struct batch *batch, char **entrypoint,
+    size_t entrypoint_size, long n)
+{
+    memset(batch, 0, sizeof(*batch));
+
+    for (long i = 0; i < n; ++i) {
+        batch_grow(batch);
+        batch->containers[i].entrypoint = entrypoint;
+        batch->containers[i].entrypoint_size = entrypoint_size;
+    }
+}
+
+void batch_load_manifest(struct batch *batch, const char *path)
+{
+    char line[BATCH_MAX_LINE];
+    char *argv[BATCH_MAX_ARGS + 1];
+    struct batch_container *c;
+    char *token, *saveptr;
+    size_t argc;
+    FILE *manifest;
+
+    memset(batch, 0, sizeof(*batch));
+    batch->owns_entrypoints = 1;
+
+    if (!(manifest = fopen(path, "r")))
+        printErr("open manifest");
+
+    while (fgets(line, sizeof(line), manifest)) {
+        argc = 0;
+        token = strtok_r(line, " \t\r\n", &saveptr);
+
+        if (!token || token[0] == '#')
+            continue;
+
+        while (token && argc < BATCH_MAX_ARGS) {
+            argv[argc++] = token;
+            token = strtok_r(NULL, " \t\r\n", &saveptr);
+        }
+
+        if (token) {
+            fprintf(stderr, "=> manifest entrypoint with more than %d "
+                "arguments\n", BATCH_MAX_ARGS);
+            exit(EXIT_FAILURE);
+        }
+
+        batch_grow(batch);
+        c = &batch->containers[batch->n_containers - 1];
+
+        c->entrypoint = malloc((argc + 1) * sizeof(char *));
+        if (!c->entrypoint)
+            printErr("malloc at batch_load_manifest");
+
+        for (size_t i = 0; i < argc; ++i)
+            c->entrypoint[i] = strdup(argv[i]);
+        c->entrypoint[argc] = NULL;
+        c->entrypoint_size = argc;
+    }
+
+    fclose(manifest);
+
+    if (batch->n_containers == 0) {
+        fprintf(stderr, "=> no entrypoint in %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+}
+
+/* start containers until every one of the batch has been started */
+static void *batch_worker(void *unused)
+{
+    struct batch_container *c;
+    pid_t pid;
+
+    for (;;) {
+        pthread_mutex_lock(&lock);
+        while (next_container < current->n_containers
+                && n_running == max_running)
+            pthread_cond_wait(&cond, &lock);
+
+        if (next_container == current->n_containers) {
+            pthread_mutex_unlock(&lock);
+            return NULL;
+        }
+
+        c = &current->containers[next_container++];
+        ++n_running;
+        pthread_mutex_unlock(&lock);
+
+        c->runc_arguments.child_entrypoint = c->entrypoint;
+        c->runc_arguments.child_entrypoint_size = c->entrypoint_size;
+        c->runc_arguments.resources = copy_resources(template);
+        c->runc_arguments.has_userns = userns;
+        c->runc_arguments.has_seccomp = seccomp;
+        c->runc_arguments.image = batch_image;
+
+        pid = runc_start(&c->runc_arguments, &c->args);
+
+        fprintf(stderr, "=> container %zu started: pid %ld, veth%d\n",
+            (size_t) (c - current->containers), (long) pid,
+            c->args.net.index + 1);
+
+        pthread_mutex_lock(&lock);
+        c->pid = pid;
+        ++n_alive;
+        pthread_cond_broadcast(&cond);
+        pthread_mutex_unlock(&lock);
+    }
+}
+
+static struct batch_container *batch_find(pid_t pid)
+{
+    for (size_t i = 0; i < current->n_containers; ++i) {
+        if (current->containers[i].pid == pid)
+            return &current->containers[i];
+    }
+
+    return NULL;
+}
+
+/* wait for a terminated container and release its resources */
+static struct batch_container *batch_reap()
+{
+    struct batch_container *c;
+    siginfo_t info;
+
+    pthread_mutex_lock(&lock);
+    while (n_alive == 0)
+        pthread_cond_wait(&cond, &lock);
+    pthread_mutex_unlock(&lock);
+
+    /* Look at the child without reaping it: it may have been cloned by a
+     * worker that has not registered its pid yet, and its pid must not be
+     * reused before that. */
+    memset(&info, 0, sizeof(info));
+    while (waitid(P_ALL, 0, &info, WEXITED | WNOWAIT) == -1) {
+        if (errno != EINTR)
+            printErr("waitid");
+    }
+
+    pthread_mutex_lock(&lock);
+    while (!(c = batch_find(info.si_pid)))
+        pthread_cond_wait(&cond, &lock);
+    pthread_mutex_unlock(&lock);
+
+    if (waitpid(c->pid, &c->status, 0) == -1)
+        printErr("waitpid");
+
+    runc_finish(&c->args);
+    destroy_resources(c->runc_arguments.resources);
+
+    pthread_mutex_lock(&lock);
+    c->pid = -1;
+    --n_alive;
+    --n_running;
+    pthread_cond_broadcast(&cond);
+    pthread_mutex_unlock(&lock);
+
+    return c;
+}
+
+int batch_run(struct batch *batch, struct cgroup_args *resources,
+    int has_userns, int has_seccomp, char *image, int n_workers)
+{
+    pthread_t workers[BATCH_MAX_WORKERS];
+    struct batch_container *c;
+    int failed = 0;
+    int i, err;
+
+    if (n_workers < 1)
+        n_workers = 1;
+    if (n_workers > BATCH_MAX_WORKERS)
+        n_workers = BATCH_MAX_WORKERS;
+
+    current = batch;
+    template = resources;
+    userns = has_userns;
+    seccomp = has_seccomp;
+    batch_image = image;
+    next_container = 0;
+    n_alive = 0;
+
+    /* a small subnet has fewer veth pairs than cgroup slots */
+    n_running = 0;
+    max_running = net_pool_size() < BATCH_MAX_RUNNING ? net_pool_size()
+                                                      : BATCH_MAX_RUNNING;
+
+    fprintf(stderr, "=> starting %zu containers with %d workers\n",
+        batch->n_containers, n_workers);
+
+    for (i = 0; i < n_workers; ++i) {
+        if ((err = pthread_create(&workers[i], NULL, batch_worker, NULL))) {
+            errno = err;
+            printErr("pthread_create");
+        }
+    }
+
+    for (size_t reaped = 0; reaped < batch->n_containers; ++reaped) {
+        c = batch_reap();
+
+        if (!WIFEXITED(c->status) || WEXITSTATUS(c->status) != 0)
+            ++failed;
+
+        fprintf(stdout, "container %zu terminated: %s %d\n",
+            (size_t) (c - batch->containers),
+            WIFSIGNALED(c->status) ? "signal" : "exit status",
+            WIFSIGNALED(c->status) ? WTERMSIG(c->status)
+                                   : WEXITSTATUS(c->status));
+    }
+
+    for (i = 0; i < n_workers; ++i)
+        pthread_join(workers[i], NULL);
+
+    current = NULL;
+    return failed;
+}
+
+void batch_free(struct batch *batch)
+{
+    if (batch->owns_entrypoints) {
+        for (size_t i = 0; i < batch->n_containers; ++i) {
+            for (size_t j = 0; j < batch->containers[i].entrypoint_size; ++j)
+                free(batch->containers[i].entrypoint[j]);
+            free(batch->containers[i].entrypoint);
+        }
+    }
+
+    free(batch->containers);
+    memset(batch, 0, sizeof(*batch));
+}
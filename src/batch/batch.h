@@ -0,0 +1,72 @@
+/**
+ * Batch mode.
+ *
+ * runc() starts one container and then blocks in waitpid() until it
+ * terminates, so launching many containers from a script serializes all
+ * of them behind each other. Batch mode starts a list of containers from
+ * a single invocation: either the same entrypoint N times (-n) or one
+ * entrypoint per line of a manifest file (-m).
+ *
+ * The setup of a container (cgroup slot, veth pair, clone, uid/gid maps)
+ * only depends on the container itself, so it is run by a pool of worker
+ * threads, one container at a time each. The main thread only reaps the
+ * terminated containers and releases their resources, which makes room
+ * for the next ones.
+ *
+ *      worker 1    runc_start(c0)  runc_start(c2)  ...
+ *      worker 2    runc_start(c1)  runc_start(c3)  ...
+ *      main        waitid() -> runc_finish(cX) -> release veth pair ...
+ *
+ * Every running container owns one veth pair and one slot of the cgroup
+ * pool: at most BATCH_MAX_RUNNING of them, and no more than the pairs of
+ * the network pool, are alive at the same time; the workers wait for one
+ * to terminate before starting the next container.
+ *
+ * A manifest line is an entrypoint with its arguments separated by
+ * blanks. Empty lines and lines starting with '#' are skipped.
+ */
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "../runc.h"
+
+#define BATCH_MAX_CONTAINERS    4096    /* max containers in a batch */
+#define BATCH_MAX_RUNNING       64      /* one veth pair and cgroup slot each */
+#define BATCH_MAX_WORKERS       64      /* max setup threads */
+#define BATCH_MAX_LINE          4096    /* max manifest line length */
+
+struct cgroup_args;
+
+/* a container of the batch */
+struct batch_container {
+    char **entrypoint;                  /* NULL terminated command */
+    size_t entrypoint_size;             /* length of the entrypoint */
+    struct runc_args runc_arguments;
+    struct clone_args args;             /* filled by runc_start() */
+    pid_t pid;                          /* 0 until started */
+    int status;                         /* wait status once reaped */
+};
+
+struct batch {
+    struct batch_container *containers;
+    size_t n_containers;
+    int owns_entrypoints;               /* entrypoints come from a manifest */
+};
+
+/* a batch running n times the same entrypoint */
+void batch_repeat(struct batch *batch, char **entrypoint,
+    size_t entrypoint_size, long n);
+
+/* a batch with the entrypoints listed in the manifest file path */
+void batch_load_manifest(struct batch *batch, const char *path);
+
+/* Start every container of the batch from image using n_workers setup
+ * threads, each one with its own copy of resources, and wait for all of
+ * them.
+ * Returns the number of containers that did not exit with 0. */
+int batch_run(struct batch *batch, struct cgroup_args *resources,
+    int has_userns, int has_seccomp, char *image, int n_workers);
+
+void batch_free(struct batch *batch);
+
+#endif //BATCH_H
@@ -4,6 +4,9 @@
 #include <string.h>
 #include <unistd.h>
 #include <sched.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include <libiptc/libiptc.h>
 #include <linux/netfilter/nf_nat.h>
 #include <arpa/inet.h>
@@ -301,6 +304,126 @@ int drop_root_privileges(void)
 	return 0;
 }
 
+ssize_t send_fds(int sock, const void *buf, size_t len,
+    const int *fds, int n_fds)
+{
+    char control[CMSG_SPACE(sizeof(int) * MAX_PASSED_FDS)];
+    struct iovec iov = { (void *) buf, len };
+    struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1 };
+    struct cmsghdr *cmsg;
+
+    if (n_fds > MAX_PASSED_FDS) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (n_fds > 0) {
+        memset(control, 0, sizeof(control));
+        msg.msg_control = control;
+        msg.msg_controllen = CMSG_SPACE(sizeof(int) * n_fds);
+
+        cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * n_fds);
+        memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * n_fds);
+    }
+
+    return sendmsg(sock, &msg, MSG_NOSIGNAL);
+}
+
+ssize_t recv_fds(int sock, void *buf, size_t len, int *fds, int *n_fds)
+{
+    char control[CMSG_SPACE(sizeof(int) * MAX_PASSED_FDS)];
+    struct iovec iov = { buf, len };
+    struct msghdr msg = {
+            .msg_iov = &iov,
+            .msg_iovlen = 1,
+            .msg_control = control,
+            .msg_controllen = sizeof(control)
+    };
+    struct cmsghdr *cmsg;
+    int max_fds = *n_fds;
+    ssize_t ret;
+
+    *n_fds = 0;
+
+    /* received descriptors must not leak into processes cloned later */
+    if ((ret = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC)) <= 0)
+        return ret;
+
+    for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        int count, i;
+
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+            continue;
+
+        count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        for (i = 0; i < count; ++i) {
+            int fd;
+
+            memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+            if (*n_fds < max_fds)
+                fds[(*n_fds)++] = fd;
+            else
+                close(fd);
+        }
+    }
+
+    return ret;
+}
+
+int open_output(const char *target, int *is_socket)
+{
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    int fd;
+
+    *is_socket = 0;
+
+    if (strncmp(target, "unix:", 5))
+        return open(target, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+
+    if (strlen(target + 5) >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(addr.sun_path, target + 5);
+
+    if ((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) == -1)
+        return -1;
+
+    if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) == -1) {
+        close(fd);
+        return -1;
+    }
+
+    *is_socket = 1;
+    return fd;
+}
+
+int write_output(int fd, int is_socket, const void *buf, size_t len)
+{
+    ssize_t n;
+
+    while (len) {
+        if (is_socket)
+            n = send(fd, buf, len, MSG_NOSIGNAL);
+        else
+            n = write(fd, buf, len);
+
+        if (n == -1) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+
+        buf = (const char *) buf + n;
+        len -= n;
+    }
+
+    return 0;
+}
+
 // write the child entrypoint command
 void get_child_entrypoint(int optind,
             char **arguments,
@@ -505,6 +628,107 @@ int _nlmsg_recieve(int fd)
 	return 0;
 }
 
+void _nlbatch_init(struct nl_batch *batch)
+{
+	batch->len    = 0;
+	batch->last   = NULL;
+	batch->seq    = time(NULL);
+	batch->n_msgs = 0;
+}
+
+/* account the attributes appended to the message being built */
+static void _nlbatch_close(struct nl_batch *batch)
+{
+	if (!batch->last)
+		return;
+
+	batch->len += NLMSG_ALIGN(batch->last->nlmsg_len);
+	batch->last = NULL;
+}
+
+/* Start a new request at the end of the arena. The returned header can be
+ * extended with _nlmsg_put() until the next request is added. */
+struct nlmsghdr *_nlbatch_add(struct nl_batch *batch, int type, int flags,
+	size_t hdrlen)
+{
+	struct nlmsghdr *nlmsg;
+
+	_nlbatch_close(batch);
+
+	if (batch->len + NLMSG_SPACE(hdrlen) + MAX_PAYLOAD > NL_BATCH_SIZE) {
+		fprintf(stderr, "netlink batch full\n");
+		exit(EXIT_FAILURE);
+	}
+
+	nlmsg = (struct nlmsghdr *) (batch->buf + batch->len);
+	memset(nlmsg, 0, NLMSG_SPACE(hdrlen) + MAX_PAYLOAD);
+	nlmsg->nlmsg_len   = NLMSG_LENGTH(hdrlen);
+	nlmsg->nlmsg_type  = type;
+	nlmsg->nlmsg_flags = flags | NLM_F_REQUEST | NLM_F_ACK;
+	nlmsg->nlmsg_seq   = batch->seq + batch->n_msgs++;
+
+	batch->last = nlmsg;
+	return nlmsg;
+}
+
+/* Send every request of the batch at once, then reap one ACK per request.
+ * The kernel handles the requests in order and keeps going after a
+ * failure, so all the ACKs are always collected. */
+int _nlbatch_commit(int fd, struct nl_batch *batch)
+{
+	struct sockaddr_nl sa = { .nl_family = AF_NETLINK };
+	char buf[NL_BATCH_SIZE];
+	int acked = 0, result = 0;
+
+	_nlbatch_close(batch);
+
+	if (batch->n_msgs == 0)
+		return 0;
+
+	struct iovec  iov = { batch->buf, batch->len };
+	struct msghdr msg = { &sa, sizeof(sa), &iov, 1, NULL, 0, 0 };
+
+	if (sendmsg(fd, &msg, 0) < 0) {
+		fprintf(stderr, "failed to send netlink batch: %s\n",
+			strerror(errno));
+		return 1;
+	}
+
+	while (acked < batch->n_msgs) {
+		struct nlmsghdr *ret;
+		ssize_t len;
+
+		iov.iov_base = buf;
+		iov.iov_len  = sizeof(buf);
+
+		if ((len = recvmsg(fd, &msg, 0)) <= 0) {
+			fprintf(stderr, "recieve error: %s\n", strerror(errno));
+			return 1;
+		}
+
+		for (ret = (struct nlmsghdr *) buf; NLMSG_OK(ret, len);
+				ret = NLMSG_NEXT(ret, len)) {
+			struct nlmsgerr *err;
+
+			if (ret->nlmsg_type != NLMSG_ERROR)
+				continue;
+
+			err = (struct nlmsgerr *) NLMSG_DATA(ret);
+			if (ret->nlmsg_seq - batch->seq >= (__u32) batch->n_msgs)
+				continue;
+
+			++acked;
+			if (err->error < 0) {
+				fprintf(stderr, "recieve error on request %u: %d\n",
+					ret->nlmsg_seq - batch->seq, err->error);
+				result = 1;
+			}
+		}
+	}
+
+	return result;
+}
+
 int _ipt_rule(struct _rule *rule)
 {
 	if (!rule->table)
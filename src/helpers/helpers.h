@@ -12,6 +12,7 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <sys/ioctl.h>
+#include "trace.h"
 
 #define MIN_PIDS                10
 #define MAX_PIDS                32768
@@ -23,12 +24,14 @@
 #define COMAND_MAX_SIZE         200
 #define MAX_MEMORY_ALLOCABLE    4294967296
 #define CPU_SHARES_CHUNK_SIZE   0x400 
+#define MAX_PASSED_FDS          8
 #ifndef ISOLATE_NETNS_H
 #define ISOLATE_NETNS_H
 
 #define DEBUG                   0     // used to enamble debug prints
 
 #define printErr(msg)   do { \
+                            trace_error(errno); \
                             fprintf(stdout, "[ERROR] - %s failed (errno: %d):" \
                             "%s\n", msg, errno, strerror(errno)); \
                             exit(EXIT_FAILURE); \
@@ -60,6 +63,19 @@ struct _addr_t {
 	unsigned int mask;
 };
 
+#define NL_BATCH_SIZE   8192    /* netlink batch arena size */
+
+/* An append-only arena of netlink requests sent with a single sendmsg().
+ * Every request asks for an ACK, ACKs are matched back to their request
+ * by sequence number. */
+struct nl_batch {
+	char buf[NL_BATCH_SIZE];
+	size_t len;                 /* bytes used by the finished messages */
+	struct nlmsghdr *last;      /* message being built, if any */
+	__u32 seq;                  /* sequence number of the first message */
+	int n_msgs;
+};
+
 #define NLMSG_TAIL(nmsg) \
 	((struct rtattr *) (((void *) (nmsg)) + NLMSG_ALIGN((nmsg)->nlmsg_len)))
 
@@ -73,6 +89,22 @@ void get_child_entrypoint(int optind, char **arguments, size_t size,
 
 int drop_root_privileges(void);
 
+/* send len bytes of buf along with n_fds file descriptors (SCM_RIGHTS) */
+ssize_t send_fds(int sock, const void *buf, size_t len,
+    const int *fds, int n_fds);
+
+/* receive a message and up to *n_fds file descriptors. On return *n_fds
+ * holds the number of descriptors actually received. */
+ssize_t recv_fds(int sock, void *buf, size_t len, int *fds, int *n_fds);
+
+/* open target for writing: a file, created or appended to, or the unix
+ * stream socket unix:<path>. Returns the fd or -1. */
+int open_output(const char *target, int *is_socket);
+
+/* write the whole buffer, a consumer closing its socket does not raise
+ * SIGPIPE. Returns 0 or -1. */
+int write_output(int fd, int is_socket, const void *buf, size_t len);
+
 
 
 #define NLMSG_STRING(nl, attr, data) \
@@ -84,6 +116,10 @@ int _nl_socket_init(void);
 int _nlmsg_recieve(int fd);
 int _nlmsg_send(int fd, struct nlmsghdr *nlmsg);
 void _nlmsg_put(struct nlmsghdr *nlmsg, int type, void *data, size_t len);
+void _nlbatch_init(struct nl_batch *batch);
+struct nlmsghdr *_nlbatch_add(struct nl_batch *batch, int type, int flags,
+	size_t hdrlen);
+int _nlbatch_commit(int fd, struct nl_batch *batch);
 int _ipt_rule(struct _rule *rule);
 struct _addr_t *  _init_addr(const char *ip);
 void _free_addr(struct _addr_t *addr);
@@ -0,0 +1,85 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/mman.h>
+#include "phases.h"
+#include "trace.h"
+#include "helpers.h"
+
+static struct phase_times *times = NULL;
+/* the batch workers each start their own container */
+static __thread enum runc_phase current = PHASE_CGROUP;
+
+static const char *phase_names[N_PHASES] = {
+	[PHASE_CGROUP]     = "cgroup",
+	[PHASE_CLONE]      = "clone",
+	[PHASE_NETNS]      = "netns",
+	[PHASE_UID_MAP]    = "uid_map",
+	[PHASE_ROOTFS]     = "rootfs",
+	[PHASE_PIVOT_ROOT] = "pivot_root",
+	[PHASE_SECCOMP]    = "seccomp",
+	[PHASE_EXEC]       = "exec",
+};
+
+unsigned long long monotonic_ns()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void phase_timing_enable()
+{
+	if (times)
+		return;
+
+	/* shared with every child cloned from now on */
+	times = mmap(NULL, sizeof(struct phase_times), PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+	if (times == MAP_FAILED)
+		printErr("phase timing mmap");
+
+	phase_timing_reset();
+}
+
+struct phase_times *phase_timing_get()
+{
+	return times;
+}
+
+void phase_timing_reset()
+{
+	if (times)
+		memset(times, 0, sizeof(struct phase_times));
+}
+
+void phase_begin(enum runc_phase phase)
+{
+	current = phase;
+	trace_event(phase, TRACE_BEGIN, 0);
+
+	if (times)
+		times->begin[phase] = monotonic_ns();
+}
+
+void phase_end(enum runc_phase phase)
+{
+	trace_event(phase, TRACE_END, 0);
+
+	if (times)
+		times->end[phase] = monotonic_ns();
+}
+
+enum runc_phase phase_current()
+{
+	return current;
+}
+
+const char *phase_name(enum runc_phase phase)
+{
+	return phase_names[phase];
+}
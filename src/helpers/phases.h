@@ -0,0 +1,61 @@
+/**
+ * Startup phases of a container.
+ *
+ * runc() goes through a fixed sequence of steps, some done by the parent
+ * and some by the cloned child. When timing is enabled every step records
+ * a monotonic begin/end timestamp into a page mapped MAP_SHARED before
+ * clone(), so the child timestamps are visible to the parent.
+ *
+ *   parent: cgroup -> clone -> netns -> uid_map -------------------------------+
+ *   child:                  rootfs -> pivot_root -> seccomp -> exec  ------->  |
+ *
+ * The end of the exec phase is seen by the parent as EOF on a
+ * close-on-exec pipe. It is read once the network and the uid/gid maps are
+ * done, so it is an upper bound when the child is faster than the parent.
+ *
+ * Every begin/end is also reported to the phase trace (see trace.h).
+ * When timing is disabled only the trace is fed.
+ */
+#ifndef PHASES_H
+#define PHASES_H
+
+enum runc_phase {
+	PHASE_CGROUP,
+	PHASE_CLONE,
+	PHASE_NETNS,
+	PHASE_UID_MAP,
+	PHASE_ROOTFS,
+	PHASE_PIVOT_ROOT,
+	PHASE_SECCOMP,
+	PHASE_EXEC,
+	N_PHASES
+};
+
+/* begin/end timestamps in ns, 0 if the phase has not been run */
+struct phase_times {
+	unsigned long long begin[N_PHASES];
+	unsigned long long end[N_PHASES];
+};
+
+/* map the shared timestamps page, from now on every phase is recorded */
+void phase_timing_enable();
+
+/* the recorded timestamps or NULL if timing is disabled */
+struct phase_times *phase_timing_get();
+
+/* forget the timestamps of the previous container */
+void phase_timing_reset();
+
+void phase_begin(enum runc_phase phase);
+void phase_end(enum runc_phase phase);
+
+/* the last phase started by this thread */
+enum runc_phase phase_current();
+
+/* printable name of a phase */
+const char *phase_name(enum runc_phase phase);
+
+/* CLOCK_MONOTONIC in ns */
+unsigned long long monotonic_ns();
+
+#endif //PHASES_H
@@ -0,0 +1,27 @@
+/**
+ * SHA-256 (FIPS 180-4), used to name the layers of the layer store after
+ * their content. Data can be fed incrementally while it is streamed.
+ */
+#ifndef SHA256_H
+#define SHA256_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define SHA256_DIGEST_LEN   32
+#define SHA256_HEX_LEN      (2 * SHA256_DIGEST_LEN)
+
+struct sha256_ctx {
+	uint32_t state[8];
+	uint64_t len;                   /* bytes hashed so far */
+	uint8_t block[64];
+	size_t block_len;
+};
+
+void sha256_init(struct sha256_ctx *ctx);
+void sha256_update(struct sha256_ctx *ctx, const void *data, size_t len);
+
+/* hex is filled with SHA256_HEX_LEN digits and a NUL */
+void sha256_final_hex(struct sha256_ctx *ctx, char *hex);
+
+#endif //SHA256_H
@@ -0,0 +1,131 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "trace.h"
+#include "phases.h"
+#include "helpers.h"
+
+#define TRACE_RING_MASK     (TRACE_RING_SIZE - 1)
+#define TRACE_WRITE_BATCH   64      /* records per write() */
+
+struct trace_ring {
+	uint64_t head;                  /* next slot to reserve, atomic */
+	uint64_t tail;                  /* next slot to export, consumer only */
+	uint64_t lost;                  /* records overwritten before export */
+	struct trace_event events[TRACE_RING_SIZE];
+};
+
+static struct trace_ring *ring = NULL;
+static int trace_fd = -1;
+static pid_t trace_owner = 0;       /* the only consumer */
+static uint32_t n_containers = 0;   /* numbered so far, atomic */
+static __thread uint32_t container = 0;
+
+static void trace_atexit()
+{
+	/* the children inherit the handler, only the consumer flushes */
+	if (getpid() == trace_owner)
+		trace_flush();
+}
+
+void trace_enable(int fd)
+{
+	if (ring)
+		return;
+
+	/* the entrypoint must not inherit the trace fd */
+	if (fcntl(fd, F_SETFD, FD_CLOEXEC) == -1)
+		printErr("trace fd");
+
+	ring = mmap(NULL, sizeof(struct trace_ring), PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+	if (ring == MAP_FAILED) {
+		ring = NULL;
+		printErr("trace ring mmap");
+	}
+
+	trace_fd = fd;
+	trace_owner = getpid();
+	atexit(trace_atexit);
+}
+
+void trace_container()
+{
+	container = __atomic_add_fetch(&n_containers, 1, __ATOMIC_RELAXED);
+}
+
+void trace_event(int phase, int type, int err)
+{
+	struct trace_event *ev;
+	uint64_t slot;
+
+	if (!ring)
+		return;
+
+	slot = __atomic_fetch_add(&ring->head, 1, __ATOMIC_RELAXED);
+	ev = &ring->events[slot & TRACE_RING_MASK];
+
+	ev->ts_ns     = monotonic_ns();
+	ev->container = container;
+	ev->err       = err;
+	ev->phase     = phase;
+	ev->type      = type;
+
+	/* publish the record */
+	__atomic_store_n(&ev->seq, (uint32_t) (slot + 1), __ATOMIC_RELEASE);
+}
+
+void trace_error(int err)
+{
+	trace_event(phase_current(), TRACE_ERROR, err);
+}
+
+void trace_flush()
+{
+	struct trace_event buf[TRACE_WRITE_BATCH];
+	uint64_t head;
+	int n = 0;
+
+	if (!ring)
+		return;
+
+	head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+
+	/* the producers lapped us */
+	if (head - ring->tail > TRACE_RING_SIZE) {
+		ring->lost += head - ring->tail - TRACE_RING_SIZE;
+		ring->tail = head - TRACE_RING_SIZE;
+	}
+
+	for (; ring->tail < head; ring->tail++) {
+		struct trace_event *ev = &ring->events[ring->tail & TRACE_RING_MASK];
+
+		/* reserved but not yet published: export it next time */
+		if (__atomic_load_n(&ev->seq, __ATOMIC_ACQUIRE)
+				!= (uint32_t) (ring->tail + 1))
+			break;
+
+		buf[n++] = *ev;
+
+		if (n == TRACE_WRITE_BATCH) {
+			if (write(trace_fd, buf, sizeof(buf)) == -1)
+				fprintf(stderr, "=> trace write: %s\n", strerror(errno));
+			n = 0;
+		}
+	}
+
+	if (n && write(trace_fd, buf, n * sizeof(struct trace_event)) == -1)
+		fprintf(stderr, "=> trace write: %s\n", strerror(errno));
+
+	if (ring->lost) {
+		fprintf(stderr, "=> %llu trace events lost\n",
+			(unsigned long long) ring->lost);
+		ring->lost = 0;
+	}
+}
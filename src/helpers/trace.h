@@ -0,0 +1,62 @@
+/**
+ * Phase tracing.
+ *
+ * A low overhead trace of the startup phases (see phases.h) that can stay
+ * enabled in production. Events are fixed-size binary records written into
+ * a preallocated ring buffer mapped MAP_SHARED, so the parent and every
+ * child cloned afterwards write into the same ring without any lock:
+ *
+ *   - a producer reserves a slot with an atomic increment of head, fills
+ *     it and then publishes it by storing its sequence number;
+ *   - the process that enabled tracing is the only consumer. It copies
+ *     the published records to the trace file descriptor when a container
+ *     terminates (trace_flush()).
+ *
+ * If the consumer falls behind by more than TRACE_RING_SIZE records the
+ * oldest ones are overwritten and accounted as lost.
+ *
+ * Every event carries the number of its container: the children of a
+ * container all are pid 1 of their own PID namespace, and the batch
+ * workers share the pid of the runtime.
+ *
+ * The file descriptor receives a plain stream of struct trace_event.
+ */
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+#define TRACE_RING_SIZE     1024    /* records, must be a power of two */
+
+enum trace_type {
+	TRACE_BEGIN,                    /* a phase started */
+	TRACE_END,                      /* a phase completed */
+	TRACE_ERROR,                    /* a phase failed, see err */
+};
+
+struct trace_event {
+	uint64_t ts_ns;                 /* CLOCK_MONOTONIC timestamp */
+	uint32_t seq;                   /* event number, starting from 1 */
+	uint32_t container;             /* see trace_container() */
+	int32_t err;                    /* errno of a TRACE_ERROR */
+	uint16_t phase;                 /* enum runc_phase */
+	uint16_t type;                  /* enum trace_type */
+};
+
+/* map the ring and export it to fd, must be called before any clone() */
+void trace_enable(int fd);
+
+/* Number a new container, from 1: the events of the calling thread, and
+ * of the children it clones from now on, carry that number. */
+void trace_container();
+
+/* append an event, a no-op if tracing is disabled */
+void trace_event(int phase, int type, int err);
+
+/* record a failure of the current phase */
+void trace_error(int err);
+
+/* copy the published events to the trace fd */
+void trace_flush();
+
+#endif //TRACE_H
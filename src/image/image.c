@@ -0,0 +1,226 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "image.h"
+#include "../helpers/helpers.h"
+#include "../../config.h"
+
+#define IMAGE_INDEX_PATH    LAYER_STORE_PATH "/images.idx"
+
+/* FNV-1a, 32 bit */
+static uint32_t image_hash(const char *name)
+{
+    uint32_t hash = 2166136261u;
+
+    while (*name) {
+        hash ^= (unsigned char) *name++;
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+void image_store_mkdirs()
+{
+    if (mkdir(LAYER_STORE_PATH, 0755) && errno != EEXIST)
+        printErr("mkdir " LAYER_STORE_PATH);
+
+    if (mkdir(LAYER_STORE_PATH "/layers", 0755) && errno != EEXIST)
+        printErr("mkdir " LAYER_STORE_PATH "/layers");
+}
+
+int image_store_open(struct image_store *store, int writable)
+{
+    struct stat st;
+
+    store->writable = writable;
+
+    if (writable) {
+        image_store_mkdirs();
+        store->fd = open(IMAGE_INDEX_PATH, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    } else {
+        store->fd = open(IMAGE_INDEX_PATH, O_RDONLY | O_CLOEXEC);
+    }
+
+    if (store->fd == -1) {
+        if (!writable && errno == ENOENT)
+            return -1;
+        printErr("open " IMAGE_INDEX_PATH);
+    }
+
+    /* a reader must not see an index being created, nor an entry being
+     * replaced */
+    if (flock(store->fd, writable ? LOCK_EX : LOCK_SH) == -1)
+        printErr("flock " IMAGE_INDEX_PATH);
+
+    if (fstat(store->fd, &st) == -1)
+        printErr("fstat " IMAGE_INDEX_PATH);
+
+    /* a new index, or one being created by somebody else */
+    if (st.st_size != sizeof(struct image_index)) {
+        if (!writable || st.st_size != 0) {
+            fprintf(stderr, "=> %s is not a valid image index\n",
+                IMAGE_INDEX_PATH);
+            exit(EXIT_FAILURE);
+        }
+
+        if (ftruncate(store->fd, sizeof(struct image_index)) == -1)
+            printErr("ftruncate " IMAGE_INDEX_PATH);
+    }
+
+    store->index = mmap(NULL, sizeof(struct image_index),
+        writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED,
+        store->fd, 0);
+
+    if (store->index == MAP_FAILED)
+        printErr("mmap " IMAGE_INDEX_PATH);
+
+    if (writable && store->index->magic[0] == '\0') {
+        strcpy(store->index->magic, IMAGE_INDEX_MAGIC);
+        store->index->n_buckets = IMAGE_INDEX_BUCKETS;
+    }
+
+    if (strcmp(store->index->magic, IMAGE_INDEX_MAGIC)
+            || store->index->n_buckets != IMAGE_INDEX_BUCKETS) {
+        fprintf(stderr, "=> %s is not a valid image index\n",
+            IMAGE_INDEX_PATH);
+        exit(EXIT_FAILURE);
+    }
+
+    return 0;
+}
+
+void image_store_close(struct image_store *store)
+{
+    if (store->writable && msync(store->index, sizeof(struct image_index),
+            MS_SYNC) == -1)
+        printErr("msync " IMAGE_INDEX_PATH);
+
+    munmap(store->index, sizeof(struct image_index));
+
+    /* drops the lock too */
+    close(store->fd);
+}
+
+/* the bucket of name, or the free bucket where it would be stored */
+static struct image_entry *image_bucket(struct image_index *index,
+    const char *name, uint32_t hash)
+{
+    struct image_entry *entry;
+
+    for (uint32_t i = 0; i < IMAGE_INDEX_BUCKETS; ++i) {
+        entry = &index->entries[(hash + i) % IMAGE_INDEX_BUCKETS];
+
+        if (entry->name[0] == '\0')
+            return entry;
+
+        if (entry->hash == hash && !strcmp(entry->name, name))
+            return entry;
+    }
+
+    return NULL;
+}
+
+const struct image_entry *image_lookup(struct image_store *store,
+    const char *name)
+{
+    struct image_entry *entry;
+
+    entry = image_bucket(store->index, name, image_hash(name));
+
+    if (!entry || entry->name[0] == '\0')
+        return NULL;
+
+    return entry;
+}
+
+void image_register(struct image_store *store, const char *name,
+    const char **layers, int n_layers)
+{
+    struct image_entry *entry;
+    uint32_t hash = image_hash(name);
+
+    if (strlen(name) >= IMAGE_NAME_MAX || name[0] == '\0') {
+        fprintf(stderr, "=> invalid image name %s\n", name);
+        exit(EXIT_FAILURE);
+    }
+
+    if (n_layers < 1 || n_layers > IMAGE_MAX_LAYERS) {
+        fprintf(stderr, "=> an image has [1-%d] layers\n", IMAGE_MAX_LAYERS);
+        exit(EXIT_FAILURE);
+    }
+
+    if (!(entry = image_bucket(store->index, name, hash))) {
+        fprintf(stderr, "=> the image index is full\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (entry->name[0] == '\0')
+        ++store->index->n_images;
+
+    for (int i = 0; i < n_layers; ++i) {
+        if (strlen(layers[i]) != LAYER_ID_LEN) {
+            fprintf(stderr, "=> invalid layer id %s\n", layers[i]);
+            exit(EXIT_FAILURE);
+        }
+        memcpy(entry->layers[i], layers[i], LAYER_ID_LEN + 1);
+    }
+
+    entry->n_layers = n_layers;
+    entry->hash = hash;
+
+    /* the name goes last: it is what makes the bucket used */
+    strcpy(entry->name, name);
+}
+
+void layer_path(const char *id, char *path, size_t size)
+{
+    if (snprintf(path, size, LAYER_STORE_PATH "/layers/%s", id) >= size) {
+        fprintf(stderr, "=> layer path too long\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+char *image_resolve(const char *image)
+{
+    const struct image_entry *entry;
+    struct image_store store;
+    char *lowerdir;
+    size_t len = 0;
+
+    if (!(lowerdir = malloc(PATH_MAX)))
+        printErr("malloc at image_resolve");
+
+    if (!image) {
+        if (realpath(FILE_SYSTEM_PATH, lowerdir) == NULL)
+            printErr("realpath root_fs");
+        return lowerdir;
+    }
+
+    if (image_store_open(&store, 0) == -1
+            || !(entry = image_lookup(&store, image))) {
+        fprintf(stderr, "=> image %s not found in " LAYER_STORE_PATH "\n",
+            image);
+        exit(EXIT_FAILURE);
+    }
+
+    /* overlayfs wants the top layer first */
+    for (int i = entry->n_layers - 1; i >= 0; --i) {
+        if (len)
+            lowerdir[len++] = ':';
+
+        layer_path(entry->layers[i], &lowerdir[len], PATH_MAX - len);
+        len += strlen(&lowerdir[len]);
+    }
+
+    image_store_close(&store);
+    return lowerdir;
+}
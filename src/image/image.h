@@ -0,0 +1,82 @@
+/**
+ * Layer store.
+ *
+ * Images are stacks of read-only layers. Every layer is a directory of the
+ * store named after the sha256 of its content, so two images built on the
+ * same base share it on disk and in the page cache:
+ *
+ *   LAYER_STORE_PATH
+ *   ├── images.idx               image name -> layer chain
+ *   └── layers
+ *       ├── <sha256>             a layer, ready to be an overlay lowerdir
+ *       └── ...
+ *
+ * images.idx is a fixed-size hash table mapped in memory. The name of an
+ * image is hashed (FNV-1a) to its bucket, collisions are resolved by linear
+ * probing, so a lookup is a couple of string compares with no file system
+ * scan. The index is never shrunk: an image registered again replaces its
+ * own entry.
+ *
+ * Writers hold an exclusive flock() on the index while they update it,
+ * readers a shared one while they read it: a lookup never sees a half
+ * created index or a layer chain being replaced.
+ */
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define IMAGE_NAME_MAX          64      /* including the NUL */
+#define IMAGE_MAX_LAYERS        16
+#define IMAGE_INDEX_BUCKETS     256     /* max images in the store */
+#define LAYER_ID_LEN            64      /* sha256 in hex */
+#define IMAGE_INDEX_MAGIC       "MYDIDX1"
+
+struct image_entry {
+    char name[IMAGE_NAME_MAX];          /* empty if the bucket is free */
+    uint32_t n_layers;
+    uint32_t hash;
+    char layers[IMAGE_MAX_LAYERS][LAYER_ID_LEN + 1];   /* base layer first */
+};
+
+/* layout of images.idx */
+struct image_index {
+    char magic[8];
+    uint32_t n_buckets;
+    uint32_t n_images;
+    struct image_entry entries[IMAGE_INDEX_BUCKETS];
+};
+
+struct image_store {
+    int fd;
+    int writable;
+    struct image_index *index;
+};
+
+/* create LAYER_STORE_PATH and its layers directory if needed */
+void image_store_mkdirs();
+
+/* map the index, locked until image_store_close(): shared when read-only,
+ * exclusive when writable. A writable store creates the index if needed.
+ * Returns -1 if a read-only index is missing. */
+int image_store_open(struct image_store *store, int writable);
+
+void image_store_close(struct image_store *store);
+
+/* the entry of the image called name or NULL */
+const struct image_entry *image_lookup(struct image_store *store,
+    const char *name);
+
+/* add or replace the image name made of layers, base layer first */
+void image_register(struct image_store *store, const char *name,
+    const char **layers, int n_layers);
+
+/* LAYER_STORE_PATH/layers/<id> */
+void layer_path(const char *id, char *path, size_t size);
+
+/* Resolve an image to the lowerdir of its overlay, the top layer first.
+ * A NULL image is the FILE_SYSTEM_PATH root_fs. The result is malloc()ed. */
+char *image_resolve(const char *image);
+
+#endif //IMAGE_H
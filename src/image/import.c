@@ -0,0 +1,979 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <ftw.h>
+#include <pthread.h>
+#include <zlib.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/xattr.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+#include <linux/openat2.h>
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+#include "import.h"
+#include "image.h"
+#include "../helpers/helpers.h"
+#include "../helpers/sha256.h"
+#include "../../config.h"
+
+#ifndef SYS_openat2
+#define SYS_openat2 437
+#endif
+
+#define TAR_BLOCK       512
+#define WHITEOUT        ".wh."
+#define WHITEOUT_OPAQUE ".wh..wh..opq"
+#define PENDING_BUCKETS 4096
+
+/* POSIX ustar header, GNU tar uses the same layout up to prefix */
+struct tar_header {
+    char name[100];
+    char mode[8];
+    char uid[8];
+    char gid[8];
+    char size[12];
+    char mtime[12];
+    char chksum[8];
+    char typeflag;
+    char linkname[100];
+    char magic[6];
+    char version[2];
+    char uname[32];
+    char gname[32];
+    char devmajor[8];
+    char devminor[8];
+    char prefix[155];
+    char pad[12];
+};
+
+/* what the parser knows about the current entry */
+struct tar_entry {
+    char path[PATH_MAX];
+    char link[PATH_MAX];
+    char type;
+    mode_t mode;
+    uid_t uid;
+    gid_t gid;
+    time_t mtime;
+    unsigned long long size;
+    dev_t dev;
+};
+
+/* the uncompressed tar, produced by the decompression thread */
+struct tar_stream {
+    const char *archive;
+    int pipe_fd[2];
+    struct sha256_ctx sha;
+    pthread_t thread;
+    char buf[IMPORT_CHUNK];
+    size_t pos;
+    size_t len;
+};
+
+/* the contents of a regular file, written by a worker */
+struct write_job {
+    struct write_job *next;
+    struct tar_entry entry;
+    char *data;
+};
+
+/* writer pool, protected by lock */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t job_ready = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t job_done = PTHREAD_COND_INITIALIZER;
+static struct write_job *queue_head = NULL, *queue_tail = NULL;
+static size_t inflight = 0;             /* bytes queued or being written */
+static int busy = 0;                    /* jobs queued or being written */
+static int stopping = 0;
+static int layer_fd = -1;               /* root of the layer being written */
+
+/* jobs queued or being written, counted by the hash of their path */
+static unsigned int pending[PENDING_BUCKETS];
+
+static void write_all(int fd, const void *buf, size_t len)
+{
+    const char *p = buf;
+    ssize_t ret;
+
+    while (len) {
+        if ((ret = write(fd, p, len)) == -1) {
+            if (errno == EINTR)
+                continue;
+            printErr("write");
+        }
+        p += ret;
+        len -= ret;
+    }
+}
+
+/* open path of the layer, never leaving the layer directory */
+static int layer_open(const char *path, int flags, mode_t mode)
+{
+    struct open_how how;
+    int fd;
+
+    memset(&how, 0, sizeof(how));
+    how.flags = flags | O_CLOEXEC;
+    how.mode = (flags & O_CREAT) ? mode : 0;
+    how.resolve = RESOLVE_IN_ROOT | RESOLVE_NO_MAGICLINKS;
+
+    while ((fd = syscall(SYS_openat2, layer_fd, path, &how, sizeof(how))) == -1
+            && errno == EAGAIN)
+        ;
+
+    return fd;
+}
+
+/* the directory containing path, *base is set to its last component */
+static int layer_open_parent(char *path, const char **base)
+{
+    char *slash = strrchr(path, '/');
+    int fd;
+
+    if (!slash) {
+        *base = path;
+        return layer_open(".", O_PATH | O_DIRECTORY, 0);
+    }
+
+    *slash = '\0';
+    fd = layer_open(path, O_PATH | O_DIRECTORY, 0);
+    *slash = '/';
+    *base = slash + 1;
+
+    if (fd == -1) {
+        fprintf(stderr, "=> missing parent directory of %s\n", path);
+        printErr("open parent");
+    }
+
+    return fd;
+}
+
+/* owner, permissions and modification time of an open regular file */
+static void set_file_attributes(int fd, struct tar_entry *entry)
+{
+    struct timespec times[2] = {
+        { .tv_nsec = UTIME_OMIT },
+        { .tv_sec = entry->mtime }
+    };
+
+    if (fchown(fd, entry->uid, entry->gid) == -1)
+        printErr("fchown");
+
+    /* after fchown(), which clears the set-user-ID bits */
+    if (fchmod(fd, entry->mode) == -1)
+        printErr("fchmod");
+
+    if (futimens(fd, times) == -1)
+        printErr("futimens");
+}
+
+static void write_regular_file(struct tar_entry *entry, const char *data)
+{
+    int fd;
+
+    fd = layer_open(entry->path, O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW,
+        0600);
+    if (fd == -1) {
+        fprintf(stderr, "=> cannot create %s\n", entry->path);
+        printErr("open");
+    }
+
+    write_all(fd, data, entry->size);
+    set_file_attributes(fd, entry);
+    close(fd);
+}
+
+static unsigned int path_bucket(const char *path)
+{
+    unsigned int hash = 5381;
+
+    while (*path)
+        hash = hash * 33 + (unsigned char) *path++;
+
+    return hash % PENDING_BUCKETS;
+}
+
+static void *import_worker(void *unused)
+{
+    struct write_job *job;
+
+    for (;;) {
+        pthread_mutex_lock(&lock);
+        while (!queue_head && !stopping)
+            pthread_cond_wait(&job_ready, &lock);
+
+        if (!queue_head) {
+            pthread_mutex_unlock(&lock);
+            return NULL;
+        }
+
+        job = queue_head;
+        if (!(queue_head = job->next))
+            queue_tail = NULL;
+        pthread_mutex_unlock(&lock);
+
+        write_regular_file(&job->entry, job->data);
+
+        pthread_mutex_lock(&lock);
+        inflight -= job->entry.size;
+        --busy;
+        --pending[path_bucket(job->entry.path)];
+        pthread_cond_broadcast(&job_done);
+        pthread_mutex_unlock(&lock);
+
+        free(job->data);
+        free(job);
+    }
+}
+
+/* hand a file to the writers, waiting for room if too much is queued */
+static void import_queue(struct tar_entry *entry, char *data)
+{
+    struct write_job *job = malloc(sizeof(struct write_job));
+
+    if (!job)
+        printErr("malloc at import_queue");
+
+    job->next = NULL;
+    job->entry = *entry;
+    job->data = data;
+
+    pthread_mutex_lock(&lock);
+    while (inflight && inflight + entry->size > IMPORT_MAX_INFLIGHT)
+        pthread_cond_wait(&job_done, &lock);
+
+    if (queue_tail)
+        queue_tail->next = job;
+    else
+        queue_head = job;
+    queue_tail = job;
+
+    inflight += entry->size;
+    ++busy;
+    ++pending[path_bucket(entry->path)];
+    pthread_cond_signal(&job_ready);
+    pthread_mutex_unlock(&lock);
+}
+
+/* wait for every queued file: needed before an entry that depends on a
+ * previous one (hard links, whiteouts) */
+static void import_drain()
+{
+    pthread_mutex_lock(&lock);
+    while (busy)
+        pthread_cond_wait(&job_done, &lock);
+    pthread_mutex_unlock(&lock);
+}
+
+/* Wait for the queued writes of path. A path can appear more than once in
+ * a tar, the last entry wins: an older file still queued must not be
+ * written over it, nor fail on the symlink that replaced it. */
+static void import_wait_path(const char *path)
+{
+    unsigned int bucket = path_bucket(path);
+
+    pthread_mutex_lock(&lock);
+    while (pending[bucket])
+        pthread_cond_wait(&job_done, &lock);
+    pthread_mutex_unlock(&lock);
+}
+
+static void *decompress_thread(void *arg)
+{
+    struct tar_stream *stream = arg;
+    unsigned char *in = malloc(IMPORT_CHUNK);
+    unsigned char *out = malloc(IMPORT_CHUNK);
+    int out_fd = stream->pipe_fd[1];
+    size_t have = 0;
+    ssize_t ret;
+    int fd;
+
+    if (!in || !out)
+        printErr("malloc at decompress_thread");
+
+    if ((fd = open(stream->archive, O_RDONLY | O_CLOEXEC)) == -1)
+        printErr("open layer archive");
+
+    while ((ret = read(fd, in, IMPORT_CHUNK)) == -1 && errno == EINTR)
+        ;
+    if (ret == -1)
+        printErr("read layer archive");
+    have = ret;
+
+    if (have >= 2 && in[0] == 0x1f && in[1] == 0x8b) {
+        z_stream zs;
+        int zret = Z_OK;
+
+        memset(&zs, 0, sizeof(zs));
+        /* 15 + 32: maximum window, gzip or zlib header detection */
+        if (inflateInit2(&zs, 15 + 32) != Z_OK) {
+            fprintf(stderr, "=> inflateInit2 failed\n");
+            exit(EXIT_FAILURE);
+        }
+
+        while (have) {
+            zs.next_in = in;
+            zs.avail_in = have;
+
+            do {
+                zs.next_out = out;
+                zs.avail_out = IMPORT_CHUNK;
+                zret = inflate(&zs, Z_NO_FLUSH);
+
+                if (zret != Z_OK && zret != Z_STREAM_END
+                        && zret != Z_BUF_ERROR) {
+                    fprintf(stderr, "=> corrupted gzip stream in %s\n",
+                        stream->archive);
+                    exit(EXIT_FAILURE);
+                }
+
+                sha256_update(&stream->sha, out, IMPORT_CHUNK - zs.avail_out);
+                write_all(out_fd, out, IMPORT_CHUNK - zs.avail_out);
+
+                /* concatenated gzip members */
+                if (zret == Z_STREAM_END && zs.avail_in)
+                    inflateReset(&zs);
+            } while (zs.avail_out == 0 || (zret == Z_STREAM_END
+                        && zs.avail_in));
+
+            while ((ret = read(fd, in, IMPORT_CHUNK)) == -1 && errno == EINTR)
+                ;
+            if (ret == -1)
+                printErr("read layer archive");
+            have = ret;
+        }
+
+        if (zret != Z_STREAM_END) {
+            fprintf(stderr, "=> truncated gzip stream in %s\n",
+                stream->archive);
+            exit(EXIT_FAILURE);
+        }
+
+        inflateEnd(&zs);
+#ifdef HAVE_ZSTD
+    } else if (have >= 4 && in[0] == 0x28 && in[1] == 0xb5
+            && in[2] == 0x2f && in[3] == 0xfd) {
+        ZSTD_DStream *zds = ZSTD_createDStream();
+        ZSTD_inBuffer zin;
+        ZSTD_outBuffer zout;
+        size_t zret;
+
+        if (!zds || ZSTD_isError(ZSTD_initDStream(zds))) {
+            fprintf(stderr, "=> ZSTD_initDStream failed\n");
+            exit(EXIT_FAILURE);
+        }
+
+        while (have) {
+            zin.src = in;
+            zin.size = have;
+            zin.pos = 0;
+
+            while (zin.pos < zin.size) {
+                zout.dst = out;
+                zout.size = IMPORT_CHUNK;
+                zout.pos = 0;
+
+                zret = ZSTD_decompressStream(zds, &zout, &zin);
+                if (ZSTD_isError(zret)) {
+                    fprintf(stderr, "=> corrupted zstd stream in %s: %s\n",
+                        stream->archive, ZSTD_getErrorName(zret));
+                    exit(EXIT_FAILURE);
+                }
+
+                sha256_update(&stream->sha, out, zout.pos);
+                write_all(out_fd, out, zout.pos);
+            }
+
+            while ((ret = read(fd, in, IMPORT_CHUNK)) == -1 && errno == EINTR)
+                ;
+            if (ret == -1)
+                printErr("read layer archive");
+            have = ret;
+        }
+
+        ZSTD_freeDStream(zds);
+#endif
+    } else {
+        while (have) {
+            sha256_update(&stream->sha, in, have);
+            write_all(out_fd, in, have);
+
+            while ((ret = read(fd, in, IMPORT_CHUNK)) == -1 && errno == EINTR)
+                ;
+            if (ret == -1)
+                printErr("read layer archive");
+            have = ret;
+        }
+    }
+
+    close(fd);
+    free(in);
+    free(out);
+
+    /* EOF for the parser */
+    close(out_fd);
+    return NULL;
+}
+
+/* read exactly len bytes of the tar, 0 at the end of the stream */
+static int tar_read(struct tar_stream *stream, void *buf, size_t len)
+{
+    char *p = buf;
+    size_t n;
+    ssize_t ret;
+
+    while (len) {
+        if (stream->pos == stream->len) {
+            ret = read(stream->pipe_fd[0], stream->buf, sizeof(stream->buf));
+            if (ret == -1 && errno == EINTR)
+                continue;
+            if (ret == -1)
+                printErr("read tar stream");
+            if (ret == 0)
+                return 0;
+
+            stream->pos = 0;
+            stream->len = ret;
+        }
+
+        n = stream->len - stream->pos < len ? stream->len - stream->pos : len;
+        if (p) {
+            memcpy(p, &stream->buf[stream->pos], n);
+            p += n;
+        }
+        stream->pos += n;
+        len -= n;
+    }
+
+    return 1;
+}
+
+static void tar_read_full(struct tar_stream *stream, void *buf, size_t len)
+{
+    if (!tar_read(stream, buf, len)) {
+        fprintf(stderr, "=> truncated tar stream in %s\n", stream->archive);
+        exit(EXIT_FAILURE);
+    }
+}
+
+/* the padding following size bytes of data */
+static void tar_skip_padding(struct tar_stream *stream,
+    unsigned long long size)
+{
+    if (size % TAR_BLOCK)
+        tar_read_full(stream, NULL, TAR_BLOCK - size % TAR_BLOCK);
+}
+
+/* octal, or base-256 when the high bit of the first byte is set */
+static unsigned long long tar_number(const char *field, size_t len)
+{
+    unsigned long long value = 0;
+    size_t i = 0;
+
+    if ((unsigned char) field[0] & 0x80) {
+        value = (unsigned char) field[0] & 0x7f;
+        for (i = 1; i < len; ++i)
+            value = (value << 8) | (unsigned char) field[i];
+        return value;
+    }
+
+    while (i < len && (field[i] == ' ' || field[i] == '\0'))
+        ++i;
+    for (; i < len && field[i] >= '0' && field[i] <= '7'; ++i)
+        value = (value << 3) | (field[i] - '0');
+
+    return value;
+}
+
+static int tar_checksum_ok(struct tar_header *header)
+{
+    unsigned char *p = (unsigned char *) header;
+    unsigned long long sum = 0;
+
+    for (size_t i = 0; i < TAR_BLOCK; ++i) {
+        if (i >= offsetof(struct tar_header, chksum)
+                && i < offsetof(struct tar_header, chksum) + 8)
+            sum += ' ';
+        else
+            sum += p[i];
+    }
+
+    return sum == tar_number(header->chksum, sizeof(header->chksum));
+}
+
+/* data of a GNU long name/link or of a pax header, NUL terminated */
+static char *tar_read_extension(struct tar_stream *stream,
+    unsigned long long size)
+{
+    char *data;
+
+    if (size >= PATH_MAX * 16) {
+        fprintf(stderr, "=> tar extended header too big\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (!(data = malloc(size + 1)))
+        printErr("malloc at tar_read_extension");
+
+    tar_read_full(stream, data, size);
+    tar_skip_padding(stream, size);
+    data[size] = '\0';
+
+    return data;
+}
+
+/* "<len> <key>=<value>\n" records of a pax extended header */
+static void pax_parse(char *data, unsigned long long size,
+    struct tar_entry *next)
+{
+    char *record = data, *key, *value, *end;
+    unsigned long len;
+
+    while (record < data + size) {
+        len = strtoul(record, &key, 10);
+        if (len == 0 || *key != ' ' || record + len > data + size)
+            break;
+
+        end = record + len - 1;
+        *end = '\0';
+        ++key;
+
+        if ((value = strchr(key, '='))) {
+            *value++ = '\0';
+
+            if (!strcmp(key, "path"))
+                snprintf(next->path, sizeof(next->path), "%s", value);
+            else if (!strcmp(key, "linkpath"))
+                snprintf(next->link, sizeof(next->link), "%s", value);
+            else if (!strcmp(key, "size"))
+                next->size = strtoull(value, NULL, 10);
+        }
+
+        record += len;
+    }
+}
+
+/* a relative path without '.' components, NULL if it escapes the layer */
+static char *clean_path(char *path)
+{
+    char *p = path, *out = path, *component;
+    size_t len;
+
+    while (*p) {
+        while (*p == '/')
+            ++p;
+
+        component = p;
+        while (*p && *p != '/')
+            ++p;
+        len = p - component;
+
+        if (len == 0 || (len == 1 && component[0] == '.'))
+            continue;
+
+        if (len == 2 && component[0] == '.' && component[1] == '.')
+            return NULL;
+
+        if (out != path)
+            *out++ = '/';
+        memmove(out, component, len);
+        out += len;
+    }
+
+    *out = '\0';
+    return path;
+}
+
+static void import_whiteout(struct tar_entry *entry)
+{
+    const char *base;
+    char *name;
+    int dir_fd;
+
+    /* the whited out entry may still be queued */
+    import_drain();
+
+    dir_fd = layer_open_parent(entry->path, &base);
+
+    if (!strcmp(base, WHITEOUT_OPAQUE)) {
+        char proc[64];
+
+        /* no fsetxattr() on an O_PATH descriptor */
+        snprintf(proc, sizeof(proc), "/proc/self/fd/%d", dir_fd);
+        if (setxattr(proc, "trusted.overlay.opaque", "y", 1, 0) == -1)
+            printErr("setxattr trusted.overlay.opaque");
+    } else {
+        name = (char *) base + strlen(WHITEOUT);
+
+        if (unlinkat(dir_fd, name, 0) == -1 && errno != ENOENT
+                && errno != EISDIR)
+            printErr("unlinkat whiteout");
+
+        if (mknodat(dir_fd, name, S_IFCHR | 0000, makedev(0, 0)) == -1)
+            printErr("mknod whiteout");
+    }
+
+    close(dir_fd);
+}
+
+static void import_entry(struct tar_stream *stream, struct tar_entry *entry)
+{
+    struct timespec times[2] = {
+        { .tv_nsec = UTIME_OMIT },
+        { .tv_sec = entry->mtime }
+    };
+    const char *base;
+    char *data;
+    int dir_fd, fd;
+
+    import_wait_path(entry->path);
+
+    switch (entry->type) {
+    case '0': case '\0': case '7':
+        if (entry->size <= IMPORT_DIRECT_SIZE) {
+            if (!(data = malloc(entry->size ? entry->size : 1)))
+                printErr("malloc at import_entry");
+
+            tar_read_full(stream, data, entry->size);
+            import_queue(entry, data);
+            break;
+        }
+
+        /* too big to be queued: streamed by the parser */
+        fd = layer_open(entry->path, O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW,
+            0600);
+        if (fd == -1) {
+            fprintf(stderr, "=> cannot create %s\n", entry->path);
+            printErr("open");
+        }
+
+        if (!(data = malloc(IMPORT_CHUNK)))
+            printErr("malloc at import_entry");
+
+        for (unsigned long long left = entry->size; left; ) {
+            size_t n = left < IMPORT_CHUNK ? left : IMPORT_CHUNK;
+
+            tar_read_full(stream, data, n);
+            write_all(fd, data, n);
+            left -= n;
+        }
+
+        free(data);
+
+        set_file_attributes(fd, entry);
+        close(fd);
+        break;
+
+    case '1':
+        /* the target must be complete */
+        import_drain();
+
+        if (!clean_path(entry->link)) {
+            fprintf(stderr, "=> hard link outside the layer: %s\n",
+                entry->link);
+            exit(EXIT_FAILURE);
+        }
+
+        if ((fd = layer_open(entry->link, O_PATH | O_NOFOLLOW, 0)) == -1)
+            printErr("open hard link target");
+
+        dir_fd = layer_open_parent(entry->path, &base);
+        unlinkat(dir_fd, base, 0);
+
+        /* AT_EMPTY_PATH would need CAP_DAC_READ_SEARCH in the userns */
+        {
+            char proc[64];
+
+            snprintf(proc, sizeof(proc), "/proc/self/fd/%d", fd);
+            if (linkat(AT_FDCWD, proc, dir_fd, base, AT_SYMLINK_FOLLOW) == -1)
+                printErr("linkat");
+        }
+
+        close(dir_fd);
+        close(fd);
+        break;
+
+    case '2':
+        dir_fd = layer_open_parent(entry->path, &base);
+        unlinkat(dir_fd, base, 0);
+
+        if (symlinkat(entry->link, dir_fd, base) == -1)
+            printErr("symlinkat");
+        if (fchownat(dir_fd, base, entry->uid, entry->gid,
+                AT_SYMLINK_NOFOLLOW) == -1)
+            printErr("fchownat symlink");
+        utimensat(dir_fd, base, times, AT_SYMLINK_NOFOLLOW);
+
+        close(dir_fd);
+        break;
+
+    case '3': case '4': case '6':
+        dir_fd = layer_open_parent(entry->path, &base);
+        unlinkat(dir_fd, base, 0);
+
+        if (mknodat(dir_fd, base, entry->mode | (entry->type == '3' ? S_IFCHR
+                : entry->type == '4' ? S_IFBLK : S_IFIFO), entry->dev) == -1)
+            printErr("mknodat");
+        if (fchownat(dir_fd, base, entry->uid, entry->gid,
+                AT_SYMLINK_NOFOLLOW) == -1)
+            printErr("fchownat");
+        if (fchmodat(dir_fd, base, entry->mode, 0) == -1)
+            printErr("fchmodat");
+
+        close(dir_fd);
+        break;
+
+    case '5':
+        dir_fd = layer_open_parent(entry->path, &base);
+
+        if (mkdirat(dir_fd, base, 0755) == -1 && errno != EEXIST)
+            printErr("mkdirat");
+        if (fchownat(dir_fd, base, entry->uid, entry->gid,
+                AT_SYMLINK_NOFOLLOW) == -1)
+            printErr("fchownat directory");
+        if (fchmodat(dir_fd, base, entry->mode, 0) == -1)
+            printErr("fchmodat directory");
+
+        close(dir_fd);
+        break;
+
+    default:
+        /* unsupported entry, its data is skipped */
+        fprintf(stderr, "=> skipping %s (type %c)\n", entry->path,
+            entry->type);
+        tar_read_full(stream, NULL, entry->size);
+        break;
+    }
+
+    tar_skip_padding(stream, entry->size);
+}
+
+/* parse the whole tar stream, every entry is created in layer_fd */
+static void import_tar(struct tar_stream *stream)
+{
+    struct tar_header header;
+    struct tar_entry entry, next;
+    int zero_blocks = 0;
+    char *data;
+
+    memset(&next, 0, sizeof(next));
+
+    while (tar_read(stream, &header, TAR_BLOCK)) {
+        if (header.name[0] == '\0') {
+            /* two zero blocks end the archive, the rest is drained */
+            if (++zero_blocks == 2) {
+                while (tar_read(stream, NULL, TAR_BLOCK))
+                    ;
+                break;
+            }
+            continue;
+        }
+        zero_blocks = 0;
+
+        if (!tar_checksum_ok(&header)) {
+            fprintf(stderr, "=> bad tar header checksum in %s\n",
+                stream->archive);
+            exit(EXIT_FAILURE);
+        }
+
+        memset(&entry, 0, sizeof(entry));
+        entry.type = header.typeflag;
+        entry.mode = tar_number(header.mode, sizeof(header.mode)) & 07777;
+        entry.uid = tar_number(header.uid, sizeof(header.uid));
+        entry.gid = tar_number(header.gid, sizeof(header.gid));
+        entry.mtime = tar_number(header.mtime, sizeof(header.mtime));
+        entry.size = tar_number(header.size, sizeof(header.size));
+        entry.dev = makedev(tar_number(header.devmajor, sizeof(header.devmajor)),
+            tar_number(header.devminor, sizeof(header.devminor)));
+
+        /* the prefix field only exists in the POSIX format */
+        if (!memcmp(header.magic, "ustar\0", 6) && header.prefix[0])
+            snprintf(entry.path, sizeof(entry.path), "%.155s/%.100s",
+                header.prefix, header.name);
+        else
+            snprintf(entry.path, sizeof(entry.path), "%.100s", header.name);
+        snprintf(entry.link, sizeof(entry.link), "%.100s", header.linkname);
+
+        switch (entry.type) {
+        case 'L':
+        case 'K':
+            data = tar_read_extension(stream, entry.size);
+            snprintf(entry.type == 'L' ? next.path : next.link, PATH_MAX,
+                "%s", data);
+            free(data);
+            continue;
+
+        case 'x':
+            data = tar_read_extension(stream, entry.size);
+            pax_parse(data, entry.size, &next);
+            free(data);
+            continue;
+
+        case 'g':
+            free(tar_read_extension(stream, entry.size));
+            continue;
+        }
+
+        /* values of the extended headers preceding the entry */
+        if (next.path[0])
+            strcpy(entry.path, next.path);
+        if (next.link[0])
+            strcpy(entry.link, next.link);
+        if (next.size)
+            entry.size = next.size;
+        memset(&next, 0, sizeof(next));
+
+        /* the size of links, devices and directories is ignored */
+        if (strchr("123456", entry.type) && entry.type != '\0')
+            entry.size = 0;
+
+        if (!clean_path(entry.path)) {
+            fprintf(stderr, "=> entry outside the layer: %s\n", entry.path);
+            exit(EXIT_FAILURE);
+        }
+
+        /* the root of the layer itself */
+        if (entry.path[0] == '\0') {
+            tar_read_full(stream, NULL, entry.size);
+            tar_skip_padding(stream, entry.size);
+            continue;
+        }
+
+        if (!strncmp(strrchr(entry.path, '/') ? strrchr(entry.path, '/') + 1
+                : entry.path, WHITEOUT, strlen(WHITEOUT))) {
+            import_whiteout(&entry);
+            tar_read_full(stream, NULL, entry.size);
+            tar_skip_padding(stream, entry.size);
+            continue;
+        }
+
+        import_entry(stream, &entry);
+    }
+}
+
+static int remove_entry(const char *path, const struct stat *st, int flag,
+    struct FTW *ftw)
+{
+    if (remove(path) == -1)
+        fprintf(stderr, "=> cannot remove %s: %s\n", path, strerror(errno));
+
+    return 0;
+}
+
+/* import one archive, id receives the sha256 naming the layer */
+static void import_layer(const char *archive, int n_workers, char *id)
+{
+    pthread_t workers[IMPORT_MAX_WORKERS];
+    char tmp[PATH_MAX], final[PATH_MAX];
+    struct tar_stream *stream;
+    int i, err;
+
+    if (!(stream = calloc(1, sizeof(struct tar_stream))))
+        printErr("calloc at import_layer");
+
+    stream->archive = archive;
+    sha256_init(&stream->sha);
+
+    snprintf(tmp, sizeof(tmp), LAYER_STORE_PATH "/layers/.import-XXXXXX");
+    if (!mkdtemp(tmp))
+        printErr("mkdtemp");
+    if (chmod(tmp, 0755) == -1)
+        printErr("chmod layer");
+
+    if ((layer_fd = open(tmp, O_PATH | O_DIRECTORY | O_CLOEXEC)) == -1)
+        printErr("open layer");
+
+    if (pipe2(stream->pipe_fd, O_CLOEXEC) == -1)
+        printErr("pipe");
+
+    fprintf(stderr, "=> importing %s...", archive);
+
+    if ((err = pthread_create(&stream->thread, NULL, decompress_thread,
+            stream))) {
+        errno = err;
+        printErr("pthread_create");
+    }
+
+    stopping = 0;
+    for (i = 0; i < n_workers; ++i) {
+        if ((err = pthread_create(&workers[i], NULL, import_worker, NULL))) {
+            errno = err;
+            printErr("pthread_create");
+        }
+    }
+
+    import_tar(stream);
+
+    pthread_mutex_lock(&lock);
+    stopping = 1;
+    pthread_cond_broadcast(&job_ready);
+    pthread_mutex_unlock(&lock);
+
+    for (i = 0; i < n_workers; ++i)
+        pthread_join(workers[i], NULL);
+
+    pthread_join(stream->thread, NULL);
+    close(stream->pipe_fd[0]);
+    close(layer_fd);
+    layer_fd = -1;
+
+    sha256_final_hex(&stream->sha, id);
+    layer_path(id, final, sizeof(final));
+
+    /* the same content is already in the store */
+    if (rename(tmp, final) == -1) {
+        if (errno != EEXIST && errno != ENOTEMPTY)
+            printErr("rename layer");
+
+        nftw(tmp, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+        fprintf(stderr, "already stored.\n");
+    } else {
+        fprintf(stderr, "done.\n");
+    }
+
+    fprintf(stderr, "=> layer sha256:%s\n", id);
+    free(stream);
+}
+
+void image_import(const char *name, char **archives, int n_archives,
+    int n_workers)
+{
+    char ids[IMAGE_MAX_LAYERS][LAYER_ID_LEN + 1];
+    const char *layers[IMAGE_MAX_LAYERS];
+    struct image_store store;
+
+    if (n_archives < 1 || n_archives > IMAGE_MAX_LAYERS) {
+        fprintf(stderr, "=> an image has [1-%d] layers\n", IMAGE_MAX_LAYERS);
+        exit(EXIT_FAILURE);
+    }
+
+    if (n_workers < 1)
+        n_workers = 1;
+    if (n_workers > IMPORT_MAX_WORKERS)
+        n_workers = IMPORT_MAX_WORKERS;
+
+    image_store_mkdirs();
+
+    /* The layers are named after their content and published with a
+     * rename(): they need no lock, the containers starting meanwhile must
+     * not wait for the extraction. Only the update of the index
+     * serializes the importers. */
+    for (int i = 0; i < n_archives; ++i) {
+        import_layer(archives[i], n_workers, ids[i]);
+        layers[i] = ids[i];
+    }
+
+    image_store_open(&store, 1);
+    image_register(&store, name, layers, n_archives);
+    image_store_close(&store);
+
+    fprintf(stdout, "Imported %s (%d layers)\n", name, n_archives);
+}
@@ -0,0 +1,45 @@
+/**
+ * Layer importer.
+ *
+ * Streams tar layers (plain, gzip or, when built with zstd, zstd
+ * compressed) into the layer store in a single pass, with no temporary
+ * copy of the archive:
+ *
+ *   layer file -> [decompress thread] -> pipe -> [tar parser] -> [writers]
+ *                  sha256 of the tar                  |            |
+ *                                                     |            +-> file contents
+ *                                                     +-> directories, links,
+ *                                                         devices, whiteouts
+ *
+ * The decompression thread also hashes the uncompressed tar stream, the
+ * layer is named after it (the OCI diff id). The parser handles the entries
+ * in order and hands the contents of regular files to a pool of writer
+ * threads; big files are written by the parser itself so the memory used
+ * by the queued contents stays bounded by IMPORT_MAX_INFLIGHT.
+ *
+ * Entries are created with openat2(RESOLVE_IN_ROOT): a path or a symlink
+ * of the layer never resolves outside of it.
+ *
+ * OCI whiteouts are converted to the overlayfs format, so a layer can be
+ * used as a lowerdir as it is (see mount.h):
+ *   .wh.<name>      -> <name> as a 0/0 character device
+ *   .wh..wh..opq    -> trusted.overlay.opaque="y" on the directory
+ *
+ * The layer is extracted into a temporary directory of the store and
+ * renamed to its sha256 once complete; a layer already in the store is
+ * not stored twice.
+ */
+#ifndef IMPORT_H
+#define IMPORT_H
+
+#define IMPORT_CHUNK            (128 * 1024)        /* read/inflate size */
+#define IMPORT_MAX_INFLIGHT     (64 * 1024 * 1024)  /* queued file bytes */
+#define IMPORT_DIRECT_SIZE      (8 * 1024 * 1024)   /* written by the parser */
+#define IMPORT_MAX_WORKERS      64
+
+/* Import the layer archives (base layer first) and register them as the
+ * image called name. n_workers threads write the file contents. */
+void image_import(const char *name, char **archives, int n_archives,
+    int n_workers);
+
+#endif //IMPORT_H
@@ -3,10 +3,65 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <getopt.h>
 #include "runc.h"
+#include "zygote/zygote.h"
+#include "batch/batch.h"
+#include "image/import.h"
+#include "seccomp/seccomp_config.h"
 #include "helpers/helpers.h"
+#include "helpers/trace.h"
 #include "namespaces/cgroup/cgroup.h"
-
+#include "namespaces/cgroup/stats.h"
+#include "namespaces/cgroup/events.h"
+#include "namespaces/cgroup/tuner.h"
+#include "namespaces/cgroup/numa.h"
+#include "namespaces/network/network.h"
+
+/* options without a short form */
+enum long_option {
+	OPT_TRACE_FD = 256,
+	OPT_STATS,
+	OPT_STATS_INTERVAL,
+	OPT_STATS_FORMAT,
+	OPT_EVENTS,
+	OPT_CPU_TUNE,
+	OPT_CPU_TUNE_LOG,
+	OPT_CPUS,
+	OPT_MEMS,
+	OPT_NUMA,
+	OPT_MEMORY_HIGH,
+	OPT_MEMORY_LOW,
+	OPT_SWAP,
+	OPT_HUGEPAGES,
+	OPT_NET_SUBNET,
+	OPT_NET_SPEC,
+	OPT_NET_MODE,
+	OPT_NET_PARENT,
+};
+
+static struct option long_options[] = {
+	{"trace-fd", required_argument, NULL, OPT_TRACE_FD},
+	{"stats", required_argument, NULL, OPT_STATS},
+	{"stats-interval", required_argument, NULL, OPT_STATS_INTERVAL},
+	{"stats-format", required_argument, NULL, OPT_STATS_FORMAT},
+	{"events", required_argument, NULL, OPT_EVENTS},
+	{"cpu-tune", required_argument, NULL, OPT_CPU_TUNE},
+	{"cpu-tune-log", required_argument, NULL, OPT_CPU_TUNE_LOG},
+	{"cpus", required_argument, NULL, OPT_CPUS},
+	{"mems", required_argument, NULL, OPT_MEMS},
+	{"numa", required_argument, NULL, OPT_NUMA},
+	{"memory-high", required_argument, NULL, OPT_MEMORY_HIGH},
+	{"memory-low", required_argument, NULL, OPT_MEMORY_LOW},
+	{"swap", required_argument, NULL, OPT_SWAP},
+	{"hugepages", required_argument, NULL, OPT_HUGEPAGES},
+	{"net-subnet", required_argument, NULL, OPT_NET_SUBNET},
+	{"net-spec", required_argument, NULL, OPT_NET_SPEC},
+	{"net-mode", required_argument, NULL, OPT_NET_MODE},
+	{"net-parent", required_argument, NULL, OPT_NET_PARENT},
+	{NULL, 0, NULL, 0}
+};
 
 int main(int argc, char *argv[])
 {
@@ -15,10 +70,45 @@ int main(int argc, char *argv[])
 	bool runall = false;
 	bool pids_flag = false;
 	bool has_userns = false;
+	bool has_seccomp = false;
 	bool cgroup_flag = false;
 	bool memory_flag = false;
 	bool weight_flag = false;
 	bool cpu_shares_flag = false;
+	bool zygote_client = false;
+	long zygote_pool = 0;
+	long batch_size = 0;
+	long batch_workers = 0;
+	int batch_failed = 0;
+	char *manifest = NULL;
+	char *image = NULL;
+	char *syscall_profile = NULL;
+	struct batch batch;
+	long trace_fd = -1;
+	char *stats_target = NULL;
+	char *events_target = NULL;
+	char *tune_log = NULL;
+	long tune_min = 0;
+	long tune_max = 0;
+	char *cpuset_cpus = NULL;
+	char *cpuset_mems = NULL;
+	bool numa_auto = false;
+	cpu_set_t cpu_set;
+	long memory_high = 0;
+	long memory_low = 0;
+	long swap_limit = -1;
+	long huge_pages_2m = 0;
+	long huge_pages_1g = 0;
+	long huge_page_unit = 0;
+	long huge_pages = 0;
+	char huge_page_size = 0;
+	char *net_subnet = NULL;
+	char *net_spec_path = NULL;
+	char *net_parent = NULL;
+	int net_mode = -1;
+	struct net_spec net_spec = { 0 };
+	long stats_interval = STATS_INTERVAL;
+	enum stats_format stats_format = STATS_LINE;
 	long max_pids = 0;
 	long max_weight = 0;
 	long cpu_shares = 0;
@@ -27,7 +117,18 @@ int main(int argc, char *argv[])
 	struct runc_args *runc_arguments = NULL;
 	struct cgroup_args *cgroup_arguments = NULL;
 
-	while ((option = getopt(argc, argv, "hacUM:C:P:I:")) != -1) {
+	/* sudo ./MyDocker import <image> <layer>... */
+	if (argc > 1 && !strcmp(argv[1], "import")) {
+		if (argc < 4)
+			goto usage;
+
+		image_import(argv[2], &argv[3], argc - 3,
+				sysconf(_SC_NPROCESSORS_ONLN));
+		exit(EXIT_SUCCESS);
+	}
+
+	while ((option = getopt_long(argc, argv, "hacUsS:p:M:C:P:I:z:Zn:m:j:i:",
+			long_options, NULL)) != -1) {
 		switch(option) {
 			case 'h':
 				debug_print("case help\n");
@@ -42,6 +143,22 @@ int main(int argc, char *argv[])
 				has_userns = true;
 				break;
 
+			case 's':
+				debug_print("case seccomp\n");
+				has_seccomp = true;
+				break;
+
+			case 'S':
+				debug_print("case seccomp profile\n");
+				sys_filter_set_profile(optarg);
+				has_seccomp = true;
+				break;
+
+			case 'p':
+				debug_print("case syscall profiler\n");
+				syscall_profile = optarg;
+				break;
+
 			case 'c':
 				debug_print("case cgroup\n");
 				cgroup_flag = true;
@@ -136,6 +253,230 @@ int main(int argc, char *argv[])
 				weight_flag = true;
 				break;
 
+			case 'z':
+				debug_print("case zygote server\n");
+				zygote_pool = strtol(optarg, NULL, 10);
+
+				if (zygote_pool < 1 || zygote_pool > ZYGOTE_MAX_POOL) {
+					printErr("zygote pool size out of range");
+					goto abort;
+				}
+				break;
+
+			case 'Z':
+				debug_print("case zygote client\n");
+				zygote_client = true;
+				break;
+
+			case 'n':
+				debug_print("case batch size\n");
+				batch_size = strtol(optarg, NULL, 10);
+
+				if (batch_size < 1 || batch_size > BATCH_MAX_CONTAINERS) {
+					printErr("batch size out of range");
+					goto abort;
+				}
+				break;
+
+			case 'm':
+				debug_print("case batch manifest\n");
+				manifest = optarg;
+				break;
+
+			case 'j':
+				debug_print("case batch workers\n");
+				batch_workers = strtol(optarg, NULL, 10);
+
+				if (batch_workers < 1 || batch_workers > BATCH_MAX_WORKERS) {
+					printErr("batch workers out of range");
+					goto abort;
+				}
+				break;
+
+			case 'i':
+				debug_print("case image\n");
+				image = optarg;
+				break;
+
+			case OPT_TRACE_FD:
+				debug_print("case trace fd\n");
+				trace_fd = strtol(optarg, NULL, 10);
+
+				if (trace_fd < 0 || fcntl(trace_fd, F_GETFD) == -1) {
+					printErr("--trace-fd is not an open file descriptor");
+					goto abort;
+				}
+				break;
+
+			case OPT_STATS:
+				debug_print("case stats\n");
+				stats_target = optarg;
+				break;
+
+			case OPT_STATS_INTERVAL:
+				debug_print("case stats interval\n");
+				stats_interval = strtol(optarg, NULL, 10);
+
+				if (stats_interval < STATS_MIN_INTERVAL ||
+					stats_interval > STATS_MAX_INTERVAL) {
+					printErr("stats interval out of range");
+					goto abort;
+				}
+				break;
+
+			case OPT_STATS_FORMAT:
+				debug_print("case stats format\n");
+
+				if (!strcmp(optarg, "line")) {
+					stats_format = STATS_LINE;
+				} else if (!strcmp(optarg, "binary")) {
+					stats_format = STATS_BINARY;
+				} else {
+					fprintf(stderr, "--stats-format is line or binary");
+					goto abort;
+				}
+				break;
+
+			case OPT_EVENTS:
+				debug_print("case events\n");
+				events_target = optarg;
+				break;
+
+			case OPT_CPU_TUNE:
+				debug_print("case cpu tune\n");
+
+				if (sscanf(optarg, "%ld:%ld", &tune_min, &tune_max) != 2 ||
+					tune_min < TUNER_MIN_QUOTA || tune_max > TUNER_MAX_QUOTA ||
+					tune_min > tune_max) {
+					fprintf(stderr, "--cpu-tune takes <min>:<max> percent of "
+					"a cpu in [%d-%d]", TUNER_MIN_QUOTA, TUNER_MAX_QUOTA);
+					goto abort;
+				}
+				break;
+
+			case OPT_CPU_TUNE_LOG:
+				debug_print("case cpu tune log\n");
+				tune_log = optarg;
+				break;
+
+			case OPT_CPUS:
+				debug_print("case cpus\n");
+
+				if (cpulist_parse(optarg, &cpu_set) < 1) {
+					fprintf(stderr, "--cpus takes a cpu list like 0-3,8");
+					goto abort;
+				}
+
+				if (strlen(optarg) >= NUMA_LIST_SIZE) {
+					fprintf(stderr, "--cpus takes a cpu list of at most %d "
+					"characters", NUMA_LIST_SIZE - 1);
+					goto abort;
+				}
+				cpuset_cpus = optarg;
+				break;
+
+			case OPT_MEMS:
+				debug_print("case mems\n");
+
+				if (cpulist_parse(optarg, &cpu_set) < 1) {
+					fprintf(stderr, "--mems takes a node list like 0-1");
+					goto abort;
+				}
+
+				if (strlen(optarg) >= NUMA_LIST_SIZE) {
+					fprintf(stderr, "--mems takes a node list of at most %d "
+					"characters", NUMA_LIST_SIZE - 1);
+					goto abort;
+				}
+				cpuset_mems = optarg;
+				break;
+
+			case OPT_NUMA:
+				debug_print("case numa\n");
+
+				if (strcmp(optarg, "auto")) {
+					fprintf(stderr, "--numa only supports auto");
+					goto abort;
+				}
+				numa_auto = true;
+				break;
+
+			case OPT_MEMORY_HIGH:
+				debug_print("case memory high\n");
+				memory_high = strtol(optarg, NULL, 10);
+
+				if (memory_high < 1 || memory_high > MAX_MEMORY_ALLOCABLE) {
+					fprintf(stderr, "--memory-high value out of range");
+					goto abort;
+				}
+				break;
+
+			case OPT_MEMORY_LOW:
+				debug_print("case memory low\n");
+				memory_low = strtol(optarg, NULL, 10);
+
+				if (memory_low < 1 || memory_low > MAX_MEMORY_ALLOCABLE) {
+					fprintf(stderr, "--memory-low value out of range");
+					goto abort;
+				}
+				break;
+
+			case OPT_SWAP:
+				debug_print("case swap\n");
+				swap_limit = strtol(optarg, NULL, 10);
+
+				if (swap_limit < 0 || swap_limit > MAX_MEMORY_ALLOCABLE) {
+					fprintf(stderr, "--swap value out of range");
+					goto abort;
+				}
+				break;
+
+			case OPT_HUGEPAGES:
+				debug_print("case hugepages\n");
+
+				if (sscanf(optarg, "%ld%c:%ld", &huge_page_unit, &huge_page_size,
+						&huge_pages) != 3 || huge_pages < 1 ||
+					!((huge_page_unit == 2 && huge_page_size == 'M') ||
+					(huge_page_unit == 1 && huge_page_size == 'G'))) {
+					fprintf(stderr, "--hugepages takes <2M|1G>:<pages>");
+					goto abort;
+				}
+
+				if (huge_page_size == 'M')
+					huge_pages_2m = huge_pages;
+				else
+					huge_pages_1g = huge_pages;
+				break;
+
+			case OPT_NET_SUBNET:
+				debug_print("case net subnet\n");
+				net_subnet = optarg;
+				break;
+
+			case OPT_NET_SPEC:
+				debug_print("case net spec\n");
+				net_spec_path = optarg;
+				break;
+
+			case OPT_NET_MODE:
+				debug_print("case net mode\n");
+				if ((net_mode = net_mode_parse(optarg)) == -1) {
+					fprintf(stderr, "--net-mode must be one of bridge, "
+					"macvlan, ipvlan-l2 and ipvlan-l3");
+					goto abort;
+				}
+				break;
+
+			case OPT_NET_PARENT:
+				debug_print("case net parent\n");
+				if (strlen(optarg) >= IFNAMSIZ) {
+					fprintf(stderr, "--net-parent must be the name of "
+					"a device of the host");
+					goto abort;
+				}
+				net_parent = optarg;
+				break;
+
 				// add other cases here
 
 			default:
@@ -144,12 +485,181 @@ int main(int argc, char *argv[])
 		}
 	}
 
-	get_child_entrypoint(optind, argv, argc, &child_entrypoint);
+	if (trace_fd != -1) {
+		trace_enable(trace_fd);
+	}
+
+	if (stats_target) {
+		if (!cgroup_flag) {
+			fprintf(stderr, "--stats samples the cgroups of the containers, "
+			"it must be used with -c");
+			goto abort;
+		}
+
+		stats_open(stats_target, stats_format, stats_interval);
+	}
+
+	if (events_target) {
+		if (!cgroup_flag) {
+			fprintf(stderr, "--events watches the cgroups of the containers, "
+			"it must be used with -c");
+			goto abort;
+		}
+
+		events_open(events_target);
+	}
+
+	if (tune_max) {
+		if (!cgroup_flag) {
+			fprintf(stderr, "--cpu-tune sets the cpu.max of the containers, "
+			"it must be used with -c");
+			goto abort;
+		}
+
+		tuner_open(tune_min, tune_max, tune_log);
+	}
+
+	if ((cpuset_mems || numa_auto) && !cgroup_flag) {
+		fprintf(stderr, "--mems and --numa bind the memory of the containers "
+		"with the cpuset controller, they must be used with -c");
+		goto abort;
+	}
+
+	if ((memory_high || memory_low || swap_limit != -1 || huge_pages_2m ||
+		huge_pages_1g) && !cgroup_flag) {
+		fprintf(stderr, "--memory-high, --memory-low, --swap and --hugepages "
+		"are cgroup limits, they must be used with -c");
+		goto abort;
+	}
+
+	if (memory_high && !cgroup_is_v2()) {
+		fprintf(stderr, "--memory-high needs cgroup v2, cgroup v1 has no "
+		"throttling limit below memory.limit_in_bytes");
+		goto abort;
+	}
+
+	if (numa_auto && (cpuset_cpus || cpuset_mems)) {
+		fprintf(stderr, "--numa auto chooses the cpus and the nodes, it "
+		"cannot be used with --cpus or --mems");
+		goto abort;
+	}
+
+	/* without cgroups the containers inherit the affinity of the runtime */
+	if (cpuset_cpus && !cgroup_flag) {
+		cpulist_parse(cpuset_cpus, &cpu_set);
 
+		if (sched_setaffinity(0, sizeof(cpu_set), &cpu_set) == -1) {
+			printErr("sched_setaffinity");
+		}
+	}
+
+	if (syscall_profile) {
+		if (zygote_pool || zygote_client || batch_size || manifest) {
+			fprintf(stderr, "-p profiles a single container, it cannot "
+			"be used with -z, -Z, -n or -m");
+			goto abort;
+		}
+
+		/* replaces the filter of -s or -S */
+		sys_filter_set_trace();
+		has_seccomp = true;
+	}
+
+	if (zygote_pool) {
+		zygote_serve(zygote_pool, has_userns, has_seccomp, image);
+		exit(EXIT_FAILURE);
+	}
+
+	if (zygote_client) {
+		exit(zygote_request(&argv[optind], (size_t) argc - optind));
+	}
+
+	if (net_spec_path) {
+		net_spec_load(&net_spec, net_spec_path);
+	}
+
+	/* the flags take precedence over the spec */
+	if (net_mode != -1) {
+		net_spec.mode = net_mode;
+	}
+
+	if (net_parent) {
+		strcpy(net_spec.parent, net_parent);
+	}
+
+	/* the veth pairs left by the previous runs are reused as they are */
+	net_pool_open(net_subnet, &net_spec, NET_WARM_PAIRS);
+
+	/* the limits of the container, or of every container of -n/-m */
 	init_resources(cgroup_flag, pids_flag, memory_flag, weight_flag,
 			cpu_shares_flag, max_pids, memory_limit, max_weight,
 			cpu_shares, &cgroup_arguments);
 
+	if (cgroup_arguments) {
+		if (tune_max) {
+			limit_cpu_max(cgroup_arguments, tune_max * TUNER_PERIOD / 100,
+					TUNER_PERIOD);
+		}
+
+		if (cpuset_cpus || cpuset_mems) {
+			limit_cpuset(cgroup_arguments, cpuset_cpus, cpuset_mems);
+		}
+
+		if (numa_auto) {
+			limit_numa_auto(cgroup_arguments);
+		}
+
+		limit_memory_tiers(cgroup_arguments, memory_high, memory_low);
+
+		if (swap_limit != -1) {
+			limit_swap(cgroup_arguments, swap_limit);
+		}
+
+		if (huge_pages_2m) {
+			limit_huge_pages(cgroup_arguments, HUGE_PAGE_2M_KB, huge_pages_2m);
+		}
+
+		if (huge_pages_1g) {
+			limit_huge_pages(cgroup_arguments, HUGE_PAGE_1G_KB, huge_pages_1g);
+		}
+	}
+
+	if (batch_size || manifest) {
+		if (!runall) {
+			fprintf(stderr, "-a flag must be used in order to create "
+			"your new containers");
+			goto abort;
+		}
+
+		if (manifest && batch_size) {
+			fprintf(stderr, "-n and -m cannot be used together");
+			goto abort;
+		}
+
+		if (!batch_workers) {
+			batch_workers = sysconf(_SC_NPROCESSORS_ONLN);
+		}
+
+		if (manifest) {
+			batch_load_manifest(&batch, manifest);
+		} else if (optind < argc) {
+			batch_repeat(&batch, &argv[optind], (size_t) argc - optind,
+				batch_size);
+		} else {
+			fprintf(stderr, "-n needs an entrypoint");
+			goto abort;
+		}
+
+		batch_failed = batch_run(&batch, cgroup_arguments, has_userns,
+				has_seccomp, image, batch_workers);
+
+		batch_free(&batch);
+		destroy_resources(cgroup_arguments);
+		exit(batch_failed ? EXIT_FAILURE : EXIT_SUCCESS);
+	}
+
+	get_child_entrypoint(optind, argv, argc, &child_entrypoint);
+
 	runc_arguments = (struct runc_args *) malloc( sizeof(struct runc_args) );
 	runc_arguments->child_entrypoint = child_entrypoint;
 	runc_arguments->child_entrypoint_size = (size_t) argc - optind;
@@ -157,6 +667,9 @@ int main(int argc, char *argv[])
 
 	// privileged or unprivileged container
 	runc_arguments->has_userns = has_userns;
+	runc_arguments->image = image;
+	runc_arguments->has_seccomp = has_seccomp;
+	runc_arguments->syscall_profile = syscall_profile;
 
 	if (runall) {
 		runc(runc_arguments);
@@ -167,13 +680,7 @@ int main(int argc, char *argv[])
 	}
 		
 	// Now it's time to free them. Bye!
-	if (runc_arguments->resources) {
-		free(runc_arguments->resources->max_pids);
-		free(runc_arguments->resources->io_weight);
-		free(runc_arguments->resources->cpu_shares);
-		free(runc_arguments->resources->memory_limit);
-		free(runc_arguments->resources);
-	}
+	destroy_resources(runc_arguments->resources);
 	
 	for (int i = 0; i < argc - optind; ++i) {
 		free(child_entrypoint[i]);
@@ -185,10 +692,16 @@ int main(int argc, char *argv[])
 
 usage:
 	printf("Usage: sudo ./MyDocker <options> <entrypoint>\n");
+	printf("       sudo ./MyDocker import <image> <layer.tar[.gz]>...\n");
 	printf("\n");
 	printf("<options> should be:\n");
 	printf("\t- a\trun all namespaces without the user namespace\n");
 	printf("\t- U\trun a user namespace using unprivileged container\n");
+	printf("\t- s\tfilter the syscalls of the container with seccomp\n");
+	printf("\t- S <profile>\tfilter the syscalls with the rules of "
+	"profile (see src/seccomp/profile.h)\n");
+	printf("\t- p <profile>\twrite the allowlist of the syscalls used by "
+	"the entrypoint to profile\n");
 	printf("\t- c\tcgrops used to limit resources.\n\t\tThis command must "
 	"be chained with at least one of:\n");
 	printf("\t\t- M <memory_limit> \t\t[1-4294967296]\t"
@@ -196,6 +709,52 @@ usage:
 	printf("\t\t- C <percentage_of_cpu_shares> \t[1-100]\t\tdefault: 25\n");
 	printf("\t\t- P <max_pids> \t\t\t[10-32768]\tdefault: 64\n");
 	printf("\t\t- I <io_weighht> \t\t[10-1000]\tdefault: 10\n");
+	printf("\t- i <image>\trun the image of the layer store instead of "
+	"root_fs\n");
+	printf("\t- z <pool_size>\tstart a zygote server keeping [1-%d] "
+	"containers ready\n", ZYGOTE_MAX_POOL);
+	printf("\t- Z\trun the entrypoint in a container of the zygote server\n");
+	printf("\t- n <count>\tstart [1-%d] containers running the entrypoint"
+	"\n", BATCH_MAX_CONTAINERS);
+	printf("\t- m <manifest>\tstart a container for each entrypoint "
+	"listed in manifest\n");
+	printf("\t- j <workers>\tthreads setting up the containers of -n/-m "
+	"[1-%d]\tdefault: number of cpus\n", BATCH_MAX_WORKERS);
+	printf("\t--trace-fd <fd>\twrite the binary phase trace "
+	"(see src/helpers/trace.h) to fd\n");
+	printf("\t--stats <file|unix:path>\tstream the cgroup usage of the "
+	"containers (see src/namespaces/cgroup/stats.h)\n");
+	printf("\t--stats-interval <ms>\t[%d-%d]\tdefault: %d\n",
+	STATS_MIN_INTERVAL, STATS_MAX_INTERVAL, STATS_INTERVAL);
+	printf("\t--stats-format <line|binary>\tdefault: line\n");
+	printf("\t--events <file|unix:path>\treport the memory and cpu "
+	"pressure and OOM events of the containers\n");
+	printf("\t--cpu-tune <min>:<max>\tadapt the cpu quota of the "
+	"containers within [min-max] %% of a cpu (see src/namespaces/cgroup/"
+	"tuner.h)\n");
+	printf("\t--cpu-tune-log <file|unix:path>\tlog the cpu tuner "
+	"decisions\tdefault: stderr\n");
+	printf("\t--cpus <list>\tpin the containers to the cpus of the list, "
+	"0-3,8\n");
+	printf("\t--mems <list>\tbind the memory of the containers to the "
+	"NUMA nodes of the list (with -c)\n");
+	printf("\t--numa auto\tplace each container on the least loaded NUMA "
+	"node (with -c, see src/namespaces/cgroup/numa.h)\n");
+	printf("\t--memory-high <bytes>\tthrottle and reclaim the containers "
+	"above, cgroup v2 only (with -c)\n");
+	printf("\t--memory-low <bytes>\tprotect the memory of the containers "
+	"from reclaim below (with -c)\n");
+	printf("\t--swap <bytes>\tswap allowed on top of -M (with -c)\n");
+	printf("\t--hugepages <2M|1G>:<pages>\treserve huge pages for each "
+	"container, repeatable (with -c)\n");
+	printf("\t--net-subnet <a.b.c.d/len>\tsubnet of the containers behind "
+	"the " NET_BRIDGE " bridge\tdefault: " NET_SUBNET "\n");
+	printf("\t--net-spec <file>\tMTU, offloads, IPv6 subnet and routes of "
+	"the containers (see src/namespaces/network/netspec.h)\n");
+	printf("\t--net-mode <bridge|macvlan|ipvlan-l2|ipvlan-l3>\thow the "
+	"containers reach the network\tdefault: bridge\n");
+	printf("\t--net-parent <dev>\tdevice of the host holding the macvlan "
+	"and ipvlan interfaces\tdefault: " NET_PARENT "\n");
 	exit(EXIT_FAILURE);
 
 abort:
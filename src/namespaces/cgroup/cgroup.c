@@ -1,13 +1,171 @@
+#define _GNU_SOURCE
 #include <string.h>
+#include <stdarg.h>
+#include <pthread.h>
+#include <sys/file.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/resource.h>
+#include <sys/vfs.h>
+#include <linux/magic.h>
 #include "cgroup.h"
+#include "numa.h"
 #include "../../helpers/helpers.h"
 #include "../../../config.h"
 
-struct cgrp_control **controller = NULL;    /* cgroup controller array */
-size_t n_controller = 0;                    /* size of the controller array */
+/* Is /sys/fs/cgroup the cgroup2 unified hierarchy? */
+bool cgroup_is_v2()
+{
+    static int v2 = -1;
+    struct statfs fs;
+
+    if (v2 == -1) {
+        if (statfs("/sys/fs/cgroup", &fs) == -1) {
+            printErr("statfs /sys/fs/cgroup");
+        }
+        v2 = fs.f_type == CGROUP2_SUPER_MAGIC;
+    }
+
+    return v2;
+}
+
+/* A cgroup hierarchy. Its pool directory is opened once per process and
+ * every file of a slot is then reached with openat() from it. */
+struct cgrp_hierarchy {
+    const char *name;           /* /sys/fs/cgroup/<name> on cgroup v1 */
+    int root_fd;                /* /sys/fs/cgroup/<name>, or /sys/fs/cgroup */
+    int pool_fd;                /* <root>/mydocker */
+};
+
+/* on cgroup v2 only the first entry is used */
+static struct cgrp_hierarchy hierarchies[N_CONTROLS] = {
+    [CTRL_MEMORY]   = { "memory",   -1, -1 },
+    [CTRL_CPU]      = { "cpu",      -1, -1 },
+    [CTRL_PIDS]     = { "pids",     -1, -1 },
+    [CTRL_IO]       = { "blkio",    -1, -1 },
+    [CTRL_CPUSET]   = { "cpuset",   -1, -1 },
+    [CTRL_HUGETLB]  = { "hugetlb",  -1, -1 },
+};
+
+/* concurrent containers of the batch mode open the hierarchies */
+static pthread_mutex_t hierarchies_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* A file of the slot directory of a controller and the value written in
+ * it. A setting is written when its limit is enabled, in the order of the
+ * table. Every setting of the hierarchies a container used is reset when
+ * its slot is released, in the reverse order, so that the next container
+ * of the slot does not inherit a limit it did not set. */
+struct cgrp_setting {
+    enum cgrp_control control;
+    const char *file;
+    enum cgrp_limit limit;
+    const char *reset;          /* value of a new cgroup, or NULL */
+    bool optional;              /* a file older kernels do not have */
+};
+
+/* memory.memsw.limit_in_bytes cannot be lower than memory.limit_in_bytes,
+ * it is written after it. A v1 cpuset is only used with both of its files
+ * written, they need no reset. */
+static const struct cgrp_setting v1_settings[] = {
+    { CTRL_MEMORY,  "memory.limit_in_bytes",        LIMIT_MEMORY,   "-1" },
+    { CTRL_MEMORY,  "memory.memsw.limit_in_bytes",  LIMIT_MEMSW,    "-1" },
+    { CTRL_MEMORY,  "memory.kmem.limit_in_bytes",   LIMIT_MEMORY,   "-1" },
+    { CTRL_MEMORY,  "memory.soft_limit_in_bytes",   LIMIT_MEMORY_LOW, "-1" },
+    { CTRL_CPU,     "cpu.shares",                   LIMIT_CPU_SHARES, "1024" },
+    { CTRL_CPU,     "cpu.cfs_period_us",            LIMIT_CPU_PERIOD, "100000" },
+    { CTRL_CPU,     "cpu.cfs_quota_us",             LIMIT_CPU_QUOTA, "-1" },
+    { CTRL_PIDS,    "pids.max",                     LIMIT_PIDS,     "max" },
+    { CTRL_IO,      "blkio.weight",                 LIMIT_IO_WEIGHT, "500" },
+    { CTRL_CPUSET,  "cpuset.mems",                  LIMIT_CPUSET_MEMS },
+    { CTRL_CPUSET,  "cpuset.cpus",                  LIMIT_CPUSET_CPUS },
+    { CTRL_HUGETLB, "hugetlb.2MB.limit_in_bytes",   LIMIT_HUGETLB_2M, "-1" },
+    { CTRL_HUGETLB, "hugetlb.2MB.rsvd.limit_in_bytes", LIMIT_HUGETLB_2M, "-1",
+        true },
+    { CTRL_HUGETLB, "hugetlb.1GB.limit_in_bytes",   LIMIT_HUGETLB_1G, "-1" },
+    { CTRL_HUGETLB, "hugetlb.1GB.rsvd.limit_in_bytes", LIMIT_HUGETLB_1G, "-1",
+        true },
+};
+
+/* cgroup v2 accounts kernel memory in memory.max. An empty cpuset stands
+ * for the cpus and nodes of the parent. */
+static const struct cgrp_setting v2_settings[] = {
+    { CTRL_MEMORY,  "memory.max",                   LIMIT_MEMORY,   "max" },
+    { CTRL_MEMORY,  "memory.high",                  LIMIT_MEMORY_HIGH, "max" },
+    { CTRL_MEMORY,  "memory.low",                   LIMIT_MEMORY_LOW, "0" },
+    { CTRL_MEMORY,  "memory.swap.max",              LIMIT_MEMORY_SWAP, "max" },
+    { CTRL_CPU,     "cpu.weight",                   LIMIT_CPU_WEIGHT, "100" },
+    { CTRL_CPU,     "cpu.max",                      LIMIT_CPU_MAX,  "max" },
+    { CTRL_PIDS,    "pids.max",                     LIMIT_PIDS,     "max" },
+    { CTRL_IO,      "io.weight",                    LIMIT_IO_WEIGHT, "100" },
+    { CTRL_CPUSET,  "cpuset.mems",                  LIMIT_CPUSET_MEMS, "\n" },
+    { CTRL_CPUSET,  "cpuset.cpus",                  LIMIT_CPUSET_CPUS, "\n" },
+    { CTRL_HUGETLB, "hugetlb.2MB.max",              LIMIT_HUGETLB_2M, "max" },
+    { CTRL_HUGETLB, "hugetlb.2MB.rsvd.max",         LIMIT_HUGETLB_2M, "max",
+        true },
+    { CTRL_HUGETLB, "hugetlb.1GB.max",              LIMIT_HUGETLB_1G, "max" },
+    { CTRL_HUGETLB, "hugetlb.1GB.rsvd.max",         LIMIT_HUGETLB_1G, "max",
+        true },
+};
+
+#define N_ELEMS(array) (sizeof(array) / sizeof(*(array)))
+
+static const struct cgrp_setting *cgroup_settings(size_t *n_settings)
+{
+    if (cgroup_is_v2()) {
+        *n_settings = N_ELEMS(v2_settings);
+        return v2_settings;
+    }
+
+    *n_settings = N_ELEMS(v1_settings);
+    return v1_settings;
+}
+
+static enum cgrp_control hierarchy_of(enum cgrp_control control)
+{
+    return cgroup_is_v2() ? 0 : control;
+}
+
+/* the hierarchies holding an enabled limit, 1 << enum cgrp_control */
+static unsigned int used_controls(struct cgroup_args *cgroup_arguments)
+{
+    const struct cgrp_setting *settings;
+    unsigned int controls = 0;
+    size_t i, n_settings;
+
+    settings = cgroup_settings(&n_settings);
+
+    for (i = 0; i < n_settings; ++i) {
+        if (cgroup_arguments->limits & (1 << settings[i].limit))
+            controls |= 1 << hierarchy_of(settings[i].control);
+    }
+
+    return controls;
+}
+
+/* format the value of a limit at the end of the arena */
+static void set_limit(struct cgroup_args *cgroup_arguments,
+        enum cgrp_limit limit, const char *fmt, ...)
+{
+    size_t room = sizeof(cgroup_arguments->arena)
+        - cgroup_arguments->arena_used;
+    va_list ap;
+    int len;
+
+    va_start(ap, fmt);
+    len = vsnprintf(cgroup_arguments->arena + cgroup_arguments->arena_used,
+        room, fmt, ap);
+    va_end(ap);
+
+    if (len < 0 || len >= room) {
+        fprintf(stderr, "=> no room for the cgroup value %d.\n", limit);
+        exit(EXIT_FAILURE);
+    }
+
+    cgroup_arguments->value[limit] = cgroup_arguments->arena_used;
+    cgroup_arguments->value_len[limit] = len;
+    /* keep the NUL for the value to be printable */
+    cgroup_arguments->arena_used += len + 1;
+}
 
 /* initialize the struct cgroup_args */
 void init_resources(bool cgroup_flag,
@@ -21,356 +179,575 @@ void init_resources(bool cgroup_flag,
 			long cpu_shares,
 			struct cgroup_args **cgroup_arguments)
 {
-    char buf[MAX_BUF_SIZE];
+    struct cgroup_args *args = NULL;
+    long shares;
+    int i;
 
     if (!cgroup_flag) {
         goto abort;
     }
 
-    *cgroup_arguments = (struct cgroup_args *) malloc(sizeof(struct cgroup_args));
-    
-    (*cgroup_arguments)->has_max_pids = pids_flag;
-    (*cgroup_arguments)->has_io_weight = weight_flag;
-    (*cgroup_arguments)->has_memory_limit = memory_flag;
-    (*cgroup_arguments)->has_cpu_shares = cpu_shares_flag;
+    args = (struct cgroup_args *) malloc(sizeof(struct cgroup_args));
 
-    buf[0] = '\0';
-    if (pids_flag) {
-        sprintf(buf, "%ld", max_pids);
-    } else {
-        strcpy(buf, PIDS);
+    if (!args) {
+        printErr("malloc at init_resources");
     }
-    (*cgroup_arguments)->max_pids = strdup(buf);
 
-    buf[0] = '\0';
-    if (weight_flag) {
-        sprintf(buf, "%ld", max_weight);
-    } else {
-        strcpy(buf, WEIGHT);
-    }
-    (*cgroup_arguments)->io_weight = strdup(buf);
+    args->limits = 0;
+    args->arena_used = 0;
 
-    buf[0] = '\0';
     if (memory_flag) {
-        sprintf(buf, "%ld", memory_limit);
+        args->limits |= 1 << LIMIT_MEMORY;
+        set_limit(args, LIMIT_MEMORY, "%ld", memory_limit);
     } else {
-        strcpy(buf, MEMORY);
+        set_limit(args, LIMIT_MEMORY, "%s", MEMORY);
     }
-    (*cgroup_arguments)->memory_limit = strdup(buf);
 
-    buf[0] = '\0';
+    shares = cpu_shares_flag ? cpu_shares * 1024 / 100
+                             : strtol(SHARES, NULL, 10);
+
     if (cpu_shares_flag) {
-        sprintf(buf, "%ld", cpu_shares * 1024 / 100);
+        args->limits |= 1 << LIMIT_CPU_SHARES | 1 << LIMIT_CPU_WEIGHT;
+    }
+    set_limit(args, LIMIT_CPU_SHARES, "%ld", shares);
+
+    /* cgroup v2 cpu.weight [1-10000] from the cpu.shares [2-262144] value */
+    set_limit(args, LIMIT_CPU_WEIGHT, "%ld", 1 + (shares - 2) * 9999 / 262142);
+
+    if (pids_flag) {
+        args->limits |= 1 << LIMIT_PIDS;
+        set_limit(args, LIMIT_PIDS, "%ld", max_pids);
     } else {
-        strcpy(buf, SHARES);
+        set_limit(args, LIMIT_PIDS, "%s", PIDS);
     }
-    (*cgroup_arguments)->cpu_shares = strdup(buf);
-    
+
+    if (weight_flag) {
+        args->limits |= 1 << LIMIT_IO_WEIGHT;
+        set_limit(args, LIMIT_IO_WEIGHT, "%ld", max_weight);
+    } else {
+        set_limit(args, LIMIT_IO_WEIGHT, "%s", WEIGHT);
+    }
+
+    args->slot = -1;
+    args->slot_lock_fd = -1;
+    for (i = 0; i < N_CONTROLS; ++i)
+        args->slot_fd[i] = -1;
+    args->joined = false;
+    args->cgroup_fd = -1;
+    args->numa_auto = false;
+    args->numa_node = -1;
+    args->numa_lock_fd = -1;
+
+    *cgroup_arguments = args;
     return;
 
 abort:
     *cgroup_arguments = NULL;
 }
 
-struct cgrp_control *alloc_ctr_memory(char *memory_limit)
+void limit_cpu_max(struct cgroup_args *cgroup_arguments, long quota_us,
+        long period_us)
 {
-        struct cgrp_setting *memory_ker = NULL;
-        struct cgrp_setting *memory_usr = NULL;
-        struct cgrp_control *ctr_memory = NULL;
-        size_t n_settings = 0;
+    cgroup_arguments->limits |= 1 << LIMIT_CPU_MAX | 1 << LIMIT_CPU_QUOTA
+        | 1 << LIMIT_CPU_PERIOD;
 
-        /* creating the two settings structures */
-        memory_usr =
-            (struct cgrp_setting *) malloc(sizeof(struct cgrp_setting));
-        
-        if (!memory_usr) {
-            printErr("alloc_ctr_memory malloc");
-        }
+    set_limit(cgroup_arguments, LIMIT_CPU_MAX, "%ld %ld", quota_us, period_us);
+    set_limit(cgroup_arguments, LIMIT_CPU_QUOTA, "%ld", quota_us);
+    set_limit(cgroup_arguments, LIMIT_CPU_PERIOD, "%ld", period_us);
+}
 
-        memory_usr->name = strdup("memory.limit_in_bytes");
-        memory_usr->value = memory_limit;
-        ++n_settings;
+void limit_cpuset(struct cgroup_args *cgroup_arguments, const char *cpus,
+        const char *mems)
+{
+    char online[NUMA_LIST_SIZE];
 
-        memory_ker =
-            (struct cgrp_setting *) malloc(sizeof(struct cgrp_setting));
+    cgroup_arguments->limits |= 1 << LIMIT_CPUSET_CPUS
+        | 1 << LIMIT_CPUSET_MEMS;
 
-        if (!memory_ker) {
-            printErr("alloc_ctr_memory malloc");
+    /* both files must hold a value before a task joins a v1 cpuset */
+    if (!cpus) {
+        if (numa_read_list(CPU_ONLINE_PATH, online, sizeof(online)) == -1) {
+            printErr("reading the online cpus");
         }
+        cpus = online;
+    }
+    set_limit(cgroup_arguments, LIMIT_CPUSET_CPUS, "%s", cpus);
 
-        memory_ker->name = strdup("memory.kmem.limit_in_bytes");
-        memory_ker->value = memory_limit;
-        ++n_settings;
+    /* a host without NUMA has a single node 0 */
+    if (!mems) {
+        if (numa_read_list(NODE_ONLINE_PATH, online, sizeof(online)) == -1)
+            strcpy(online, "0");
+        mems = online;
+    }
+    set_limit(cgroup_arguments, LIMIT_CPUSET_MEMS, "%s", mems);
+}
 
-        /* now the controller */
-        ctr_memory = (struct cgrp_control *) malloc(sizeof(struct cgrp_control));
+void limit_memory_tiers(struct cgroup_args *cgroup_arguments, long high,
+        long low)
+{
+    if (high) {
+        cgroup_arguments->limits |= 1 << LIMIT_MEMORY_HIGH;
+        set_limit(cgroup_arguments, LIMIT_MEMORY_HIGH, "%ld", high);
+    }
 
-        if (!ctr_memory) {
-            printErr("alloc_ctr_memory malloc");
-        }
+    if (low) {
+        cgroup_arguments->limits |= 1 << LIMIT_MEMORY_LOW;
+        set_limit(cgroup_arguments, LIMIT_MEMORY_LOW, "%ld", low);
+    }
+}
 
-        ctr_memory->control = strdup("memory");
+void limit_swap(struct cgroup_args *cgroup_arguments, long swap)
+{
+    long memory = strtol(cgroup_arguments->arena
+        + cgroup_arguments->value[LIMIT_MEMORY], NULL, 10);
 
-        if (!ctr_memory->control) {
-            printErr("alloc_ctr_memory malloc");
-        }
+    cgroup_arguments->limits |= 1 << LIMIT_MEMORY | 1 << LIMIT_MEMORY_SWAP
+        | 1 << LIMIT_MEMSW;
 
-        ctr_memory->settings =
-            (struct cgrp_setting **) malloc(2 * sizeof(struct cgrp_setting *));
-        
-        if (!ctr_memory->settings) {
-            printErr("alloc_ctr_memory malloc");
-        }
+    set_limit(cgroup_arguments, LIMIT_MEMORY_SWAP, "%ld", swap);
+    set_limit(cgroup_arguments, LIMIT_MEMSW, "%ld", memory + swap);
+}
 
-        /* pushing the two setting structures */
-        ctr_memory->settings[0] = memory_usr;
-        ctr_memory->settings[1] = memory_ker;
-        ctr_memory->n_settings = n_settings;
+void limit_huge_pages(struct cgroup_args *cgroup_arguments, long page_kb,
+        long pages)
+{
+    enum cgrp_limit limit = page_kb == HUGE_PAGE_1G_KB ? LIMIT_HUGETLB_1G
+                                                       : LIMIT_HUGETLB_2M;
 
-        return ctr_memory;
+    cgroup_arguments->limits |= 1 << limit;
+    set_limit(cgroup_arguments, limit, "%ld", pages * page_kb * 1024);
 }
 
-struct cgrp_control *alloc_ctr_cpu(char *cpu_shares)
+void limit_numa_auto(struct cgroup_args *cgroup_arguments)
 {
-    struct cgrp_control *ctr_cpu = NULL;
-    struct cgrp_setting *cpu = NULL;
-    size_t n_settings = 0;
+    cgroup_arguments->numa_auto = true;
+}
 
-    cpu = (struct cgrp_setting *) malloc(sizeof(struct cgrp_setting));
+/* bind the container to the cpus and memory of the least loaded node */
+static void place_on_numa_node(struct cgroup_args *cgroup_arguments)
+{
+    char cpus[NUMA_LIST_SIZE];
+    int node;
 
-    if (!cpu) {
-        printErr("alloc_ctr_cpu malloc");
+    if ((node = numa_place(cpus, sizeof(cpus),
+            &cgroup_arguments->numa_lock_fd)) == -1) {
+        fprintf(stderr, "=> no NUMA topology, the container is not placed.\n");
+        return;
     }
 
-    cpu->name = strdup("cpu.shares");
-    cpu->value = cpu_shares;
-    ++n_settings;
+    cgroup_arguments->numa_node = node;
+    cgroup_arguments->limits |= 1 << LIMIT_CPUSET_CPUS
+        | 1 << LIMIT_CPUSET_MEMS;
 
-    ctr_cpu = (struct cgrp_control *) malloc(sizeof(struct cgrp_control));
+    set_limit(cgroup_arguments, LIMIT_CPUSET_CPUS, "%s", cpus);
+    set_limit(cgroup_arguments, LIMIT_CPUSET_MEMS, "%d", node);
+}
 
-    if (!ctr_cpu) {
-        printErr("alloc_ctr_cpu malloc");
-    }
+/* a new struct cgroup_args with the same limits and no slot, used when
+ * many containers are started with the same configuration */
+struct cgroup_args *copy_resources(struct cgroup_args *cgroup_arguments)
+{
+    struct cgroup_args *copy = NULL;
+    int i;
 
-    ctr_cpu->settings = (struct cgrp_setting **)
-        malloc(sizeof(struct cgrp_setting *));
-    
-    if (!ctr_cpu->settings) {
-        printErr("alloc_ctr_cpu malloc");
+    if (!cgroup_arguments)
+        return NULL;
+
+    copy = (struct cgroup_args *) malloc(sizeof(struct cgroup_args));
+
+    if (!copy) {
+        printErr("malloc at copy_resources");
     }
 
-    ctr_cpu->control = strdup("cpu");
-    ctr_cpu->settings[0] = cpu;
-    ctr_cpu->n_settings = n_settings;
+    /* the values are offsets in the arena, copied along */
+    *copy = *cgroup_arguments;
+    copy->slot = -1;
+    copy->slot_lock_fd = -1;
+    for (i = 0; i < N_CONTROLS; ++i)
+        copy->slot_fd[i] = -1;
+    copy->joined = false;
+    copy->cgroup_fd = -1;
+    copy->numa_node = -1;
+    copy->numa_lock_fd = -1;
+
+    return copy;
+}
 
-    return ctr_cpu;
+/* free a struct cgroup_args allocated by init_resources() */
+void destroy_resources(struct cgroup_args *cgroup_arguments)
+{
+    free(cgroup_arguments);
 }
 
-struct cgrp_control *alloc_ctr_pids(char *max_pids)
+/* write a whole value in a file of dir_fd */
+static int write_cgroup_file(int dir_fd, const char *file, const char *value,
+        size_t len)
 {
-    struct cgrp_control *ctr_pids = NULL;
-    struct cgrp_setting *pids = NULL;
-    size_t n_settings = 0;
+    int fd;
 
-    pids = (struct cgrp_setting *) malloc(sizeof(struct cgrp_setting));
+    if ((fd = openat(dir_fd, file, O_WRONLY | O_CLOEXEC)) == -1)
+        return -1;
 
-    if (!pids) {
-        printErr("alloc_ctr_pids malloc");
+    if (write(fd, value, len) == -1) {
+        close(fd);
+        return -1;
     }
 
-    pids->name = strdup("pids.max");
-    pids->value = max_pids;
-    ++n_settings;
+    return close(fd);
+}
+
+/* On cgroup v2 a controller is only available in a child cgroup once it
+ * is listed in the cgroup.subtree_control of its parent. A controller the
+ * kernel does not provide is skipped: writing its settings will fail. */
+static void enable_v2_controllers(int dir_fd)
+{
+    static const char *controls[] = {
+        "+memory", "+cpu", "+pids", "+io", "+cpuset", "+hugetlb"
+    };
+    int fd, i;
 
-    ctr_pids = (struct cgrp_control *) malloc(sizeof(struct cgrp_control));
+    fd = openat(dir_fd, "cgroup.subtree_control", O_WRONLY | O_CLOEXEC);
 
-    if (!ctr_pids) {
-        printErr("alloc_ctr_pids malloc");
+    if (fd == -1) {
+        printErr("open at enable_v2_controllers");
     }
 
-    ctr_pids->settings = (struct cgrp_setting **)
-        malloc(sizeof(struct cgrp_setting *));
-    
-    if (!ctr_pids->settings) {
-        printErr("alloc_ctr_pids malloc");
+    for (i = 0; i < sizeof(controls) / sizeof(*controls); ++i) {
+        if (write(fd, controls[i], strlen(controls[i])) == -1)
+            fprintf(stderr, "=> cannot enable the %s controller: %s\n",
+                controls[i] + 1, strerror(errno));
     }
 
-    ctr_pids->control = strdup("pids");
-    ctr_pids->settings[0] = pids;
-    ctr_pids->n_settings = n_settings;
-
-    return ctr_pids;
+    close(fd);
 }
 
-struct cgrp_control *alloc_ctr_blkio(char *io_weight)
+/* A new v1 cpuset is empty, and no task can join it, until cpuset.cpus
+ * and cpuset.mems are written: the pool gets the values of the root and
+ * the slots created below it inherit them (cgroup.clone_children). */
+static void inherit_cpuset(struct cgrp_hierarchy *hierarchy)
 {
-    struct cgrp_control *ctr_blkio = NULL;
-    struct cgrp_setting *blkio = NULL;
-    size_t n_settings = 0;
+    static const char *files[] = { "cpuset.cpus", "cpuset.mems" };
+    char value[CGROUP_READ_SIZE];
+    ssize_t n;
+    int fd, i;
+
+    for (i = 0; i < sizeof(files) / sizeof(*files); ++i) {
+        if ((fd = openat(hierarchy->root_fd, files[i], O_RDONLY | O_CLOEXEC))
+                == -1 || (n = read(fd, value, sizeof(value))) == -1) {
+            printErr("reading the root cpuset");
+        }
+        close(fd);
 
-    blkio = (struct cgrp_setting *) malloc(sizeof(struct cgrp_setting));
+        if (write_cgroup_file(hierarchy->pool_fd, files[i], value, n) == -1) {
+            printErr("writing the pool cpuset");
+        }
+    }
 
-    if (!blkio) {
-        printErr("alloc_ctr_blkio malloc");
+    if (write_cgroup_file(hierarchy->pool_fd, "cgroup.clone_children", "1", 1)
+            == -1) {
+        printErr("writing the pool cgroup.clone_children");
     }
+}
 
-    blkio->name = strdup("blkio.weight");
-    blkio->value = io_weight;
-    ++n_settings;
+/* The first time a controller is used the whole pool is created in one
+ * go, afterwards the directories are only reused. A concurrent container
+ * may still be populating the pool: in that case the last slot does not
+ * exist yet and the missing slots are created here as well. */
+static void populate_cgroup_pool(struct cgrp_hierarchy *hierarchy)
+{
+    char slot_name[16];
+    struct stat st;
+    int slot;
+
+    if (mkdirat(hierarchy->root_fd, CGROUP_POOL_NAME,
+            S_IRUSR | S_IWUSR | S_IXUSR) && errno != EEXIST) {
+        printErr("mkdir at populate_cgroup_pool");
+    }
 
-    ctr_blkio = (struct cgrp_control *) malloc(sizeof(struct cgrp_control));
+    hierarchy->pool_fd = openat(hierarchy->root_fd, CGROUP_POOL_NAME,
+        O_RDONLY | O_DIRECTORY | O_CLOEXEC);
 
-    if (!ctr_blkio) {
-        printErr("alloc_ctr_blkio malloc");
+    if (hierarchy->pool_fd == -1) {
+        printErr("open at populate_cgroup_pool");
     }
 
-    ctr_blkio->settings = (struct cgrp_setting **)
-        malloc(sizeof(struct cgrp_setting *));
-    
-    if (!ctr_blkio->settings) {
-        printErr("alloc_ctr_blkio malloc");
+    snprintf(slot_name, sizeof(slot_name), "%d", CGROUP_POOL_SIZE - 1);
+    if (fstatat(hierarchy->pool_fd, slot_name, &st, 0) == 0)
+        return;
+
+    if (cgroup_is_v2()) {
+        enable_v2_controllers(hierarchy->root_fd);
+        enable_v2_controllers(hierarchy->pool_fd);
+    } else if (hierarchy == &hierarchies[CTRL_CPUSET]) {
+        inherit_cpuset(hierarchy);
     }
 
-    ctr_blkio->control = strdup("blkio");
-    ctr_blkio->settings[0] = blkio;
-    ctr_blkio->n_settings = n_settings;
+    for (slot = 0; slot < CGROUP_POOL_SIZE; ++slot) {
+        snprintf(slot_name, sizeof(slot_name), "%d", slot);
 
-    return ctr_blkio;
+        if (mkdirat(hierarchy->pool_fd, slot_name, S_IRUSR | S_IWUSR | S_IXUSR)
+                && errno != EEXIST) {
+            printErr("mkdir at populate_cgroup_pool");
+        }
+    }
 }
 
-/* create a new cgroup controller */
-struct cgrp_control **setup_cgrp_controller(
-    struct cgroup_args *cgroup_arguments,
-    size_t *n_controller)
+/* /sys/fs/cgroup/<control>/mydocker on cgroup v1, /sys/fs/cgroup/mydocker
+ * for every controller on cgroup v2. Opened, and the pool populated, the
+ * first time a container of the process uses the controller. */
+static struct cgrp_hierarchy *open_hierarchy(enum cgrp_control control)
 {
-    struct cgrp_control **controller_l = NULL;
-    struct cgrp_control *ctr_memory = NULL;
-    struct cgrp_control *ctr_blkio = NULL;
-    struct cgrp_control *ctr_pids = NULL;
-    struct cgrp_control *ctr_cpu = NULL;
-    int n_controllers = 0, k = 0;
+    struct cgrp_hierarchy *hierarchy = &hierarchies[control];
+    char dir[BUFF_LEN] = { 0 };
 
-    if (cgroup_arguments->has_memory_limit) {
-        ++n_controllers;
-        ctr_memory = alloc_ctr_memory(cgroup_arguments->memory_limit);
-    }
+    pthread_mutex_lock(&hierarchies_lock);
 
-    if (cgroup_arguments->has_cpu_shares) {
-        ++n_controllers;
-        ctr_cpu = alloc_ctr_cpu(cgroup_arguments->cpu_shares);
-    }
+    if (hierarchy->pool_fd == -1) {
+        if (cgroup_is_v2())
+            strcpy(dir, "/sys/fs/cgroup");
+        else
+            snprintf(dir, sizeof(dir), "/sys/fs/cgroup/%s", hierarchy->name);
 
-    if (cgroup_arguments->has_max_pids) {
-        ++n_controllers;
-        ctr_pids = alloc_ctr_pids(cgroup_arguments->max_pids);
-    }
+        hierarchy->root_fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
 
-    if (cgroup_arguments->has_io_weight) {
-        ++n_controllers;
-        ctr_blkio = alloc_ctr_blkio(cgroup_arguments->io_weight);
+        if (hierarchy->root_fd == -1) {
+            printErr("open at open_hierarchy");
+        }
+
+        populate_cgroup_pool(hierarchy);
     }
 
-    controller_l = (struct cgrp_control **) 
-        malloc(n_controllers * sizeof(struct cgrp_control *));
+    pthread_mutex_unlock(&hierarchies_lock);
 
-    if (!controller_l) {
-        printErr("controller failed allocation");
-    }
+    return hierarchy;
+}
 
-    if (ctr_memory) {
-        controller_l[k++] = ctr_memory;
+/* a slot left with processes inside by a crashed run cannot be reused */
+static bool slot_is_empty(unsigned int controls, int slot)
+{
+    char path[BUFF_LEN] = { 0 };
+    char ch;
+    int i, fd;
+    ssize_t ret;
+
+    if (snprintf(path, sizeof(path), "%d/%s", slot,
+            cgroup_is_v2() ? "cgroup.procs" : "tasks") == -1) {
+        printErr("snprintf at slot_is_empty");
     }
 
-    if (ctr_cpu) {
-        controller_l[k++] = ctr_cpu;
+    for (i = 0; i < N_CONTROLS; ++i) {
+        if (!(controls & (1 << i)))
+            continue;
+
+        fd = openat(hierarchies[i].pool_fd, path, O_RDONLY | O_CLOEXEC);
+
+        if (fd == -1) {
+            if (errno == ENOENT)
+                continue;
+            printErr("open at slot_is_empty");
+        }
+
+        ret = read(fd, &ch, 1);
+        close(fd);
+
+        if (ret != 0)
+            return false;
     }
 
-    if (ctr_pids) {
-        controller_l[k++] = ctr_pids;
+    return true;
+}
+
+/* Lock the first free slot of the pool. The lock is a flock() on a file
+ * under RUN_DIR, so concurrent containers never share a slot and the lock
+ * goes away by itself if the owner dies. */
+static void acquire_cgroup_slot(struct cgroup_args *cgroup_arguments,
+        unsigned int controls)
+{
+    char lock_path[BUFF_LEN] = { 0 };
+    int slot, fd;
+
+    if (mkdir(RUN_DIR, S_IRUSR | S_IWUSR | S_IXUSR) && errno != EEXIST) {
+        printErr("mkdir at acquire_cgroup_slot");
     }
 
-    if (ctr_blkio) {
-        controller_l[k++] = ctr_blkio;
+    for (slot = 0; slot < CGROUP_POOL_SIZE; ++slot) {
+        if (snprintf(lock_path, sizeof(lock_path), RUN_DIR "/cgroup-%d.lock",
+                slot) == -1) {
+            printErr("snprintf at acquire_cgroup_slot");
+        }
+
+        if ((fd = open(lock_path, O_RDWR | O_CREAT | O_CLOEXEC, 0600)) == -1) {
+            printErr("open at acquire_cgroup_slot");
+        }
+
+        if (flock(fd, LOCK_EX | LOCK_NB) == -1
+                || !slot_is_empty(controls, slot)) {
+            close(fd);
+            continue;
+        }
+
+        cgroup_arguments->slot = slot;
+        cgroup_arguments->slot_lock_fd = fd;
+        return;
     }
-    
-    *n_controller = n_controllers;
-    return controller_l;
+
+    fprintf(stderr, "=> no free slot in the cgroup pool.\n");
+    exit(EXIT_FAILURE);
+}
+
+/* read a number of the huge pages pool of page_kb pages, -1 on error */
+static long huge_pages_read(long page_kb, const char *file)
+{
+    char path[BUFF_LEN], buf[32];
+    ssize_t n;
+    int fd;
+
+    snprintf(path, sizeof(path), HUGE_PAGES_PATH, page_kb, file);
+
+    if ((fd = open(path, O_RDONLY | O_CLOEXEC)) == -1)
+        return -1;
+
+    n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+
+    if (n <= 0)
+        return -1;
+    buf[n] = '\0';
+
+    return strtol(buf, NULL, 10);
 }
 
-void write_writing_process_task(char dir[BUFF_LEN])
+/* The hugetlb controller only limits the pages a container can take from
+ * the pool of the host: the pool is grown, if it has fewer unreserved free
+ * pages than the limit, so that the container finds them. The kernel may
+ * find less contiguous memory than asked, the container cannot start
+ * then. The pool is shared by every run of the host, its read-modify-write
+ * is done under a flock() on a file of RUN_DIR.
+ * The pages are not given back when the container terminates: the next
+ * containers find them free, and shrinking the pool under the other runs
+ * could take pages they are about to use. */
+static void reserve_huge_pages(struct cgroup_args *cgroup_arguments,
+        enum cgrp_limit limit, long page_kb)
 {
-    char file_name[BUFF_LEN];
-    char *value = NULL;
-    int fd = 0;
+    char path[BUFF_LEN], value[32];
+    long pages, free_pages, resv_pages, total;
+    int len, lock_fd;
 
-    if (snprintf(file_name, sizeof(file_name), "%s/tasks", dir) == -1) {
-        printErr("snprintf at write_writing_process_task");
+    pages = strtol(cgroup_arguments->arena + cgroup_arguments->value[limit],
+        NULL, 10) / (page_kb * 1024);
+
+    if (mkdir(RUN_DIR, S_IRUSR | S_IWUSR | S_IXUSR) && errno != EEXIST) {
+        printErr("mkdir at reserve_huge_pages");
     }
 
-    if ((fd = open(file_name, O_WRONLY)) == -1) {
-        printErr("open at write_writing_process_task");
+    if ((lock_fd = open(RUN_DIR "/hugepages.lock",
+            O_RDWR | O_CREAT | O_CLOEXEC, 0600)) == -1
+            || flock(lock_fd, LOCK_EX) == -1) {
+        printErr("locking the huge pages pool");
     }
 
-    value = strdup("0");
+    if ((free_pages = huge_pages_read(page_kb, "free_hugepages")) == -1
+            || (resv_pages = huge_pages_read(page_kb, "resv_hugepages")) == -1
+            || (total = huge_pages_read(page_kb, "nr_hugepages")) == -1) {
+        fprintf(stderr, "=> cannot read the pool of huge pages of %ld kB.\n",
+            page_kb);
+        exit(EXIT_FAILURE);
+    }
 
-    if (write(fd, value, strlen(value)) == -1) {
-        close(fd);
-        free(value);
-        printErr("writing the cgroup tasks file");
+    if (free_pages - resv_pages < pages) {
+        total += pages - (free_pages - resv_pages);
+        len = snprintf(value, sizeof(value), "%ld", total);
+        snprintf(path, sizeof(path), HUGE_PAGES_PATH, page_kb, "nr_hugepages");
+
+        if (write_cgroup_file(AT_FDCWD, path, value, len) == -1
+                || huge_pages_read(page_kb, "nr_hugepages") < total) {
+            fprintf(stderr, "=> cannot reserve %ld huge pages of %ld kB.\n",
+                pages, page_kb);
+            exit(EXIT_FAILURE);
+        }
     }
 
-    close(fd);
-    free(value);
+    close(lock_fd);
 }
 
-/* For each controller a new directory under
- * /sys/fs/cgroup/<cgrp_control.control>/container/ is created,
- * here a new file containing the resource limitation represented
- * by cgrp_setting is created and the associated value is written. */
-void setting_cgroups()
+/* The slot directory /sys/fs/cgroup/<control>/mydocker/<slot>/ of each
+ * hierarchy is opened once and reset by writing every enabled setting
+ * again: one open-write-close per file, relative to the slot directory. */
+void setting_cgroups(struct cgroup_args *cgroup_arguments)
 {
-    int i = 0, j = 0;
-    struct cgrp_control **cgrp;
-    struct cgrp_setting **setting;
+    const struct cgrp_setting *settings;
+    unsigned int controls;
+    char slot_name[16];
+    size_t i, n_settings;
+    int *slot_fd;
+
+    if (cgroup_arguments->numa_auto && cgroup_arguments->numa_node == -1)
+        place_on_numa_node(cgroup_arguments);
+
+    if (cgroup_arguments->limits & (1 << LIMIT_HUGETLB_2M))
+        reserve_huge_pages(cgroup_arguments, LIMIT_HUGETLB_2M, HUGE_PAGE_2M_KB);
+
+    if (cgroup_arguments->limits & (1 << LIMIT_HUGETLB_1G))
+        reserve_huge_pages(cgroup_arguments, LIMIT_HUGETLB_1G, HUGE_PAGE_1G_KB);
+
     fprintf(stderr, "=> setting cgroups...");
 
-    for (i = 0, cgrp = controller; i < n_controller; cgrp++, i++) {
-        char dir[BUFF_LEN] = { 0 };
+    controls = used_controls(cgroup_arguments);
 
-        if (snprintf(dir, sizeof(dir), "/sys/fs/cgroup/%s/" HOSTNAME,
-                (*cgrp)->control) == -1) {
-            printErr("snprintf at setting_cgroups");
-        }
-        
-        if (mkdir(dir, S_IRUSR | S_IWUSR | S_IXUSR)) {
-            printErr("mkdir at setting_cgroups");
+    for (i = 0; i < N_CONTROLS; ++i) {
+        if (controls & (1 << i))
+            open_hierarchy(i);
+    }
+
+    acquire_cgroup_slot(cgroup_arguments, controls);
+    snprintf(slot_name, sizeof(slot_name), "%d", cgroup_arguments->slot);
+
+    for (i = 0; i < N_CONTROLS; ++i) {
+        if (!(controls & (1 << i)))
+            continue;
+
+        cgroup_arguments->slot_fd[i] = openat(hierarchies[i].pool_fd,
+            slot_name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+        if (cgroup_arguments->slot_fd[i] == -1) {
+            printErr("open at setting_cgroups");
         }
+    }
 
-        for (j = 0, setting = (*cgrp)->settings;
-                j < (*cgrp)->n_settings;
-                setting++, j++) {
-            char path[BUFF_LEN] = {0};
-            int fd = 0;
-            
-            if (snprintf(path, sizeof(path), "%s/%s", dir,
-                    (*setting)->name) == -1) {
-                printErr("snprintf at setting_cgroups");
-            }
+    settings = cgroup_settings(&n_settings);
 
-            if ((fd = open(path, O_WRONLY)) == -1) {
-                printErr("open at setting_cgroups");
-            }
+    for (i = 0; i < n_settings; ++i) {
+        enum cgrp_limit limit = settings[i].limit;
 
-            if (write(fd, (*setting)->value, strlen((*setting)->value)) == -1) {
-                close(fd);
-                printErr("writing the cgroup file");
-            }
-            printf("\nopened: %s\nwrote: %s\n", path, (*setting)->value);
-            close(fd);
+        if (!(cgroup_arguments->limits & (1 << limit)))
+            continue;
+
+        slot_fd = &cgroup_arguments->slot_fd[hierarchy_of(settings[i].control)];
+
+        if (write_cgroup_file(*slot_fd, settings[i].file,
+                cgroup_arguments->arena + cgroup_arguments->value[limit],
+                cgroup_arguments->value_len[limit]) == -1
+                && !(settings[i].optional && errno == ENOENT)) {
+            printErr("writing the cgroup file");
         }
+    }
+
+    if (cgroup_is_v2()) {
+        /* the child is cloned straight into the slot */
+        cgroup_arguments->cgroup_fd = cgroup_arguments->slot_fd[0];
+        fprintf(stderr, "done.\n");
+        return;
+    }
 
-        write_writing_process_task(dir);
+    for (i = 0; i < N_CONTROLS; ++i) {
+        if (controls & (1 << i)
+                && write_cgroup_file(cgroup_arguments->slot_fd[i], "tasks",
+                    "0", 1) == -1) {
+            printErr("writing the cgroup tasks file");
+        }
     }
+
+    cgroup_arguments->joined = true;
     fprintf(stderr, "done.\n");
 }
 
@@ -399,74 +776,144 @@ void set_fd_hard_limit()
 	fprintf(stderr, "done.\n");
 }
 
-/* now we can free the settings associated with each controller
- * and the controller array associated memory */
-void cleanup_controller()
+int cgroup_slot_fd(struct cgroup_args *cgroup_arguments,
+        enum cgrp_control control)
 {
-    int i = 0;
-    int j = 0;
-    
-    for (i = 0; i < n_controller; ++i) {
-        free(controller[i]->control);
-        for (j = 0; j < controller[i]->n_settings; ++j) {
-            free(controller[i]->settings[j]->name);
-            free(controller[i]->settings[j]->value);
+    return cgroup_arguments->slot_fd[hierarchy_of(control)];
+}
+
+int cgroup_read_keyed(int fd, const char *const *keys,
+        unsigned long long *values, size_t n_keys)
+{
+    char buf[CGROUP_READ_SIZE], *key, *end;
+    unsigned long long value;
+    int found = 0;
+    ssize_t n;
+    size_t i;
+
+    if ((n = pread(fd, buf, sizeof(buf) - 1, 0)) == -1)
+        return -1;
+    buf[n] = '\0';
+
+    for (key = buf; *key; key = end + (*end == '\n')) {
+        if (!(end = strchr(key, ' ')))
+            break;
+
+        *end = '\0';
+        value = strtoull(end + 1, &end, 10);
+
+        for (i = 0; i < n_keys; ++i) {
+            if (!strcmp(key, keys[i])) {
+                values[i] = value;
+                found |= 1 << i;
+            }
         }
-        free(controller[i]->settings);
     }
-    free(controller);
+
+    return found;
 }
 
-void free_cgroup_resources()
+unsigned long long cgroup_read_pressure(int fd)
+{
+    char buf[CGROUP_READ_SIZE], *total;
+    ssize_t n;
+
+    if ((n = pread(fd, buf, sizeof(buf) - 1, 0)) == -1)
+        return 0;
+    buf[n] = '\0';
+
+    if (!(total = strstr(buf, "total=")))
+        return 0;
+
+    return strtoull(total + 6, NULL, 10);
+}
+
+void leave_cgroups(struct cgroup_args *cgroup_arguments)
 {
     int i = 0;
-    struct cgrp_control **cgrp = NULL;
-
-    fprintf(stderr, "=> cleaning cgroups...");
-	
-    for (cgrp = controller, i = 0; i < n_controller; ++i) {
-		char dir[BUFF_LEN] = {0};
-		char task[BUFF_LEN] = {0};
-		int task_fd = 0;
-
-		if (snprintf(dir, sizeof(dir), "/sys/fs/cgroup/%s/" HOSTNAME,
-			    cgrp[i]->control) == -1
-		    || snprintf(task, sizeof(task), "/sys/fs/cgroup/%s/tasks",
-				cgrp[i]->control) == -1) {
-			printErr("snprintf - free_cgroup_resources");
-		}
-
-		if ((task_fd = open(task, O_WRONLY)) == -1) {
-			printErr("open - free_cgroup_resources");
-		}
-
-        /* first we have to clean all pids into the cgroup namespace */
-		if (write(task_fd, "0", 2) == -1) {
-			close(task_fd);
-            printErr("writing to task in free_cgroup_resources");
-		}
-		
-        close(task_fd);
-
-        /* now we can remove the cgroup folder */
-		if (rmdir(dir)) {
-			printErr("rmdir in free_cgroup_resources");
-		}
-	}
 
-    /* free the allocated memory */
-    cleanup_controller();
+    if (!cgroup_arguments || !cgroup_arguments->joined)
+        return;
+
+    for (i = 0; i < N_CONTROLS; ++i) {
+        if (cgroup_arguments->slot_fd[i] == -1)
+            continue;
+
+        /* the slot will only contain the containered processes */
+        if (write_cgroup_file(hierarchies[i].root_fd, "tasks", "0", 1) == -1) {
+            printErr("writing to task in leave_cgroups");
+        }
+    }
+
+    cgroup_arguments->joined = false;
+}
+
+/* Give the slot back the settings of a new cgroup. Every file of the
+ * hierarchies the container used is reset, whether it set the limit or
+ * not: "-M 64M" then a plain "-c" run in the same slot must not leave the
+ * second container with the memory limit of the first. */
+static void reset_cgroups(struct cgroup_args *cgroup_arguments)
+{
+    const struct cgrp_setting *settings;
+    size_t i, n_settings;
+    int slot_fd;
+
+    settings = cgroup_settings(&n_settings);
+
+    for (i = n_settings; i-- > 0; ) {
+        slot_fd = cgroup_slot_fd(cgroup_arguments, settings[i].control);
+
+        if (!settings[i].reset || slot_fd == -1)
+            continue;
+
+        write_cgroup_file(slot_fd, settings[i].file, settings[i].reset,
+            strlen(settings[i].reset));
+    }
+}
+
+void free_cgroup_resources(struct cgroup_args *cgroup_arguments)
+{
+    int i;
+
+    if (!cgroup_arguments)
+        return;
+
+    fprintf(stderr, "=> releasing cgroups...");
+
+    leave_cgroups(cgroup_arguments);
+
+    reset_cgroups(cgroup_arguments);
+
+    numa_release(cgroup_arguments->numa_lock_fd);
+    cgroup_arguments->numa_lock_fd = -1;
+    cgroup_arguments->numa_node = -1;
+
+    /* cgroup_fd is the slot directory of the first hierarchy */
+    for (i = 0; i < N_CONTROLS; ++i) {
+        if (cgroup_arguments->slot_fd[i] != -1) {
+            close(cgroup_arguments->slot_fd[i]);
+            cgroup_arguments->slot_fd[i] = -1;
+        }
+    }
+    cgroup_arguments->cgroup_fd = -1;
+
+    /* The slot directories are kept for the next container: once every
+     * containered process is gone the slot is empty and it is enough to
+     * drop the lock. */
+    if (cgroup_arguments->slot_lock_fd != -1) {
+        close(cgroup_arguments->slot_lock_fd);
+        cgroup_arguments->slot_lock_fd = -1;
+        cgroup_arguments->slot = -1;
+    }
+
 	fprintf(stderr, "done.\n");
 }
 
 void apply_cgroups(struct cgroup_args *cgroup_arguments)
 {
-    controller = setup_cgrp_controller(cgroup_arguments, &n_controller);
-
-    /* The hostname will be 'mydocker', actually it is static */
-    setting_cgroups();
+    setting_cgroups(cgroup_arguments);
 
     //TODO: actually not working
     /* hard limit on the number of file descriptor. */
     //set_fd_hard_limit();
-}
\ No newline at end of file
+}
@@ -11,40 +11,80 @@
 									 // It defines a throttling/upper IO rate
 									 //limit on devices.
 
+#define CGROUP_POOL_NAME	"mydocker"	 // pool dir under each controller
+#define CGROUP_POOL_SIZE	64				 // max concurrent containers
+
 typedef enum {false, true} bool;
 
+#define CGROUP_ARENA_SIZE	1024			 // room for every formatted value:
+									 // the numbers and two lists of
+									 // NUMA_LIST_SIZE (--cpus, --mems)
+#define CGROUP_READ_SIZE	4096			 // largest cgroup file read
+
+#define HUGE_PAGE_2M_KB		2048
+#define HUGE_PAGE_1G_KB		1048576
+#define HUGE_PAGES_PATH		"/sys/kernel/mm/hugepages/hugepages-%ldkB/%s"
+
+/* The hierarchies a limit is written in. On cgroup v2 they are all the
+ * same directory. */
+enum cgrp_control {
+	CTRL_MEMORY,
+	CTRL_CPU,
+	CTRL_PIDS,
+	CTRL_IO,
+	CTRL_CPUSET,
+	CTRL_HUGETLB,
+	N_CONTROLS
+};
+
+/* The values of struct cgroup_args. The files each one is written to
+ * are listed in the settings tables of cgroup.c. */
+enum cgrp_limit {
+	LIMIT_MEMORY,				/* kernel and user space both */
+	LIMIT_CPU_SHARES,			/* cgroup v1 cpu.shares */
+	LIMIT_CPU_WEIGHT,			/* the same as a cgroup v2 cpu.weight */
+	LIMIT_PIDS,
+	LIMIT_IO_WEIGHT,			/* the default weight on all io devices */
+	LIMIT_CPU_MAX,				/* cgroup v2 cpu.max "<quota> <period>" */
+	LIMIT_CPU_QUOTA,			/* the same as cgroup v1 cfs quota ... */
+	LIMIT_CPU_PERIOD,			/* ... and period, in us */
+	LIMIT_CPUSET_CPUS,			/* cpu list of the container */
+	LIMIT_CPUSET_MEMS,			/* its memory nodes */
+	LIMIT_MEMORY_HIGH,			/* cgroup v2 only: throttled and reclaimed above */
+	LIMIT_MEMORY_LOW,			/* protected from reclaim below, v1 soft limit */
+	LIMIT_MEMORY_SWAP,			/* cgroup v2 memory.swap.max */
+	LIMIT_MEMSW,				/* the same as cgroup v1 memory + swap */
+	LIMIT_HUGETLB_2M,			/* bytes of 2 MiB huge pages */
+	LIMIT_HUGETLB_1G,			/* bytes of 1 GiB huge pages */
+	N_LIMITS
+};
+
 /* This structure contains all information about the
  * resources limitations that will be applied in the
  * cgrop namespace of the process.
- * Metrics should be reported as string. */
+ * Every value is formatted once by init_resources() in the arena of the
+ * structure: a copy is a plain assignment and nothing else is allocated
+ * while the container is configured. */
 struct cgroup_args {
-	bool has_max_pids;			/* max_pids flag */
-	bool has_io_weight;			/* io_weight flag */
-	bool has_memory_limit;		/* memory_limit flag */
-	bool has_cpu_shares;		/* max_pids flag */
-    char *max_pids;				/* max pids limit */
-    char *io_weight;			/* io default weight limit */
-	char *memory_limit;			/* memory limit. Kernel and user space both */
-    char *cpu_shares;			/* cpu shares chunks value */
+	unsigned int limits;		/* enabled limits, 1 << enum cgrp_limit */
+	unsigned short value[N_LIMITS];	/* offset of each value in arena */
+	unsigned short value_len[N_LIMITS];
+	char arena[CGROUP_ARENA_SIZE];
+	size_t arena_used;
+	int slot;					/* cgroup pool slot in use */
+	int slot_lock_fd;			/* holds the slot lock, -1 if none */
+	int slot_fd[N_CONTROLS];	/* slot directory of each hierarchy */
+	bool joined;				/* the caller is inside the slot */
+	int cgroup_fd;				/* cgroup v2 slot for CLONE_INTO_CGROUP */
+	bool numa_auto;				/* placed on a node by apply_cgroups() */
+	int numa_node;				/* node it was placed on, -1 if none */
+	int numa_lock_fd;			/* counts it on that node, -1 if none */
 };
 
-/* This structure represents the file that is written inside
- * /sys/fs/cgroup/<cgrp_control.control>/mydocker/ 
- * the name of the file is cgrp_setting.name and the value that is written
- * inside is store inside cgrp_setting.value */
-struct cgrp_setting {
-	char *name;
-	char *value;
-};
-
-/* Represents the directory that will be created in /sys/fs/cgroup/
- * each controller is dedicated for a certain type of resource, for example
- * the maximum userspace memory that can be allocated by the process. */
-struct cgrp_control {
-	char *control;
-	size_t n_settings;
-	struct cgrp_setting **settings;
-};
+/* true on a cgroup v2 (unified hierarchy) only host. cgroup v2 uses
+ * memory.max, cpu.weight, pids.max and io.weight in a single directory
+ * and the child is cloned into it with clone3(CLONE_INTO_CGROUP). */
+bool cgroup_is_v2();
 
 /* initialize the struct cgroup_args */
 void init_resources(bool cgroup_flag, bool pids_flag, bool memory_flag,
@@ -52,8 +92,65 @@ void init_resources(bool cgroup_flag, bool pids_flag, bool memory_flag,
 			long max_pids, long memory_limit, long max_weight,
 			long cpu_shares, struct cgroup_args **cgroup_arguments);
 
-/* apply a specific resource configuration for the containered process */
+/* limit the cpu time of the container to quota_us every period_us */
+void limit_cpu_max(struct cgroup_args *cgroup_arguments, long quota_us,
+			long period_us);
+
+/* Pin the container to the cpus and memory nodes lists, "0-3,8". A NULL
+ * list stands for every online cpu or node of the host. */
+void limit_cpuset(struct cgroup_args *cgroup_arguments, const char *cpus,
+			const char *mems);
+
+/* The soft tiers of the memory limit, in bytes, 0 leaves a tier unset.
+ * Above high the container is throttled and reclaimed instead of being
+ * killed, below low its memory is only reclaimed if nothing else can be. */
+void limit_memory_tiers(struct cgroup_args *cgroup_arguments, long high,
+			long low);
+
+/* allow swap bytes of swap on top of the memory limit, which is then
+ * enforced even if it was not given */
+void limit_swap(struct cgroup_args *cgroup_arguments, long swap);
+
+/* Limit the container to pages huge pages of page_kb (2048 or 1048576)
+ * kB. The pages are reserved in the pool of the host when the container
+ * starts. */
+void limit_huge_pages(struct cgroup_args *cgroup_arguments, long page_kb,
+			long pages);
+
+/* place the container on the least loaded NUMA node when its cgroups are
+ * applied (see numa.h) */
+void limit_numa_auto(struct cgroup_args *cgroup_arguments);
+
+/* duplicate the limits of cgroup_arguments, without its pool slot */
+struct cgroup_args *copy_resources(struct cgroup_args *cgroup_arguments);
+
+/* free a struct cgroup_args allocated by init_resources() or
+ * copy_resources() */
+void destroy_resources(struct cgroup_args *cgroup_arguments);
+
+/* Apply a specific resource configuration for the containered process.
+ * A free slot of the cgroup pool is locked, configured and joined by the
+ * caller so that the next clone() is created inside it. */
 void apply_cgroups(struct cgroup_args *cgroup_arguments);
 
-/* clean and remove the cgroup folder */
-void free_cgroup_resources();
\ No newline at end of file
+/* The slot directory of control while the container runs, -1 if that
+ * hierarchy has no limit. Owned by cgroup_arguments. */
+int cgroup_slot_fd(struct cgroup_args *cgroup_arguments,
+			enum cgrp_control control);
+
+/* Read the flat keyed file at fd, "<key> <value>" lines like cpu.stat or
+ * memory.events: values[i] gets the value of keys[i]. Returns the mask
+ * (1 << i) of the keys found, or -1. */
+int cgroup_read_keyed(int fd, const char *const *keys,
+			unsigned long long *values, size_t n_keys);
+
+/* the total stall time (us) of the "some" line of the pressure file at
+ * fd, like cpu.pressure, 0 if it cannot be read */
+unsigned long long cgroup_read_pressure(int fd);
+
+/* move the caller back to the root cgroups once the child is cloned */
+void leave_cgroups(struct cgroup_args *cgroup_arguments);
+
+/* Release the pool slot. The cgroup directories are kept to be reused
+ * by the next container, nothing is removed on this path. */
+void free_cgroup_resources(struct cgroup_args *cgroup_arguments);
\ No newline at end of file
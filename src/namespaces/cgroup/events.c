@@ -0,0 +1,423 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include "cgroup.h"
+#include "events.h"
+#include "../../helpers/helpers.h"
+#include "../../helpers/phases.h"
+
+#define EVENTS_RECORD_SIZE  160
+
+/* what a container is notified by */
+enum events_source {
+    SRC_MEMORY_PRESSURE,            /* v2 PSI trigger, v1 eventfd */
+    SRC_CPU_PRESSURE,               /* v2 PSI trigger */
+    SRC_MEMORY_EVENTS,              /* v2 memory.events */
+    SRC_OOM,                        /* v1 eventfd */
+    N_SOURCES
+};
+
+static const char *event_names[N_EVENT_TYPES] = {
+    [EVENT_MEMORY_PRESSURE] = "memory_pressure",
+    [EVENT_CPU_PRESSURE]    = "cpu_pressure",
+    [EVENT_MEMORY_HIGH]     = "memory_high",
+    [EVENT_MEMORY_MAX]      = "memory_max",
+    [EVENT_OOM]             = "oom",
+    [EVENT_OOM_KILL]        = "oom_kill",
+};
+
+/* the counters of memory.events that are reported */
+static const struct {
+    const char *key;
+    enum cgroup_event_type type;
+} memory_counters[] = {
+    { "high",       EVENT_MEMORY_HIGH },
+    { "max",        EVENT_MEMORY_MAX },
+    { "oom",        EVENT_OOM },
+    { "oom_kill",   EVENT_OOM_KILL },
+};
+
+/* a watched container, indexed by its cgroup slot */
+struct events_cgroup {
+    pid_t pid;                      /* 0 if the slot is not watched */
+    uint32_t generation;            /* tells the epoll events of a reused slot */
+    int fd[N_SOURCES];              /* -1 if not available */
+    uint64_t count[N_EVENT_TYPES];  /* counters already reported */
+    unsigned long long pressure_ns; /* last v1 pressure report */
+};
+
+static struct events_cgroup watched[CGROUP_POOL_SIZE];
+
+/* held while watched and the output are used */
+static pthread_mutex_t events_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t events_once = PTHREAD_ONCE_INIT;
+
+static int epoll_fd = -1;
+static int events_fd = -1;
+static int events_is_socket = 0;
+
+/* sources that could not be set up, reported once */
+static unsigned int unavailable = 0;
+
+#define N_ELEMS(array) (sizeof(array) / sizeof(*(array)))
+
+#define EVENT_KEY(slot, source, generation) \
+    ((uint64_t) (generation) << 32 | (uint64_t) (slot) << 8 | (source))
+
+static void events_report(int slot, enum cgroup_event_type type,
+        unsigned long long value)
+{
+    char record[EVENTS_RECORD_SIZE];
+    struct timespec ts;
+    int len;
+
+    if (events_fd == -1)
+        return;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    len = snprintf(record, sizeof(record),
+        "mydocker_event,slot=%d,pid=%d,type=%s value=%llui %llu\n",
+        slot, watched[slot].pid, event_names[type], value,
+        ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+
+    /* the containers keep running without a consumer */
+    if (write_output(events_fd, events_is_socket, record, len) == -1) {
+        fprintf(stderr, "=> events output failed: %s, reporting stopped.\n",
+            strerror(errno));
+        close(events_fd);
+        events_fd = -1;
+    }
+}
+
+/* Read memory.events into counts, in the order of memory_counters. Reading
+ * the file also acknowledges its notification. */
+static int read_memory_events(int fd, unsigned long long *counts)
+{
+    const char *keys[N_ELEMS(memory_counters)];
+    size_t i;
+
+    for (i = 0; i < N_ELEMS(memory_counters); ++i)
+        keys[i] = memory_counters[i].key;
+
+    return cgroup_read_keyed(fd, keys, counts, N_ELEMS(keys)) == -1 ? -1 : 0;
+}
+
+static void handle_memory_events(int slot)
+{
+    struct events_cgroup *cgroup = &watched[slot];
+    unsigned long long counts[N_ELEMS(memory_counters)] = { 0 };
+    enum cgroup_event_type type;
+    size_t i;
+
+    if (read_memory_events(cgroup->fd[SRC_MEMORY_EVENTS], counts))
+        return;
+
+    for (i = 0; i < N_ELEMS(memory_counters); ++i) {
+        type = memory_counters[i].type;
+
+        if (counts[i] > cgroup->count[type]) {
+            cgroup->count[type] = counts[i];
+            events_report(slot, type, counts[i]);
+        }
+    }
+}
+
+/* The number of notifications of a cgroup v1 eventfd. Reclaim signals
+ * the pressure level every few hundred pages: like a PSI trigger, pressure
+ * is reported at most once per window. */
+static void handle_eventfd(int slot, int fd, enum cgroup_event_type type)
+{
+    struct events_cgroup *cgroup = &watched[slot];
+    unsigned long long now;
+    uint64_t n;
+
+    if (read(fd, &n, sizeof(n)) != sizeof(n))
+        return;
+
+    cgroup->count[type] += n;
+
+    if (type == EVENT_MEMORY_PRESSURE) {
+        now = monotonic_ns();
+        if (now - cgroup->pressure_ns < EVENTS_PSI_WINDOW * 1000ULL)
+            return;
+        cgroup->pressure_ns = now;
+    }
+
+    events_report(slot, type, cgroup->count[type]);
+}
+
+/* the stall time since the container started */
+static void handle_pressure(int slot, int fd, enum cgroup_event_type type)
+{
+    events_report(slot, type,
+        cgroup_read_pressure(fd) - watched[slot].count[type]);
+}
+
+static void events_handle(int slot, enum events_source source)
+{
+    int fd = watched[slot].fd[source];
+
+    switch (source) {
+        case SRC_MEMORY_PRESSURE:
+            if (cgroup_is_v2())
+                handle_pressure(slot, fd, EVENT_MEMORY_PRESSURE);
+            else
+                handle_eventfd(slot, fd, EVENT_MEMORY_PRESSURE);
+            break;
+
+        case SRC_CPU_PRESSURE:
+            handle_pressure(slot, fd, EVENT_CPU_PRESSURE);
+            break;
+
+        case SRC_MEMORY_EVENTS:
+            handle_memory_events(slot);
+            break;
+
+        case SRC_OOM:
+            handle_eventfd(slot, fd, EVENT_OOM);
+            break;
+
+        default:
+            break;
+    }
+}
+
+static void *events_loop(void *unused)
+{
+    struct epoll_event events[EVENTS_MAX_EVENTS];
+    struct events_cgroup *cgroup;
+    uint64_t key;
+    int i, n, slot;
+
+    for (;;) {
+        if ((n = epoll_wait(epoll_fd, events, EVENTS_MAX_EVENTS, -1)) == -1) {
+            if (errno == EINTR)
+                continue;
+            printErr("events epoll_wait");
+        }
+
+        pthread_mutex_lock(&events_lock);
+
+        for (i = 0; i < n; ++i) {
+            key = events[i].data.u64;
+            slot = key >> 8 & 0xffffff;
+            cgroup = &watched[slot];
+
+            /* the container was unwatched before we got the lock */
+            if (!cgroup->pid || cgroup->generation != key >> 32)
+                continue;
+
+            events_handle(slot, key & 0xff);
+        }
+
+        pthread_mutex_unlock(&events_lock);
+    }
+
+    return NULL;
+}
+
+static void events_start()
+{
+    pthread_t thread;
+    int err;
+
+    if ((epoll_fd = epoll_create1(EPOLL_CLOEXEC)) == -1)
+        printErr("events epoll_create");
+
+    if ((err = pthread_create(&thread, NULL, events_loop, NULL))) {
+        errno = err;
+        printErr("pthread_create events");
+    }
+
+    pthread_detach(thread);
+}
+
+static void source_unavailable(enum events_source source, const char *file)
+{
+    if (unavailable & (1 << source))
+        return;
+
+    unavailable |= 1 << source;
+    fprintf(stderr, "=> no notification from %s: %s\n", file,
+        strerror(errno));
+}
+
+/* a PSI trigger stays armed as long as its fd is open */
+static int psi_trigger(int dir_fd, const char *file)
+{
+    char trigger[64];
+    int fd, len;
+
+    if ((fd = openat(dir_fd, file, O_RDWR | O_NONBLOCK | O_CLOEXEC)) == -1)
+        return -1;
+
+    len = snprintf(trigger, sizeof(trigger), "some %d %d", EVENTS_PSI_STALL,
+        EVENTS_PSI_WINDOW);
+
+    /* the NUL is part of the trigger */
+    if (write(fd, trigger, len + 1) == -1) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+/* An eventfd signalled by the cgroup v1 memory controller, the
+ * registration lives as long as the eventfd. */
+static int v1_memory_event(int dir_fd, const char *file, const char *args)
+{
+    char line[64];
+    int event_fd, target_fd, control_fd, len;
+
+    if ((event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) == -1)
+        return -1;
+
+    target_fd = openat(dir_fd, file, O_RDONLY | O_CLOEXEC);
+    control_fd = openat(dir_fd, "cgroup.event_control", O_WRONLY | O_CLOEXEC);
+
+    len = snprintf(line, sizeof(line), "%d %d%s%s", event_fd, target_fd,
+        args ? " " : "", args ? args : "");
+
+    if (target_fd == -1 || control_fd == -1 || write(control_fd, line, len) == -1) {
+        close(event_fd);
+        event_fd = -1;
+    }
+
+    if (target_fd != -1)
+        close(target_fd);
+    if (control_fd != -1)
+        close(control_fd);
+
+    return event_fd;
+}
+
+void events_open(const char *target)
+{
+    if ((events_fd = open_output(target, &events_is_socket)) == -1)
+        printErr("open the events output");
+}
+
+void events_watch(struct cgroup_args *cgroup_arguments, pid_t pid)
+{
+    static const char *files[N_SOURCES] = {
+        [SRC_MEMORY_PRESSURE]   = "memory.pressure",
+        [SRC_CPU_PRESSURE]      = "cpu.pressure",
+        [SRC_MEMORY_EVENTS]     = "memory.events",
+        [SRC_OOM]               = "memory.oom_control",
+    };
+    unsigned long long counts[N_ELEMS(memory_counters)] = { 0 };
+    struct events_cgroup *cgroup;
+    struct epoll_event ev;
+    int i, slot, dir_fd;
+
+    if (events_fd == -1 || !cgroup_arguments)
+        return;
+
+    /* the memory slot, the single slot on cgroup v2 */
+    if ((dir_fd = cgroup_slot_fd(cgroup_arguments, CTRL_MEMORY)) == -1)
+        return;
+
+    pthread_once(&events_once, events_start);
+
+    pthread_mutex_lock(&events_lock);
+    slot = cgroup_arguments->slot;
+    cgroup = &watched[slot];
+    memset(cgroup->count, 0, sizeof(cgroup->count));
+    cgroup->pressure_ns = 0;
+
+    for (i = 0; i < N_SOURCES; ++i)
+        cgroup->fd[i] = -1;
+
+    if (cgroup_is_v2()) {
+        cgroup->fd[SRC_MEMORY_PRESSURE] = psi_trigger(dir_fd, "memory.pressure");
+        cgroup->fd[SRC_CPU_PRESSURE] = psi_trigger(dir_fd, "cpu.pressure");
+        cgroup->fd[SRC_MEMORY_EVENTS] = openat(dir_fd, "memory.events",
+            O_RDONLY | O_CLOEXEC);
+    } else {
+        cgroup->fd[SRC_MEMORY_PRESSURE] = v1_memory_event(dir_fd,
+            "memory.pressure_level", "medium");
+        cgroup->fd[SRC_OOM] = v1_memory_event(dir_fd, "memory.oom_control",
+            NULL);
+    }
+
+    /* the slot is reused: only what happens from now on is reported */
+    if (cgroup->fd[SRC_MEMORY_PRESSURE] != -1 && cgroup_is_v2())
+        cgroup->count[EVENT_MEMORY_PRESSURE] =
+            cgroup_read_pressure(cgroup->fd[SRC_MEMORY_PRESSURE]);
+
+    if (cgroup->fd[SRC_CPU_PRESSURE] != -1)
+        cgroup->count[EVENT_CPU_PRESSURE] =
+            cgroup_read_pressure(cgroup->fd[SRC_CPU_PRESSURE]);
+
+    if (cgroup->fd[SRC_MEMORY_EVENTS] != -1
+            && !read_memory_events(cgroup->fd[SRC_MEMORY_EVENTS], counts)) {
+        for (i = 0; i < N_ELEMS(memory_counters); ++i)
+            cgroup->count[memory_counters[i].type] = counts[i];
+    }
+
+    for (i = 0; i < N_SOURCES; ++i) {
+        if (cgroup->fd[i] == -1) {
+            if (cgroup_is_v2() == (i != SRC_OOM))
+                source_unavailable(i, files[i]);
+            continue;
+        }
+
+        /* eventfds are readable, the cgroup files raise POLLPRI */
+        ev.events = cgroup_is_v2() ? EPOLLPRI : EPOLLIN;
+        ev.data.u64 = EVENT_KEY(slot, i, cgroup->generation);
+
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, cgroup->fd[i], &ev) == -1)
+            printErr("events epoll_ctl");
+    }
+
+    cgroup->pid = pid;
+    pthread_mutex_unlock(&events_lock);
+}
+
+void events_unwatch(struct cgroup_args *cgroup_arguments)
+{
+    struct events_cgroup *cgroup;
+    int i, slot;
+
+    if (!cgroup_arguments || cgroup_arguments->slot == -1)
+        return;
+
+    pthread_mutex_lock(&events_lock);
+    slot = cgroup_arguments->slot;
+    cgroup = &watched[slot];
+
+    if (!cgroup->pid) {
+        pthread_mutex_unlock(&events_lock);
+        return;
+    }
+
+    /* an OOM kill racing with the exit of the container */
+    if (cgroup->fd[SRC_MEMORY_EVENTS] != -1)
+        handle_memory_events(slot);
+
+    if (cgroup->fd[SRC_OOM] != -1)
+        handle_eventfd(slot, cgroup->fd[SRC_OOM], EVENT_OOM);
+
+    for (i = 0; i < N_SOURCES; ++i) {
+        if (cgroup->fd[i] == -1)
+            continue;
+
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, cgroup->fd[i], NULL);
+        close(cgroup->fd[i]);
+        cgroup->fd[i] = -1;
+    }
+
+    cgroup->pid = 0;
+    ++cgroup->generation;
+    pthread_mutex_unlock(&events_lock);
+}
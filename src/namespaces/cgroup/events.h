@@ -0,0 +1,63 @@
+/**
+ * Cgroup events.
+ *
+ * The memory and cpu troubles of a running container are reported as soon
+ * as the kernel sees them, instead of when waitpid() returns. A thread of
+ * the parent sleeps in epoll_wait() on the notification files of every
+ * container and wakes up only when one of them fires:
+ *
+ *   cgroup v2
+ *     memory.pressure, cpu.pressure    a PSI trigger "some <stall> <window>"
+ *                                      fires POLLPRI when the tasks stalled
+ *                                      more than EVENTS_PSI_STALL us within
+ *                                      EVENTS_PSI_WINDOW us
+ *     memory.events                    POLLPRI when a counter changes: high
+ *                                      (throttled by memory.high), max (hit
+ *                                      memory.max), oom and oom_kill
+ *   cgroup v1
+ *     memory.pressure_level            an eventfd registered through
+ *     memory.oom_control               cgroup.event_control, signalled at
+ *                                      the medium level and on an OOM
+ *
+ * Each event is written as a line protocol record timestamped with
+ * CLOCK_REALTIME, to a file or a unix stream socket given as unix:<path>:
+ *
+ *   mydocker_event,slot=3,pid=4242,type=oom_kill value=1i 1792259445561874893
+ *
+ * The value is the new count of a memory.events counter or of the OOM
+ * notifications. For a pressure event it is the stall time (us) since the
+ * container started, the number of notifications on cgroup v1.
+ */
+#ifndef EVENTS_H
+#define EVENTS_H
+
+#include <sys/types.h>
+
+#define EVENTS_PSI_STALL        100000      /* us of stall ... */
+#define EVENTS_PSI_WINDOW       1000000     /* ... per window, [0.5s-10s] */
+#define EVENTS_MAX_EVENTS       16
+
+struct cgroup_args;
+
+enum cgroup_event_type {
+	EVENT_MEMORY_PRESSURE,
+	EVENT_CPU_PRESSURE,
+	EVENT_MEMORY_HIGH,
+	EVENT_MEMORY_MAX,
+	EVENT_OOM,
+	EVENT_OOM_KILL,
+	N_EVENT_TYPES
+};
+
+/* report the events of every container started afterwards to target,
+ * exits if target cannot be opened */
+void events_open(const char *target);
+
+/* Register the notifications of the container pid in the cgroup slot of
+ * cgroup_arguments. A no-op if events_open() was not called. */
+void events_watch(struct cgroup_args *cgroup_arguments, pid_t pid);
+
+/* report what is pending and drop the notifications of the container */
+void events_unwatch(struct cgroup_args *cgroup_arguments);
+
+#endif //EVENTS_H
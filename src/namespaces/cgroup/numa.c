@@ -0,0 +1,242 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include "numa.h"
+#include "../../helpers/helpers.h"
+#include "../../../config.h"
+
+#define NODE_PATH       "/sys/devices/system/node/node%d/%s"
+#define NODE_LOCK_PATH  RUN_DIR "/numa-%d-%d.lock"
+
+/* a node of the host, read once */
+struct numa_node {
+    char cpus[NUMA_LIST_SIZE];      /* its cpulist */
+    int n_cpus;                     /* 0 if the node has no cpu */
+};
+
+static struct numa_node nodes[NUMA_MAX_NODES];
+static int n_nodes = 0;             /* highest node + 1 */
+
+static pthread_once_t numa_once = PTHREAD_ONCE_INIT;
+
+int cpulist_parse(const char *list, cpu_set_t *set)
+{
+    const char *p = list;
+    long first, last;
+    char *end;
+    int count = 0;
+
+    CPU_ZERO(set);
+
+    for (;;) {
+        first = last = strtol(p, &end, 10);
+        if (end == p || first < 0)
+            return -1;
+
+        if (*end == '-') {
+            p = end + 1;
+            last = strtol(p, &end, 10);
+            if (end == p || last < first)
+                return -1;
+        }
+
+        if (last >= CPU_SETSIZE)
+            return -1;
+
+        for (; first <= last; ++first, ++count)
+            CPU_SET(first, set);
+
+        if (*end == '\0' || *end == '\n')
+            return count;
+        if (*end != ',')
+            return -1;
+        p = end + 1;
+    }
+}
+
+int numa_read_list(const char *path, char *list, size_t size)
+{
+    ssize_t n;
+    char ch;
+    int fd;
+
+    if ((fd = open(path, O_RDONLY | O_CLOEXEC)) == -1)
+        return -1;
+
+    n = read(fd, list, size - 1);
+
+    /* a full buffer is only the whole list if the newline comes next */
+    if (n == size - 1 && !memchr(list, '\n', n)
+            && read(fd, &ch, 1) == 1 && ch != '\n') {
+        close(fd);
+        errno = EOVERFLOW;
+        return -1;
+    }
+    close(fd);
+
+    if (n <= 0)
+        return -1;
+
+    list[n] = '\0';
+    list[strcspn(list, "\n")] = '\0';
+    return 0;
+}
+
+static void read_topology()
+{
+    char list[NUMA_LIST_SIZE], path[128];
+    cpu_set_t online, cpus;
+    int node;
+
+    if (numa_read_list(NODE_ONLINE_PATH, list, sizeof(list)) == -1
+            || cpulist_parse(list, &online) == -1)
+        return;
+
+    for (node = 0; node < NUMA_MAX_NODES; ++node) {
+        if (!CPU_ISSET(node, &online))
+            continue;
+
+        snprintf(path, sizeof(path), NODE_PATH, node, "cpulist");
+
+        /* a memory only node has an empty cpulist */
+        if (numa_read_list(path, nodes[node].cpus, NUMA_LIST_SIZE) == -1
+                || cpulist_parse(nodes[node].cpus, &cpus) == -1)
+            continue;
+
+        nodes[node].n_cpus = CPU_COUNT(&cpus);
+        n_nodes = node + 1;
+    }
+}
+
+/* MemFree of the node in kB, 0 if unknown */
+static unsigned long long node_mem_free(int node)
+{
+    char buf[2048], path[128], *free_kb;
+    ssize_t n;
+    int fd;
+
+    snprintf(path, sizeof(path), NODE_PATH, node, "meminfo");
+
+    if ((fd = open(path, O_RDONLY | O_CLOEXEC)) == -1)
+        return 0;
+
+    n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+
+    if (n <= 0)
+        return 0;
+    buf[n] = '\0';
+
+    if (!(free_kb = strstr(buf, "MemFree:")))
+        return 0;
+
+    return strtoull(free_kb + strlen("MemFree:"), NULL, 10);
+}
+
+/* The containers placed on node by every run: the lock files of the node
+ * are created in order, the first free one is taken, so they are counted
+ * up to the first missing one. */
+static int node_load(int node)
+{
+    char path[128];
+    int n, fd, load = 0;
+
+    for (n = 0; n < NUMA_MAX_PLACED; ++n) {
+        snprintf(path, sizeof(path), NODE_LOCK_PATH, node, n);
+
+        if ((fd = open(path, O_RDONLY | O_CLOEXEC)) == -1)
+            break;
+
+        if (flock(fd, LOCK_SH | LOCK_NB) == -1)
+            ++load;
+        close(fd);
+    }
+
+    return load;
+}
+
+/* count a new container on node, the lock file it holds or -1 */
+static int node_take(int node)
+{
+    char path[128];
+    int n, fd;
+
+    for (n = 0; n < NUMA_MAX_PLACED; ++n) {
+        snprintf(path, sizeof(path), NODE_LOCK_PATH, node, n);
+
+        if ((fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600)) == -1)
+            return -1;
+
+        if (flock(fd, LOCK_EX | LOCK_NB) == 0)
+            return fd;
+        close(fd);
+    }
+
+    return -1;
+}
+
+int numa_place(char *cpus, size_t size, int *lock_fd)
+{
+    unsigned long long mem_free, best_free = 0;
+    int load[NUMA_MAX_NODES];
+    int node, best = -1, fd;
+
+    *lock_fd = -1;
+
+    pthread_once(&numa_once, read_topology);
+
+    if (!n_nodes)
+        return -1;
+
+    /* the runs of the host, and the batch workers of each, count and
+     * take the nodes one at a time */
+    if (mkdir(RUN_DIR, S_IRUSR | S_IWUSR | S_IXUSR) && errno != EEXIST) {
+        printErr("mkdir at numa_place");
+    }
+
+    if ((fd = open(RUN_DIR "/numa.lock", O_RDWR | O_CREAT | O_CLOEXEC, 0600))
+            == -1 || flock(fd, LOCK_EX) == -1) {
+        printErr("locking the NUMA nodes");
+    }
+
+    for (node = 0; node < n_nodes; ++node) {
+        if (!nodes[node].n_cpus)
+            continue;
+
+        mem_free = node_mem_free(node);
+        load[node] = node_load(node);
+
+        /* fewer containers per cpu, then more free memory */
+        if (best == -1
+                || load[node] * nodes[best].n_cpus
+                    < load[best] * nodes[node].n_cpus
+                || (load[node] * nodes[best].n_cpus
+                    == load[best] * nodes[node].n_cpus
+                    && mem_free > best_free)) {
+            best = node;
+            best_free = mem_free;
+        }
+    }
+
+    if (best != -1) {
+        *lock_fd = node_take(best);
+        snprintf(cpus, size, "%s", nodes[best].cpus);
+    }
+
+    close(fd);
+
+    return best;
+}
+
+void numa_release(int lock_fd)
+{
+    if (lock_fd != -1)
+        close(lock_fd);
+}
@@ -0,0 +1,50 @@
+/**
+ * NUMA placement.
+ *
+ * A container can be pinned to a cpu list and to memory nodes, written to
+ * cpuset.cpus and cpuset.mems of its cgroup slot, or placed automatically
+ * on a node of the host. The topology is read once from sysfs:
+ *
+ *   /sys/devices/system/node/online            the nodes, "0-1"
+ *   /sys/devices/system/node/node<N>/cpulist   the cpus of a node
+ *   /sys/devices/system/node/node<N>/meminfo   "Node <N> MemFree: <kB>"
+ *
+ * In automatic mode each new container goes to the node running the fewest
+ * placed containers per cpu, the node with the most free memory when there
+ * is a tie, and is bound to its cpus and memory so that its threads never
+ * reach memory across the interconnect. The containers of every run of the
+ * host are counted: a placed container holds the flock() of a file
+ * RUN_DIR/numa-<node>-<n>.lock until it terminates. Containers pinned with
+ * --cpus are only seen through the free memory of the nodes.
+ */
+#ifndef NUMA_H
+#define NUMA_H
+
+#include <sched.h>
+#include <stddef.h>
+
+#define NUMA_MAX_NODES      64
+#define NUMA_LIST_SIZE      256     /* room for a list like "0,2,4,...,94" */
+#define NUMA_MAX_PLACED     64      /* containers counted on a node */
+
+#define CPU_ONLINE_PATH     "/sys/devices/system/cpu/online"
+#define NODE_ONLINE_PATH    "/sys/devices/system/node/online"
+
+/* Parse a cpu or node list, "0-3,8,10-11", into set. Returns the number
+ * of entries or -1 if the list is not valid. */
+int cpulist_parse(const char *list, cpu_set_t *set);
+
+/* Read the list of the sysfs file at path, without the newline; 0 or -1.
+ * A list that does not fit in size is an error, EOVERFLOW. */
+int numa_read_list(const char *path, char *list, size_t size);
+
+/* Choose the node of a new container and count it there: *lock_fd holds
+ * its lock file, or is -1 if the node already counts NUMA_MAX_PLACED
+ * containers. Its cpu list is copied to cpus. Returns the node, or -1 if
+ * the host has no NUMA topology. */
+int numa_place(char *cpus, size_t size, int *lock_fd);
+
+/* the container placed with lock_fd by numa_place() terminated */
+void numa_release(int lock_fd);
+
+#endif //NUMA_H
@@ -0,0 +1,354 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/timerfd.h>
+#include "cgroup.h"
+#include "stats.h"
+#include "../../helpers/helpers.h"
+
+#define STATS_RECORD_SIZE   320     /* room for a line protocol record */
+
+/* the counter files of a container, opened once */
+enum stats_file {
+    FILE_MEMORY,
+    FILE_CPU_STAT,
+    FILE_CPU_USAGE,
+    FILE_PIDS,
+    FILE_IO,
+    N_STATS_FILES
+};
+
+struct stats_file_desc {
+    enum cgrp_control control;
+    const char *v1;                 /* name on cgroup v1 */
+    const char *v2;                 /* name on cgroup v2, NULL if none */
+};
+
+static const struct stats_file_desc stats_files[N_STATS_FILES] = {
+    [FILE_MEMORY]       = { CTRL_MEMORY, "memory.usage_in_bytes", "memory.current" },
+    [FILE_CPU_STAT]     = { CTRL_CPU,    "cpu.stat",              "cpu.stat" },
+    /* usage_usec of cpu.stat on v2 */
+    [FILE_CPU_USAGE]    = { CTRL_CPU,    "cpuacct.usage",         NULL },
+    [FILE_PIDS]         = { CTRL_PIDS,   "pids.current",          "pids.current" },
+    [FILE_IO]           = { CTRL_IO,     "blkio.throttle.io_service_bytes",
+                                                                  "io.stat" },
+};
+
+/* field keys of the line protocol */
+static const char *field_names[N_STATS] = {
+    [STAT_MEMORY]           = "memory",
+    [STAT_CPU_USAGE]        = "cpu_usage_us",
+    [STAT_NR_THROTTLED]     = "nr_throttled",
+    [STAT_CPU_THROTTLED]    = "cpu_throttled_us",
+    [STAT_PIDS]             = "pids",
+    [STAT_IO_RBYTES]        = "io_rbytes",
+    [STAT_IO_WBYTES]        = "io_wbytes",
+};
+
+/* a sampled container, indexed by its cgroup slot */
+struct stats_cgroup {
+    pid_t pid;                      /* 0 if the slot is not watched */
+    int fd[N_STATS_FILES];          /* -1 if the file is not available */
+};
+
+static struct stats_cgroup watched[CGROUP_POOL_SIZE];
+
+/* held while watched and the output are used */
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t stats_once = PTHREAD_ONCE_INIT;
+
+static int stats_fd = -1;
+static int stats_is_socket = 0;
+static enum stats_format stats_format = STATS_LINE;
+static long stats_interval = STATS_INTERVAL;
+
+/* the records of a tick */
+static char out_buf[CGROUP_POOL_SIZE * STATS_RECORD_SIZE];
+
+static void set_field(struct cgroup_sample *sample, enum stats_field field,
+        unsigned long long value)
+{
+    sample->value[field] = value;
+    sample->present |= 1 << field;
+}
+
+/* the whole file as a string, the files are smaller than a page */
+static int read_counters(int fd, char buf[CGROUP_READ_SIZE])
+{
+    ssize_t n;
+
+    if (fd == -1 || (n = pread(fd, buf, CGROUP_READ_SIZE - 1, 0)) == -1)
+        return -1;
+
+    buf[n] = '\0';
+    return 0;
+}
+
+/* throttled_time is in ns on cgroup v1 */
+static void parse_cpu_stat(int fd, struct cgroup_sample *sample)
+{
+    static const char *keys[] = {
+        "usage_usec", "nr_throttled", "throttled_usec", "throttled_time"
+    };
+    unsigned long long values[4];
+    int found;
+
+    if ((found = cgroup_read_keyed(fd, keys, values, 4)) == -1)
+        return;
+
+    if (found & 1 << 0)
+        set_field(sample, STAT_CPU_USAGE, values[0]);
+    if (found & 1 << 1)
+        set_field(sample, STAT_NR_THROTTLED, values[1]);
+    if (found & 1 << 2)
+        set_field(sample, STAT_CPU_THROTTLED, values[2]);
+    if (found & 1 << 3)
+        set_field(sample, STAT_CPU_THROTTLED, values[3] / 1000);
+}
+
+/* v2: "8:0 rbytes=N wbytes=N rios=N ...", a line per device
+ * v1: "8:0 Read N", "8:0 Write N", ... and a "Total N" line */
+static void parse_io_stat(char *buf, struct cgroup_sample *sample)
+{
+    unsigned long long rbytes = 0, wbytes = 0;
+    const char *read_key = "rbytes=", *write_key = "wbytes=";
+    char *token;
+
+    if (!cgroup_is_v2()) {
+        read_key = " Read ";
+        write_key = " Write ";
+    }
+
+    for (token = buf; (token = strstr(token, read_key)); )
+        rbytes += strtoull(token += strlen(read_key), NULL, 10);
+
+    for (token = buf; (token = strstr(token, write_key)); )
+        wbytes += strtoull(token += strlen(write_key), NULL, 10);
+
+    set_field(sample, STAT_IO_RBYTES, rbytes);
+    set_field(sample, STAT_IO_WBYTES, wbytes);
+}
+
+static void sample_cgroup(int slot, struct cgroup_sample *sample)
+{
+    struct stats_cgroup *cgroup = &watched[slot];
+    char buf[CGROUP_READ_SIZE];
+    struct timespec ts;
+
+    memset(sample, 0, sizeof(*sample));
+    clock_gettime(CLOCK_REALTIME, &ts);
+    sample->ts_ns = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    sample->pid = cgroup->pid;
+    sample->slot = slot;
+
+    if (!read_counters(cgroup->fd[FILE_MEMORY], buf))
+        set_field(sample, STAT_MEMORY, strtoull(buf, NULL, 10));
+
+    parse_cpu_stat(cgroup->fd[FILE_CPU_STAT], sample);
+
+    /* cpuacct.usage is in ns */
+    if (!read_counters(cgroup->fd[FILE_CPU_USAGE], buf))
+        set_field(sample, STAT_CPU_USAGE, strtoull(buf, NULL, 10) / 1000);
+
+    if (!read_counters(cgroup->fd[FILE_PIDS], buf))
+        set_field(sample, STAT_PIDS, strtoull(buf, NULL, 10));
+
+    if (!read_counters(cgroup->fd[FILE_IO], buf))
+        parse_io_stat(buf, sample);
+}
+
+/* append the record of a sample to buf, returns its length */
+static size_t format_sample(const struct cgroup_sample *sample, char *buf)
+{
+    size_t len;
+    int i, sep = ' ';
+
+    if (stats_format == STATS_BINARY) {
+        memcpy(buf, sample, sizeof(*sample));
+        return sizeof(*sample);
+    }
+
+    /* a line protocol record needs at least one field */
+    if (!sample->present)
+        return 0;
+
+    len = sprintf(buf, "mydocker,slot=%u,pid=%d", sample->slot, sample->pid);
+
+    for (i = 0; i < N_STATS; ++i) {
+        if (!(sample->present & (1 << i)))
+            continue;
+
+        len += sprintf(buf + len, "%c%s=%llui", sep, field_names[i],
+            (unsigned long long) sample->value[i]);
+        sep = ',';
+    }
+
+    len += sprintf(buf + len, " %llu\n", (unsigned long long) sample->ts_ns);
+
+    return len;
+}
+
+/* A consumer going away must not stop the containers: the stream is
+ * closed and sampling ends. */
+static void stats_write(const char *buf, size_t len)
+{
+    if (stats_fd == -1 || !len)
+        return;
+
+    if (write_output(stats_fd, stats_is_socket, buf, len) == -1) {
+        fprintf(stderr, "=> stats output failed: %s, sampling stopped.\n",
+            strerror(errno));
+        close(stats_fd);
+        stats_fd = -1;
+    }
+}
+
+static void *stats_loop(void *unused)
+{
+    struct cgroup_sample sample;
+    struct itimerspec period;
+    uint64_t expirations;
+    size_t len;
+    int timer_fd, slot;
+
+    if ((timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC)) == -1)
+        printErr("stats timerfd_create");
+
+    period.it_interval.tv_sec = stats_interval / 1000;
+    period.it_interval.tv_nsec = stats_interval % 1000 * 1000000;
+    period.it_value = period.it_interval;
+
+    if (timerfd_settime(timer_fd, 0, &period, NULL) == -1)
+        printErr("stats timerfd_settime");
+
+    for (;;) {
+        if (read(timer_fd, &expirations, sizeof(expirations)) == -1) {
+            if (errno == EINTR)
+                continue;
+            printErr("stats timerfd read");
+        }
+
+        pthread_mutex_lock(&stats_lock);
+
+        if (stats_fd == -1) {
+            pthread_mutex_unlock(&stats_lock);
+            break;
+        }
+
+        for (slot = 0, len = 0; slot < CGROUP_POOL_SIZE; ++slot) {
+            if (!watched[slot].pid)
+                continue;
+
+            sample_cgroup(slot, &sample);
+            len += format_sample(&sample, out_buf + len);
+        }
+
+        stats_write(out_buf, len);
+        pthread_mutex_unlock(&stats_lock);
+    }
+
+    close(timer_fd);
+    return NULL;
+}
+
+static void stats_start()
+{
+    pthread_t thread;
+    int err;
+
+    if ((err = pthread_create(&thread, NULL, stats_loop, NULL))) {
+        errno = err;
+        printErr("pthread_create stats");
+    }
+
+    pthread_detach(thread);
+}
+
+void stats_open(const char *target, enum stats_format format,
+        long interval_ms)
+{
+    if ((stats_fd = open_output(target, &stats_is_socket)) == -1)
+        printErr("open the stats output");
+
+    stats_format = format;
+    stats_interval = interval_ms;
+}
+
+void stats_watch(struct cgroup_args *cgroup_arguments, pid_t pid)
+{
+    struct stats_cgroup *cgroup;
+    const char *name;
+    int i, dir_fd;
+
+    if (stats_fd == -1 || !cgroup_arguments)
+        return;
+
+    pthread_once(&stats_once, stats_start);
+
+    pthread_mutex_lock(&stats_lock);
+    cgroup = &watched[cgroup_arguments->slot];
+
+    for (i = 0; i < N_STATS_FILES; ++i) {
+        name = cgroup_is_v2() ? stats_files[i].v2 : stats_files[i].v1;
+        dir_fd = cgroup_slot_fd(cgroup_arguments, stats_files[i].control);
+
+        /* a missing file only leaves its fields out */
+        cgroup->fd[i] = name && dir_fd != -1
+            ? openat(dir_fd, name, O_RDONLY | O_CLOEXEC) : -1;
+    }
+
+    cgroup->pid = pid;
+    pthread_mutex_unlock(&stats_lock);
+}
+
+void stats_unwatch(struct cgroup_args *cgroup_arguments)
+{
+    struct cgroup_sample sample;
+    struct stats_cgroup *cgroup;
+    size_t len;
+    int i;
+
+    if (!cgroup_arguments || cgroup_arguments->slot == -1)
+        return;
+
+    pthread_mutex_lock(&stats_lock);
+    cgroup = &watched[cgroup_arguments->slot];
+
+    if (cgroup->pid) {
+        sample_cgroup(cgroup_arguments->slot, &sample);
+        len = format_sample(&sample, out_buf);
+        stats_write(out_buf, len);
+
+        for (i = 0; i < N_STATS_FILES; ++i) {
+            if (cgroup->fd[i] != -1)
+                close(cgroup->fd[i]);
+        }
+        cgroup->pid = 0;
+    }
+
+    pthread_mutex_unlock(&stats_lock);
+}
+
+int stats_sample(struct cgroup_args *cgroup_arguments,
+        struct cgroup_sample *sample)
+{
+    int watching;
+
+    if (!cgroup_arguments || cgroup_arguments->slot == -1)
+        return 0;
+
+    pthread_mutex_lock(&stats_lock);
+
+    if ((watching = watched[cgroup_arguments->slot].pid != 0))
+        sample_cgroup(cgroup_arguments->slot, sample);
+
+    pthread_mutex_unlock(&stats_lock);
+
+    return watching;
+}
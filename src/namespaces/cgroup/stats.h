@@ -0,0 +1,82 @@
+/**
+ * Cgroup statistics.
+ *
+ * The usage of the running containers is read back from their cgroup slot
+ * and streamed as a time series:
+ *
+ *   memory     memory.current          (v1 memory.usage_in_bytes)
+ *   cpu        cpu.stat usage_usec, nr_throttled and throttled_usec
+ *              (v1 cpuacct.usage, cpu.stat nr_throttled, throttled_time)
+ *   pids       pids.current
+ *   io         io.stat rbytes and wbytes of every device
+ *              (v1 blkio.throttle.io_service_bytes Read and Write)
+ *
+ * The files are opened once when a container starts and read with pread()
+ * at offset 0, so a sample costs a few reads of the kernel counters and no
+ * path lookup. One thread samples every container of the process on a
+ * timerfd and writes the records of a tick with a single write; a last
+ * sample is taken when a container terminates.
+ *
+ * On cgroup v1 only the hierarchies with a limit hold the container: the
+ * other fields are left out of its samples (see cgroup_sample.present).
+ *
+ * Two formats are available:
+ *   - line: one line protocol record per sample,
+ *       mydocker,slot=3,pid=4242 memory=1048576i,cpu_usage_us=5120i,... <ns>
+ *   - binary: a plain stream of struct cgroup_sample.
+ * The output is a file, created or appended to, or a unix stream socket
+ * given as unix:<path>.
+ */
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#define STATS_INTERVAL      1000    /* default sampling period, ms */
+#define STATS_MIN_INTERVAL  10
+#define STATS_MAX_INTERVAL  3600000
+
+struct cgroup_args;
+
+enum stats_format {
+	STATS_LINE,
+	STATS_BINARY,
+};
+
+enum stats_field {
+	STAT_MEMORY,                    /* bytes */
+	STAT_CPU_USAGE,                 /* us */
+	STAT_NR_THROTTLED,              /* periods */
+	STAT_CPU_THROTTLED,             /* us */
+	STAT_PIDS,
+	STAT_IO_RBYTES,
+	STAT_IO_WBYTES,
+	N_STATS
+};
+
+struct cgroup_sample {
+	uint64_t ts_ns;                 /* CLOCK_REALTIME timestamp */
+	int32_t pid;                    /* container init in the host PID ns */
+	uint16_t slot;                  /* cgroup pool slot */
+	uint16_t present;               /* 1 << enum stats_field read */
+	uint64_t value[N_STATS];
+};
+
+/* Stream the samples of every container started afterwards to target,
+ * every interval_ms milliseconds. Exits if target cannot be opened. */
+void stats_open(const char *target, enum stats_format format,
+	long interval_ms);
+
+/* Sample the container pid in the cgroup slot of cgroup_arguments until
+ * stats_unwatch(). A no-op if stats_open() was not called. */
+void stats_watch(struct cgroup_args *cgroup_arguments, pid_t pid);
+
+/* take the last sample of the container and stop sampling it */
+void stats_unwatch(struct cgroup_args *cgroup_arguments);
+
+/* read one sample of the container, returns 0 if it is not watched */
+int stats_sample(struct cgroup_args *cgroup_arguments,
+	struct cgroup_sample *sample);
+
+#endif //STATS_H
@@ -0,0 +1,346 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/timerfd.h>
+#include "cgroup.h"
+#include "tuner.h"
+#include "../../helpers/helpers.h"
+#include "../../helpers/phases.h"
+
+#define TUNER_RECORD_SIZE   256
+
+/* the files of a tuned container */
+enum tuner_file {
+    FILE_STAT,                      /* cpu.stat */
+    FILE_USAGE,                     /* v1 cpuacct.usage */
+    FILE_PRESSURE,                  /* v2 cpu.pressure */
+    FILE_MAX,                       /* cpu.max, v1 cpu.cfs_quota_us */
+    FILE_WEIGHT,                    /* cpu.weight, v1 cpu.shares */
+    N_TUNER_FILES
+};
+
+struct tuner_file_desc {
+    const char *v1;
+    const char *v2;
+    int flags;
+};
+
+static const struct tuner_file_desc tuner_files[N_TUNER_FILES] = {
+    [FILE_STAT]     = { "cpu.stat",         "cpu.stat",     O_RDONLY },
+    [FILE_USAGE]    = { "cpuacct.usage",    NULL,           O_RDONLY },
+    [FILE_PRESSURE] = { NULL,               "cpu.pressure", O_RDONLY },
+    [FILE_MAX]      = { "cpu.cfs_quota_us", "cpu.max",      O_WRONLY },
+    [FILE_WEIGHT]   = { "cpu.shares",       "cpu.weight",   O_WRONLY },
+};
+
+/* the counters of the last decision */
+struct tuner_counters {
+    unsigned long long ns;
+    unsigned long long periods;
+    unsigned long long throttled;
+    unsigned long long usage_us;    /* ULLONG_MAX if unknown */
+    unsigned long long stall_us;
+};
+
+/* a tuned container, indexed by its cgroup slot */
+struct tuned_cgroup {
+    pid_t pid;                      /* 0 if the slot is not tuned */
+    int fd[N_TUNER_FILES];          /* -1 if not available */
+    long quota;                     /* % of a cpu */
+    long weight;                    /* following the quota */
+    int idle_ticks;                 /* intervals without throttling */
+    struct tuner_counters last;
+};
+
+static struct tuned_cgroup tuned[CGROUP_POOL_SIZE];
+
+/* held while tuned and the log are used */
+static pthread_mutex_t tuner_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t tuner_once = PTHREAD_ONCE_INIT;
+
+static int tuner_enabled = 0;
+static long min_quota, max_quota;
+static int log_fd = STDERR_FILENO;
+static int log_is_socket = 0;
+
+#define UNKNOWN_USAGE   (~0ULL)
+
+static void read_counters(struct tuned_cgroup *cgroup,
+        struct tuner_counters *counters)
+{
+    static const char *keys[] = { "nr_periods", "nr_throttled", "usage_usec" };
+    unsigned long long values[3] = { 0 };
+    char buf[32];
+    ssize_t n;
+    int found;
+
+    counters->ns = monotonic_ns();
+    found = cgroup_read_keyed(cgroup->fd[FILE_STAT], keys, values, 3);
+
+    counters->periods = values[0];
+    counters->throttled = values[1];
+    counters->usage_us = found != -1 && found & 1 << 2
+        ? values[2] : UNKNOWN_USAGE;
+
+    /* cpuacct.usage is in ns */
+    if (cgroup->fd[FILE_USAGE] != -1
+            && (n = pread(cgroup->fd[FILE_USAGE], buf, sizeof(buf) - 1, 0)) > 0) {
+        buf[n] = '\0';
+        counters->usage_us = strtoull(buf, NULL, 10) / 1000;
+    }
+
+    counters->stall_us = cgroup->fd[FILE_PRESSURE] != -1
+        ? cgroup_read_pressure(cgroup->fd[FILE_PRESSURE]) : 0;
+}
+
+/* write the quota and the weight following it */
+static int write_quota(struct tuned_cgroup *cgroup, long quota)
+{
+    char value[32];
+    long weight;
+    int len;
+
+    if (cgroup_is_v2())
+        len = snprintf(value, sizeof(value), "%ld %d",
+            quota * TUNER_PERIOD / 100, TUNER_PERIOD);
+    else
+        len = snprintf(value, sizeof(value), "%ld", quota * TUNER_PERIOD / 100);
+
+    if (write(cgroup->fd[FILE_MAX], value, len) == -1)
+        return -1;
+
+    /* cpu.weight [1-10000], cpu.shares [2-262144] */
+    if (cgroup_is_v2())
+        weight = quota < 1 ? 1 : quota > 10000 ? 10000 : quota;
+    else
+        weight = quota * 1024 / 100 < 2 ? 2 : quota * 1024 / 100;
+
+    len = snprintf(value, sizeof(value), "%ld", weight);
+
+    if (cgroup->fd[FILE_WEIGHT] != -1)
+        write(cgroup->fd[FILE_WEIGHT], value, len);
+
+    cgroup->quota = quota;
+    cgroup->weight = weight;
+    return 0;
+}
+
+static void tuner_log(int slot, const char *action, double throttled,
+        double stall, double usage)
+{
+    char record[TUNER_RECORD_SIZE];
+    struct timespec ts;
+    int len;
+
+    if (log_fd == -1)
+        return;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    len = snprintf(record, sizeof(record),
+        "mydocker_cpu_tune,slot=%d,pid=%d,action=%s quota=%ldi,weight=%ldi,"
+        "throttled=%.3f,stall=%.3f,usage=%.1f %llu\n", slot, tuned[slot].pid,
+        action, tuned[slot].quota, tuned[slot].weight, throttled, stall, usage,
+        ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+
+    /* the containers keep their last quota without a consumer */
+    if (write_output(log_fd, log_is_socket, record, len) == -1) {
+        fprintf(stderr, "=> cpu tuner log failed: %s, logging stopped.\n",
+            strerror(errno));
+        if (log_fd != STDERR_FILENO)
+            close(log_fd);
+        log_fd = -1;
+    }
+}
+
+static void tune(int slot)
+{
+    struct tuned_cgroup *cgroup = &tuned[slot];
+    struct tuner_counters now;
+    double throttled = 0, stall = 0, usage = -1, elapsed_us;
+    unsigned long long periods;
+    const char *action = NULL;
+    long quota = cgroup->quota;
+
+    read_counters(cgroup, &now);
+    elapsed_us = (now.ns - cgroup->last.ns) / 1000.0;
+
+    if (elapsed_us <= 0)
+        return;
+
+    if ((periods = now.periods - cgroup->last.periods))
+        throttled = (double) (now.throttled - cgroup->last.throttled) / periods;
+
+    stall = (now.stall_us - cgroup->last.stall_us) / elapsed_us;
+
+    if (now.usage_us != UNKNOWN_USAGE && cgroup->last.usage_us != UNKNOWN_USAGE)
+        usage = (now.usage_us - cgroup->last.usage_us) * 100 / elapsed_us;
+
+    cgroup->last = now;
+
+    if (throttled > TUNER_THROTTLED_HIGH || stall > TUNER_STALL_HIGH) {
+        cgroup->idle_ticks = 0;
+
+        /* at least a step of 1% for the small quotas */
+        quota = quota + (quota / 4 ? quota / 4 : 1);
+        if (quota > max_quota)
+            quota = max_quota;
+        action = "grow";
+    } else if (throttled == 0) {
+        ++cgroup->idle_ticks;
+
+        if (usage >= 0 ? usage < quota / 2.0
+                       : cgroup->idle_ticks >= TUNER_IDLE_TICKS) {
+            cgroup->idle_ticks = 0;
+
+            quota = quota - quota / 10;
+            if (quota < min_quota)
+                quota = min_quota;
+            action = "shrink";
+        }
+    }
+
+    if (!action || quota == cgroup->quota)
+        return;
+
+    if (write_quota(cgroup, quota) == -1) {
+        fprintf(stderr, "=> cannot tune the cpu of slot %d: %s\n", slot,
+            strerror(errno));
+        return;
+    }
+
+    tuner_log(slot, action, throttled, stall, usage);
+}
+
+static void *tuner_loop(void *unused)
+{
+    struct itimerspec period;
+    uint64_t expirations;
+    int timer_fd, slot;
+
+    if ((timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC)) == -1)
+        printErr("tuner timerfd_create");
+
+    period.it_interval.tv_sec = TUNER_INTERVAL / 1000;
+    period.it_interval.tv_nsec = TUNER_INTERVAL % 1000 * 1000000;
+    period.it_value = period.it_interval;
+
+    if (timerfd_settime(timer_fd, 0, &period, NULL) == -1)
+        printErr("tuner timerfd_settime");
+
+    for (;;) {
+        if (read(timer_fd, &expirations, sizeof(expirations)) == -1) {
+            if (errno == EINTR)
+                continue;
+            printErr("tuner timerfd read");
+        }
+
+        pthread_mutex_lock(&tuner_lock);
+
+        for (slot = 0; slot < CGROUP_POOL_SIZE; ++slot) {
+            if (tuned[slot].pid)
+                tune(slot);
+        }
+
+        pthread_mutex_unlock(&tuner_lock);
+    }
+
+    return NULL;
+}
+
+static void tuner_start()
+{
+    pthread_t thread;
+    int err;
+
+    if ((err = pthread_create(&thread, NULL, tuner_loop, NULL))) {
+        errno = err;
+        printErr("pthread_create tuner");
+    }
+
+    pthread_detach(thread);
+}
+
+void tuner_open(long min, long max, const char *log_target)
+{
+    if (log_target && (log_fd = open_output(log_target, &log_is_socket)) == -1)
+        printErr("open the cpu tuner log");
+
+    min_quota = min;
+    max_quota = max;
+    tuner_enabled = 1;
+}
+
+void tuner_watch(struct cgroup_args *cgroup_arguments, pid_t pid)
+{
+    struct tuned_cgroup *cgroup;
+    const char *name;
+    int i, dir_fd;
+
+    if (!tuner_enabled || !cgroup_arguments)
+        return;
+
+    if ((dir_fd = cgroup_slot_fd(cgroup_arguments, CTRL_CPU)) == -1)
+        return;
+
+    pthread_once(&tuner_once, tuner_start);
+
+    pthread_mutex_lock(&tuner_lock);
+    cgroup = &tuned[cgroup_arguments->slot];
+
+    for (i = 0; i < N_TUNER_FILES; ++i) {
+        name = cgroup_is_v2() ? tuner_files[i].v2 : tuner_files[i].v1;
+        cgroup->fd[i] = name
+            ? openat(dir_fd, name, tuner_files[i].flags | O_CLOEXEC) : -1;
+    }
+
+    if (cgroup->fd[FILE_STAT] == -1 || cgroup->fd[FILE_MAX] == -1) {
+        fprintf(stderr, "=> the cpu of slot %d cannot be tuned: %s\n",
+            cgroup_arguments->slot, strerror(errno));
+
+        for (i = 0; i < N_TUNER_FILES; ++i) {
+            if (cgroup->fd[i] != -1)
+                close(cgroup->fd[i]);
+        }
+        pthread_mutex_unlock(&tuner_lock);
+        return;
+    }
+
+    /* cpu.max was set to the upper bound with the other limits */
+    cgroup->quota = max_quota;
+    cgroup->idle_ticks = 0;
+    read_counters(cgroup, &cgroup->last);
+    cgroup->pid = pid;
+
+    pthread_mutex_unlock(&tuner_lock);
+}
+
+void tuner_unwatch(struct cgroup_args *cgroup_arguments)
+{
+    struct tuned_cgroup *cgroup;
+    int i;
+
+    if (!cgroup_arguments || cgroup_arguments->slot == -1)
+        return;
+
+    pthread_mutex_lock(&tuner_lock);
+    cgroup = &tuned[cgroup_arguments->slot];
+
+    /* cpu.max and the weight, tuned even if the container did not set
+     * one, are reset with the other limits by free_cgroup_resources() */
+    if (cgroup->pid) {
+        for (i = 0; i < N_TUNER_FILES; ++i) {
+            if (cgroup->fd[i] != -1)
+                close(cgroup->fd[i]);
+        }
+        cgroup->pid = 0;
+    }
+
+    pthread_mutex_unlock(&tuner_lock);
+}
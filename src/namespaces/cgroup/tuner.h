@@ -0,0 +1,65 @@
+/**
+ * Cpu tuner.
+ *
+ * Instead of a static share decided at start, the cpu bandwidth of each
+ * container follows what it actually needs, within the bounds given by
+ * the user. Every TUNER_INTERVAL ms a thread of the parent compares, for
+ * every running container, the last interval of:
+ *
+ *   cpu.stat       nr_periods, nr_throttled and the usage (v1 cpuacct.usage)
+ *   cpu.pressure   the "some" stall time (cgroup v2 only)
+ *
+ * and moves its quota:
+ *
+ *   - grow by 25% when more than TUNER_THROTTLED_HIGH of the periods were
+ *     throttled, or the tasks stalled waiting for a cpu more than
+ *     TUNER_STALL_HIGH of the time;
+ *   - shrink by 10% when nothing was throttled and the container used
+ *     less than half of its quota (without a usage counter, when it was
+ *     not throttled for TUNER_IDLE_TICKS intervals);
+ *   - keep it otherwise.
+ *
+ * The quota is a percentage of one cpu written to cpu.max (v1
+ * cpu.cfs_quota_us) over a TUNER_PERIOD period. The weight follows it: a
+ * container allowed one cpu gets the default cpu.weight of 100 (v1
+ * cpu.shares 1024). A container starts at the upper bound, its cpu.max is
+ * lifted when it terminates.
+ *
+ * Each change is logged as a line protocol record, to stderr or to a file
+ * or unix stream socket given as unix:<path>:
+ *
+ *   mydocker_cpu_tune,slot=0,pid=4242,action=grow quota=125i,weight=125i,
+ *       throttled=0.310,stall=0.000,usage=99.2 1792259633871157165
+ *
+ * usage and quota are in percent of one cpu, throttled and stall are the
+ * shares of the last interval; usage is -1 when it cannot be measured.
+ */
+#ifndef TUNER_H
+#define TUNER_H
+
+#include <sys/types.h>
+
+#define TUNER_INTERVAL          1000    /* ms between two decisions */
+#define TUNER_PERIOD            100000  /* cpu.max period, us */
+#define TUNER_MIN_QUOTA         1       /* bounds of the bounds, % of a cpu */
+#define TUNER_MAX_QUOTA         (100 * 1024)
+#define TUNER_THROTTLED_HIGH    0.05
+#define TUNER_STALL_HIGH        0.05
+#define TUNER_IDLE_TICKS        3
+
+struct cgroup_args;
+
+/* Tune the containers started afterwards between min_quota and max_quota
+ * percent of a cpu. Decisions go to log_target, or stderr if NULL. The
+ * cgroup_args of the containers must start at max_quota (see
+ * limit_cpu_max()). */
+void tuner_open(long min_quota, long max_quota, const char *log_target);
+
+/* start tuning the container pid, a no-op if tuner_open() was not called */
+void tuner_watch(struct cgroup_args *cgroup_arguments, pid_t pid);
+
+/* stop tuning the container, its cpu.max and weight are reset when its
+ * cgroup slot is released */
+void tuner_unwatch(struct cgroup_args *cgroup_arguments);
+
+#endif //TUNER_H
@@ -111,13 +111,13 @@ pivot_root(const char *new_root, const char *put_old)
  * really any guarantee from the kernel what /proc/self/cwd will be after a
  * pivot_root(2).
  */
-void perform_pivot_root(int has_userns)
+void perform_pivot_root(int has_userns, const char *rootfs)
 {
 	int oldroot = open("/", O_DIRECTORY | O_RDONLY,0);
 	if(oldroot == -1)
 		printErr("open oldroot");
 
-	int newroot = open(FILE_SYSTEM_PATH, O_DIRECTORY | O_RDONLY, 0);
+	int newroot = open(rootfs, O_DIRECTORY | O_RDONLY, 0);
 	if(newroot == -1)
 		printErr("open newroot");
 
@@ -155,17 +155,17 @@ void perform_pivot_root(int has_userns)
 	chdir("/");
 }
 
-void prepare_rootfs(int has_userns)
+void prepare_rootfs(int has_userns, const char *rootfs)
 {
 	int i;
-	char *base_path;
+	char base_path[PATH_MAX];
 	char *target_fs;
-	FILE *fp;	 
+	int fd;
 	char *target_dev_path;
 
-	base_path = get_rootfs();
-    if (base_path == NULL) {
-		fprintf(stderr,"=> cannot retrieve root_fs path.\n");
+	if (snprintf(base_path, sizeof(base_path), "%s", rootfs)
+			>= sizeof(base_path)) {
+		fprintf(stderr,"=> root_fs path too long.\n");
 		exit(EXIT_FAILURE);
 	}
 
@@ -236,9 +236,9 @@ void prepare_rootfs(int has_userns)
 				exit(EXIT_FAILURE);
 			}
 
-			fp = fopen(target_dev_path, "a");
+			fd = open(target_dev_path, O_WRONLY | O_CREAT | O_CLOEXEC, 0666);
 
-			if (fp == NULL) {
+			if (fd == -1) {
 				fprintf(stderr, "=> %s device creation failed\n",
 					default_devs[i].path);
 				exit(EXIT_FAILURE);
@@ -248,22 +248,26 @@ void prepare_rootfs(int has_userns)
 				fprintf(stderr,"=>%s mount failed\n", default_devs[i].path);
 				exit(EXIT_FAILURE);
 			}
-			fclose(fp);
+			close(fd);
 			target_dev_path[strlen(target_dev_path)-strlen(default_devs[i].path)]
 				= '\0';
 		}
 	}
 
 	/* We assume that both stderr, stdin and stdout are linked to the same pty */
-	char *current_pts = ttyname(0);
+	char current_pts[PATH_MAX];
+	if (ttyname_r(0, current_pts, sizeof(current_pts)) != 0) {
+		fprintf(stderr, "=> ttyname_r() failed.\n");
+		exit(EXIT_FAILURE);
+	}
 	if (strcat(target_dev_path, default_devs[i].path) == NULL) {
 		fprintf(stderr, "=> strcat() failed.\n");
 		exit(EXIT_FAILURE);
 	}
 	/* create target */
-	fp = fopen(target_dev_path, "a");
+	fd = open(target_dev_path, O_WRONLY | O_CREAT | O_CLOEXEC, 0666);
 
-	if (fp == NULL) {
+	if (fd == -1) {
 		fprintf(stderr, "=> console creation failed\n");
 		exit(EXIT_FAILURE);
 	}
@@ -273,7 +277,62 @@ void prepare_rootfs(int has_userns)
 		exit(EXIT_FAILURE);
 	}
 
-	fclose(fp);
+	close(fd);
+}
+
+void prepare_rootfs_scratch()
+{
+	if (mkdir(RUN_DIR, 0755) && errno != EEXIST)
+		printErr("mkdir " RUN_DIR);
+
+	if (mkdir(ROOTFS_SCRATCH_PATH, 0755) && errno != EEXIST)
+		printErr("mkdir " ROOTFS_SCRATCH_PATH);
+}
+
+const char *mount_rootfs(const char *lower)
+{
+	static char rootfs[PATH_MAX];
+	char options[3 * PATH_MAX];
+
+	/* the writable layer lives and dies with this mount namespace */
+	if (mount("tmpfs", ROOTFS_SCRATCH_PATH, "tmpfs", MS_NOSUID | MS_NODEV,
+			"mode=755,size=" ROOTFS_SCRATCH_SIZE) == -1)
+		printErr("mount scratch tmpfs");
+
+	if (mkdir(ROOTFS_SCRATCH_PATH "/upper", 0755) == -1 ||
+			mkdir(ROOTFS_SCRATCH_PATH "/work", 0755) == -1 ||
+			mkdir(ROOTFS_SCRATCH_PATH "/rootfs", 0755) == -1)
+		printErr("mkdir scratch layout");
+
+	snprintf(options, sizeof(options),
+		"lowerdir=%s,upperdir=" ROOTFS_SCRATCH_PATH "/upper,"
+		"workdir=" ROOTFS_SCRATCH_PATH "/work", lower);
+
+	if (mount("overlay", ROOTFS_SCRATCH_PATH "/rootfs", "overlay", 0,
+			options) == 0) {
+		strcpy(rootfs, ROOTFS_SCRATCH_PATH "/rootfs");
+		return rootfs;
+	}
+
+	/* a stack of layers cannot be bind mounted */
+	if (strchr(lower, ':'))
+		printErr("mount overlay");
+
+	fprintf(stderr, "=> overlay mount failed (%s), sharing %s.\n",
+		strerror(errno), lower);
+
+	/* Ensure that the rootfs is a mount point. 
+	 * By default, when a directory is bind mounted, only that directory is
+	 * mounted; if there are any submounts under the directory tree, they
+	 * are not bind mounted.  If the MS_REC flag is also specified, then a
+	 * recursive bind mount operation is performed: all submounts under the
+	 * source subtree (other than unbindable mounts) are also bind mounted
+	 * at the corresponding location in the target subtree.*/
+	if (mount(lower, lower, "bind", MS_BIND | MS_REC, "") == -1)
+		printErr("mount-MS_BIND");
+
+	strcpy(rootfs, lower);
+	return rootfs;
 }
 
 int prepare_dev_fd()
@@ -25,13 +25,39 @@
  * otherwise we'll end up changing the host's '/' which is not the
  * intention! And we want all this to happen before the namespaced shell
  * starts so that the requested root filesystem is ready for when it does.
+ *
+ * -----------------------------------------------------------------------
+ * The root filesystem is shared by every container and it is never
+ * written. Each container mounts an overlayfs using it as the read-only
+ * lower layer, with the upper and work directories on a private tmpfs:
+ *
+ *   ROOTFS_SCRATCH_PATH          tmpfs, only visible to the container
+ *   ├── upper                    files written by the container
+ *   ├── work                     overlayfs private directory
+ *   └── rootfs                   overlay lower=root_fs upper=upper
+ *
+ * The lower layer can also be a stack of layers of the layer store (see
+ * src/image/image.h).
+ *
+ * Mounting it costs the same whatever the size of the image and nothing is
+ * copied. Everything the container writes goes away with its mount
+ * namespace. Where overlayfs is not available (e.g. in a user namespace on
+ * kernels older than 5.11) the root filesystem is bind mounted instead,
+ * as a shared writable directory.
  */
 
- 
 /* mounting the container file system -> ubuntu-fs */
-void perform_pivot_root(int has_userns);
+void perform_pivot_root(int has_userns, const char *rootfs);
+
+void prepare_rootfs(int has_userns, const char *rootfs);
+
+/* create the scratch mount point, called before clone() because an
+ * unprivileged child cannot create it */
+void prepare_rootfs_scratch();
 
-void prepare_rootfs(int has_userns);
+/* mount the root filesystem of the container using lower as the overlay
+ * lowerdir (see image_resolve()), returns the path of the mounted rootfs */
+const char *mount_rootfs(const char *lower);
 
 int prepare_dev_fd();
 
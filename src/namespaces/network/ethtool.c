@@ -0,0 +1,171 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/genetlink.h>
+#include <linux/ethtool_netlink.h>
+
+#include "ethtool.h"
+#include "../../helpers/helpers.h"
+
+#define OFFLOAD_MAX_FEATURES    2
+
+/* the kernel features of an offload */
+static const char *offload_features[N_OFFLOADS][OFFLOAD_MAX_FEATURES] = {
+	[OFFLOAD_GSO] = { "tx-generic-segmentation" },
+	[OFFLOAD_GRO] = { "rx-gro" },
+	[OFFLOAD_TSO] = { "tx-tcp-segmentation", "tx-tcp6-segmentation" },
+};
+
+static int ethtool_family = -1;
+static pthread_once_t family_once = PTHREAD_ONCE_INIT;
+
+static int genl_socket()
+{
+	struct sockaddr_nl sa = { .nl_family = AF_NETLINK };
+	int fd;
+
+	if ((fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_GENERIC))
+			== -1)
+		return -1;
+
+	if (bind(fd, (struct sockaddr *) &sa, sizeof(sa)) == -1) {
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+/* CTRL_CMD_GETFAMILY of ETHTOOL_GENL_NAME, once per process */
+static void resolve_family()
+{
+	struct {
+		struct nlmsghdr n;
+		struct genlmsghdr g;
+		char buf[64];
+	} req;
+	char buf[4096];
+	struct nlmsghdr *ret;
+	struct rtattr *rta;
+	ssize_t len;
+	int attrlen, fd;
+
+	if ((fd = genl_socket()) == -1)
+		return;
+
+	memset(&req, 0, sizeof(req));
+	req.n.nlmsg_len   = NLMSG_LENGTH(GENL_HDRLEN);
+	req.n.nlmsg_type  = GENL_ID_CTRL;
+	req.n.nlmsg_flags = NLM_F_REQUEST;
+	req.g.cmd = CTRL_CMD_GETFAMILY;
+	req.g.version = 1;
+	NLMSG_STRING(&req.n, CTRL_ATTR_FAMILY_NAME, ETHTOOL_GENL_NAME);
+
+	if (send(fd, &req, req.n.nlmsg_len, 0) == -1
+			|| (len = recv(fd, buf, sizeof(buf), 0)) <= 0) {
+		close(fd);
+		return;
+	}
+
+	close(fd);
+
+	/* an error if the family is not registered */
+	ret = (struct nlmsghdr *) buf;
+	if (!NLMSG_OK(ret, len) || ret->nlmsg_type != GENL_ID_CTRL)
+		return;
+
+	rta = (struct rtattr *) ((char *) NLMSG_DATA(ret) + GENL_HDRLEN);
+	attrlen = ret->nlmsg_len - NLMSG_LENGTH(GENL_HDRLEN);
+
+	for (; RTA_OK(rta, attrlen); rta = RTA_NEXT(rta, attrlen)) {
+		if (rta->rta_type == CTRL_ATTR_FAMILY_ID) {
+			ethtool_family = *(__u16 *) RTA_DATA(rta);
+			return;
+		}
+	}
+}
+
+static struct rtattr *nest_begin(struct nlmsghdr *nlmsg, int type)
+{
+	struct rtattr *nest = NLMSG_TAIL(nlmsg);
+
+	NLMSG_ATTR(nlmsg, NLA_F_NESTED | type);
+	return nest;
+}
+
+static void nest_end(struct nlmsghdr *nlmsg, struct rtattr *nest)
+{
+	nest->rta_len = (unsigned char *) NLMSG_TAIL(nlmsg)
+		- (unsigned char *) nest;
+}
+
+/* ethtool -K <ifname> <feature> <on|off>... */
+static void features_set(struct nl_batch *batch, char *ifname,
+	const struct net_spec *spec)
+{
+	struct nlmsghdr *nlmsg;
+	struct genlmsghdr *genl;
+	struct rtattr *header, *wanted, *bits, *bit;
+	__u32 flags = ETHTOOL_FLAG_OMIT_REPLY;
+	const char *feature;
+	int i, j;
+
+	nlmsg = _nlbatch_add(batch, ethtool_family, 0, GENL_HDRLEN);
+	genl = (struct genlmsghdr *) NLMSG_DATA(nlmsg);
+	genl->cmd = ETHTOOL_MSG_FEATURES_SET;
+	genl->version = ETHTOOL_GENL_VERSION;
+
+	header = nest_begin(nlmsg, ETHTOOL_A_FEATURES_HEADER);
+	NLMSG_STRING(nlmsg, ETHTOOL_A_HEADER_DEV_NAME, ifname);
+	_nlmsg_put(nlmsg, ETHTOOL_A_HEADER_FLAGS, &flags, sizeof(flags));
+	nest_end(nlmsg, header);
+
+	wanted = nest_begin(nlmsg, ETHTOOL_A_FEATURES_WANTED);
+	bits = nest_begin(nlmsg, ETHTOOL_A_BITSET_BITS);
+
+	for (i = 0; i < N_OFFLOADS; ++i) {
+		if (spec->offloads[i] == OFFLOAD_KEEP)
+			continue;
+
+		for (j = 0; j < OFFLOAD_MAX_FEATURES; ++j) {
+			if (!(feature = offload_features[i][j]))
+				break;
+
+			bit = nest_begin(nlmsg, ETHTOOL_A_BITSET_BITS_BIT);
+			NLMSG_STRING(nlmsg, ETHTOOL_A_BITSET_BIT_NAME, (char *) feature);
+			if (spec->offloads[i] == OFFLOAD_ON)
+				NLMSG_ATTR(nlmsg, ETHTOOL_A_BITSET_BIT_VALUE);
+			nest_end(nlmsg, bit);
+		}
+	}
+
+	nest_end(nlmsg, bits);
+	nest_end(nlmsg, wanted);
+}
+
+int ethtool_set_offloads(char **ifnames, int n_ifnames,
+	const struct net_spec *spec)
+{
+	struct nl_batch batch;
+	int i, fd, result;
+
+	pthread_once(&family_once, resolve_family);
+
+	if (ethtool_family == -1 || (fd = genl_socket()) == -1)
+		return -1;
+
+	_nlbatch_init(&batch);
+	for (i = 0; i < n_ifnames; ++i)
+		features_set(&batch, ifnames[i], spec);
+
+	result = _nlbatch_commit(fd, &batch) ? -1 : 0;
+	close(fd);
+
+	return result;
+}
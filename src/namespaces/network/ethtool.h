@@ -0,0 +1,26 @@
+/**
+ * Offloads through ethtool netlink.
+ *
+ * The features of a device are switched with ETHTOOL_MSG_FEATURES_SET of
+ * the "ethtool" generic netlink family, whose id is resolved once. The
+ * wanted features are sent by name, without a mask: only the listed ones
+ * change, the kernel keeps the others and the features they depend on.
+ *
+ *   gso    tx-generic-segmentation
+ *   gro    rx-gro
+ *   tso    tx-tcp-segmentation, tx-tcp6-segmentation
+ *
+ * The requests of every device go in a single batch.
+ */
+#ifndef ETHTOOL_H
+#define ETHTOOL_H
+
+#include "netspec.h"
+
+/* Switch the offloads of spec on the n_ifnames devices of the current
+ * network namespace. Returns 0, or -1 if the kernel has no ethtool
+ * netlink or refused a feature. */
+int ethtool_set_offloads(char **ifnames, int n_ifnames,
+	const struct net_spec *spec);
+
+#endif //ETHTOOL_H
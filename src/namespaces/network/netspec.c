@@ -0,0 +1,234 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <arpa/inet.h>
+#include <linux/if_ether.h>
+
+#include "netspec.h"
+#include "../../helpers/helpers.h"
+
+static const char *offload_names[N_OFFLOADS] = {
+	[OFFLOAD_GSO] = "gso",
+	[OFFLOAD_GRO] = "gro",
+	[OFFLOAD_TSO] = "tso",
+};
+
+static const char *mode_names[N_NET_MODES] = {
+	[NET_MODE_BRIDGE]    = "bridge",
+	[NET_MODE_MACVLAN]   = "macvlan",
+	[NET_MODE_IPVLAN_L2] = "ipvlan-l2",
+	[NET_MODE_IPVLAN_L3] = "ipvlan-l3",
+};
+
+const char *net_offload_name(enum net_offload offload)
+{
+	return offload_names[offload];
+}
+
+int net_mode_parse(const char *name)
+{
+	for (int mode = 0; mode < N_NET_MODES; ++mode) {
+		if (!strcmp(name, mode_names[mode]))
+			return mode;
+	}
+
+	return -1;
+}
+
+const char *net_mode_name(enum net_mode mode)
+{
+	return mode_names[mode];
+}
+
+static void spec_error(const char *path, int line, const char *msg)
+{
+	fprintf(stderr, "=> %s:%d: %s\n", path, line, msg);
+	exit(EXIT_FAILURE);
+}
+
+/* an address of either family, its family or -1 */
+static int parse_addr(const char *token, unsigned char *addr)
+{
+	if (inet_pton(AF_INET6, token, addr) == 1)
+		return AF_INET6;
+	if (inet_pton(AF_INET, token, addr) == 1)
+		return AF_INET;
+
+	return -1;
+}
+
+/* "<addr>/<len>", its family or -1 */
+static int parse_prefix(const char *token, unsigned char *addr, int *len)
+{
+	char buf[INET6_ADDRSTRLEN];
+	int family, max_len;
+	char *slash, *end;
+
+	if (!(slash = strchr(token, '/')) || slash - token >= INET6_ADDRSTRLEN)
+		return -1;
+
+	memcpy(buf, token, slash - token);
+	buf[slash - token] = '\0';
+
+	if ((family = parse_addr(buf, addr)) == -1)
+		return -1;
+
+	max_len = family == AF_INET6 ? 128 : 32;
+	*len = strtol(slash + 1, &end, 10);
+	if (end == slash + 1 || *end != '\0' || *len < 0 || *len > max_len)
+		return -1;
+
+	return family;
+}
+
+/* clear the host bits of a prefix */
+static void mask_prefix(unsigned char *addr, int family, int len)
+{
+	int size = family == AF_INET6 ? 16 : 4;
+
+	for (int i = 0; i < size; ++i, len -= 8) {
+		if (len <= 0)
+			addr[i] = 0;
+		else if (len < 8)
+			addr[i] &= 0xff << (8 - len);
+	}
+}
+
+void net_spec_load(struct net_spec *spec, const char *path)
+{
+	char line[NET_SPEC_MAX_LINE];
+	char *token[5], *saveptr, *end;
+	struct net_route *route;
+	int n_tokens, n_line = 0, i;
+	FILE *file;
+
+	memset(spec, 0, sizeof(*spec));
+
+	if (!(file = fopen(path, "r")))
+		printErr("open network spec");
+
+	while (fgets(line, sizeof(line), file)) {
+		++n_line;
+
+		if (!strchr(line, '\n') && !feof(file))
+			spec_error(path, n_line, "line too long");
+
+		/* comments can also follow a setting */
+		if ((end = strchr(line, '#')))
+			*end = '\0';
+
+		n_tokens = 0;
+		token[0] = strtok_r(line, " \t\r\n", &saveptr);
+		while (token[n_tokens] && n_tokens < 4)
+			token[++n_tokens] = strtok_r(NULL, " \t\r\n", &saveptr);
+
+		if (n_tokens == 0)
+			continue;
+
+		if (n_tokens == 4 && token[4])
+			spec_error(path, n_line, "too many fields");
+
+		if (!strcmp(token[0], "mode")) {
+			if (n_tokens != 2 || (i = net_mode_parse(token[1])) == -1)
+				spec_error(path, n_line,
+					"expected mode <bridge|macvlan|ipvlan-l2|ipvlan-l3>");
+
+			spec->mode = i;
+			continue;
+		}
+
+		if (!strcmp(token[0], "parent")) {
+			if (n_tokens != 2 || strlen(token[1]) >= IFNAMSIZ)
+				spec_error(path, n_line, "expected parent <dev>");
+
+			strcpy(spec->parent, token[1]);
+			continue;
+		}
+
+		if (!strcmp(token[0], "mtu")) {
+			if (n_tokens != 2)
+				spec_error(path, n_line, "expected mtu <bytes>");
+
+			spec->mtu = strtol(token[1], &end, 10);
+			if (*end != '\0' || spec->mtu < ETH_MIN_MTU
+					|| spec->mtu > ETH_MAX_MTU)
+				spec_error(path, n_line, "mtu not in [68-65535]");
+			continue;
+		}
+
+		if (!strcmp(token[0], "offload")) {
+			if (n_tokens != 3 || (strcmp(token[2], "on")
+					&& strcmp(token[2], "off")))
+				spec_error(path, n_line,
+					"expected offload <gso|gro|tso> <on|off>");
+
+			for (i = 0; i < N_OFFLOADS; ++i) {
+				if (!strcmp(token[1], offload_names[i]))
+					break;
+			}
+			if (i == N_OFFLOADS)
+				spec_error(path, n_line, "unknown offload");
+
+			spec->offloads[i] = !strcmp(token[2], "on")
+				? OFFLOAD_ON : OFFLOAD_OFF;
+			continue;
+		}
+
+		if (!strcmp(token[0], "subnet6")) {
+			if (n_tokens != 2 || parse_prefix(token[1],
+					spec->subnet6.s6_addr, &spec->prefix6) != AF_INET6
+					|| spec->prefix6 < NET6_MIN_PREFIX
+					|| spec->prefix6 > NET6_MAX_PREFIX)
+				spec_error(path, n_line, "expected subnet6 <addr6>/[16-112]");
+
+			mask_prefix(spec->subnet6.s6_addr, AF_INET6, spec->prefix6);
+			continue;
+		}
+
+		if (!strcmp(token[0], "route")) {
+			if (n_tokens != 2 && (n_tokens != 4 || strcmp(token[2], "via")))
+				spec_error(path, n_line,
+					"expected route <dst>/<len> [via <addr>]");
+
+			if (spec->n_routes == NET_SPEC_MAX_ROUTES)
+				spec_error(path, n_line, "too many routes");
+
+			route = &spec->routes[spec->n_routes];
+
+			if ((route->family = parse_prefix(token[1], route->dst,
+					&route->dst_len)) == -1)
+				spec_error(path, n_line, "invalid destination");
+
+			mask_prefix(route->dst, route->family, route->dst_len);
+
+			if (n_tokens == 4) {
+				if (parse_addr(token[3], route->via) != route->family)
+					spec_error(path, n_line,
+						"the gateway is not of the family of the destination");
+				route->has_via = 1;
+			}
+
+			++spec->n_routes;
+			continue;
+		}
+
+		spec_error(path, n_line, "unknown setting");
+	}
+
+	if (ferror(file))
+		printErr("read network spec");
+
+	fclose(file);
+
+	/* through the bridge, or the router, of subnet6 */
+	for (i = 0; i < spec->n_routes; ++i) {
+		if (spec->routes[i].family == AF_INET6 && !spec->routes[i].has_via
+				&& !spec->prefix6) {
+			fprintf(stderr, "=> %s: IPv6 routes without a gateway need "
+				"subnet6\n", path);
+			exit(EXIT_FAILURE);
+		}
+	}
+}
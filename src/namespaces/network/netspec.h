@@ -0,0 +1,117 @@
+/**
+ * Network specs.
+ *
+ * A spec describes the interface of the containers, vpeer<n>, beyond the
+ * IPv4 address the pool hands out. It is read from a text file with one
+ * setting per line:
+ *
+ *   # jumbo frames and offloads for the transfer jobs
+ *   mtu      9000
+ *   offload  gso on
+ *   offload  gro on
+ *   offload  tso on
+ *   subnet6  fd00:6d79::/64
+ *   route    10.20.0.0/16
+ *   route    fd00:1::/48 via fd00:6d79::10
+ *
+ * "mtu" is set on both ends of the pair, ETH_DATA_LEN without it. The
+ * bridge follows the smallest MTU of its ports. The macvlan and ipvlan
+ * interfaces keep the MTU of their parent without it.
+ *
+ * "offload <gso|gro|tso> <on|off>" switches a feature of both ends through
+ * ethtool netlink (see ethtool.h), the features not listed are left as
+ * they are. The pairs are reused, so the runs of the host should all use
+ * the same offloads.
+ *
+ * "subnet6" gives every container an IPv6 address next to its IPv4 one:
+ * the bridge holds <subnet6>::1 and the container of address n of the pool
+ * <subnet6>::<n+2>, with a default route through the bridge. The IPv6
+ * traffic is not masqueraded.
+ *
+ * "route <dst>/<len> [via <addr>]" adds a route, through the bridge unless
+ * a gateway of the subnet of the same family is given.
+ *
+ * "mode <bridge|macvlan|ipvlan-l2|ipvlan-l3>" chooses how the containers
+ * reach the network, "parent <dev>" the device of the host the other modes
+ * hang their interface on, NET_PARENT by default:
+ *
+ *   bridge     a veth pair, a port of the bridge, masqueraded (network.h)
+ *   macvlan    a macvlan of parent in bridge mode, with its own MAC
+ *   ipvlan-l2  an ipvlan of parent in L2 mode, sharing the MAC of parent
+ *   ipvlan-l3  an ipvlan of parent in L3 mode, routed by the host
+ *
+ * The sub-interfaces are created right into the network namespace of the
+ * container: its packets leave through the driver of parent without a
+ * second network stack, bridge or conntrack on the way. The subnet is
+ * then a range of the network of parent, whose router is its first
+ * address (ipvlan-l3 needs no gateway, the other hosts need a route to
+ * the subnet through the host instead). Like with the usual macvlan and
+ * ipvlan setups, the containers do not reach the host through parent.
+ *
+ * The whole spec is compiled into the netlink batches that already set up
+ * the pair: it adds requests to them, not round trips.
+ */
+#ifndef NETSPEC_H
+#define NETSPEC_H
+
+#include <net/if.h>
+#include <netinet/in.h>
+
+#define NET_SPEC_MAX_LINE       256
+#define NET_SPEC_MAX_ROUTES     16
+#define NET6_MIN_PREFIX         16
+#define NET6_MAX_PREFIX         112     /* room for NET_MAX_PAIRS hosts */
+#define NET_PARENT              "eth0"  /* of the macvlan and ipvlan modes */
+
+enum net_mode {
+	NET_MODE_BRIDGE,
+	NET_MODE_MACVLAN,
+	NET_MODE_IPVLAN_L2,
+	NET_MODE_IPVLAN_L3,
+	N_NET_MODES
+};
+
+enum net_offload {
+	OFFLOAD_GSO,
+	OFFLOAD_GRO,
+	OFFLOAD_TSO,
+	N_OFFLOADS
+};
+
+enum net_offload_state {
+	OFFLOAD_KEEP,               /* not listed */
+	OFFLOAD_ON,
+	OFFLOAD_OFF,
+};
+
+struct net_route {
+	int family;                 /* AF_INET or AF_INET6 */
+	unsigned char dst[sizeof(struct in6_addr)];
+	int dst_len;
+	int has_via;                /* through the bridge otherwise */
+	unsigned char via[sizeof(struct in6_addr)];
+};
+
+struct net_spec {
+	enum net_mode mode;
+	char parent[IFNAMSIZ];      /* "": NET_PARENT */
+	int mtu;                    /* 0: ETH_DATA_LEN, or that of parent */
+	enum net_offload_state offloads[N_OFFLOADS];
+	struct in6_addr subnet6;
+	int prefix6;                /* 0 without IPv6 */
+	struct net_route routes[NET_SPEC_MAX_ROUTES];
+	int n_routes;
+};
+
+/* load the spec at path, exits on a malformed file */
+void net_spec_load(struct net_spec *spec, const char *path);
+
+/* the name of an offload in the specs, "gso" */
+const char *net_offload_name(enum net_offload offload);
+
+/* the mode called name in the specs, -1 if there is none */
+int net_mode_parse(const char *name);
+
+const char *net_mode_name(enum net_mode mode);
+
+#endif //NETSPEC_H
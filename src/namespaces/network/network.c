@@ -4,47 +4,519 @@
 #include <unistd.h>
 #include <sched.h>
 #include <time.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/file.h>
+#include <sys/stat.h>
 #include <libiptc/libiptc.h>
 #include <linux/netfilter/nf_nat.h>
 #include <linux/netfilter/x_tables.h>
 #include <arpa/inet.h>
+#include <net/route.h>
+#include <linux/if_ether.h>
 
 #include "network.h"
+#include "nftables.h"
+#include "ethtool.h"
 #include "../../helpers/helpers.h"
+#include "../../../config.h"
+
+
+/* the subnet of the pool and its addresses in use, under pool_lock */
+static char net_subnet[INET_ADDRSTRLEN + 4] = NET_SUBNET;
+static in_addr_t net_base;                  /* host order */
+static int net_prefix;
+static int n_blocks;                        /* container addresses */
+static int bridge_index;
+static uint64_t used_blocks[NET_MAX_PAIRS / 64];
+static uint64_t foreign_blocks[NET_MAX_PAIRS / 64];  /* locked by others */
+static struct net_spec net_spec;            /* the interface of the containers */
+static int has_offloads;
+static int parent_index;                    /* of the sub-interface modes */
+static char net_uplink[IFNAMSIZ];           /* the masqueraded interface */
+
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t pool_once = PTHREAD_ONCE_INIT;
+
+/* ip link set <ifname> up */
+static void nl_link_up(struct nl_batch *batch, char *ifname)
+{
+	struct nlmsghdr *nlmsg;
+	struct ifinfomsg *ifmsg;
+
+	nlmsg = _nlbatch_add(batch, RTM_NEWLINK, 0, sizeof(struct ifinfomsg));
+
+	ifmsg = (struct ifinfomsg *) NLMSG_DATA(nlmsg);
+	ifmsg->ifi_family  = AF_UNSPEC;
+	ifmsg->ifi_change |= IFF_UP;
+	ifmsg->ifi_flags  |= IFF_UP;
 
+	/* with no index the kernel looks the link up by name */
+	NLMSG_STRING(nlmsg, IFLA_IFNAME, ifname);
+}
 
-void prepare_netns(int cmd_pid)
+/* ip addr add <addr>/<prefix> broadcast <bcast> dev <ifname> */
+static void nl_addr_add(struct nl_batch *batch, char *ifname, char *addr,
+	int prefix, char *bcast)
 {
- /*
-    char *veth = "veth0";
-    char *vpeer = "veth1";
-    char *veth_addr = "10.1.1.1";
-    char *vpeer_addr = "10.1.1.2";
-    char *netmask = "255.255.255.0";  //10.1.1.0/24
 	int addrlen = sizeof(struct in_addr);
+	struct in_addr local, broadcast;
+	struct nlmsghdr *nlmsg;
+	struct ifaddrmsg *ifa;
+
+	nlmsg = _nlbatch_add(batch, RTM_NEWADDR, NLM_F_CREATE|NLM_F_EXCL,
+			sizeof(struct ifaddrmsg));
+
+	ifa = (struct ifaddrmsg *) NLMSG_DATA(nlmsg);
+	ifa->ifa_prefixlen = prefix;
+	if (!(ifa->ifa_index = if_nametoindex(ifname))) {
+		printErr("failed to get interface index");
+	}
+	ifa->ifa_family = AF_INET;
+	ifa->ifa_scope = 0;
+
+	if (inet_pton(AF_INET, addr, &local) < 0)
+		exit(1);
+	if (inet_pton(AF_INET, bcast, &broadcast) < 0)
+		exit(1);
+
+	_nlmsg_put(nlmsg, IFA_LOCAL,     &local,     addrlen);
+	_nlmsg_put(nlmsg, IFA_ADDRESS,   &local,     addrlen);
+	_nlmsg_put(nlmsg, IFA_BROADCAST, &broadcast, addrlen);
+}
+
+/* ip -6 addr add <addr>/<prefix> dev <ifname> nodad, replaced if present */
+static void nl_addr6_add(struct nl_batch *batch, char *ifname, char *addr,
+	int prefix)
+{
+	struct in6_addr local;
+	struct nlmsghdr *nlmsg;
+	struct ifaddrmsg *ifa;
+	__u32 flags = IFA_F_NODAD;
+
+	nlmsg = _nlbatch_add(batch, RTM_NEWADDR, NLM_F_CREATE|NLM_F_REPLACE,
+			sizeof(struct ifaddrmsg));
+
+	ifa = (struct ifaddrmsg *) NLMSG_DATA(nlmsg);
+	ifa->ifa_prefixlen = prefix;
+	if (!(ifa->ifa_index = if_nametoindex(ifname))) {
+		printErr("failed to get interface index");
+	}
+	ifa->ifa_family = AF_INET6;
+	ifa->ifa_scope = 0;
+
+	if (inet_pton(AF_INET6, addr, &local) != 1)
+		exit(1);
+
+	/* usable at once, the addresses of the subnet are unique */
+	_nlmsg_put(nlmsg, IFA_LOCAL,   &local, sizeof(local));
+	_nlmsg_put(nlmsg, IFA_ADDRESS, &local, sizeof(local));
+	_nlmsg_put(nlmsg, IFA_FLAGS,   &flags, sizeof(flags));
+}
+
+/* ip route add <dst>/<dst_len> via <gateway>, or dev <ifname> without a
+ * gateway, the default route with a dst_len of 0 */
+static void nl_route_add(struct nl_batch *batch, int family, void *dst,
+	int dst_len, void *gateway, char *ifname)
+{
+	int addrlen = family == AF_INET6
+		? sizeof(struct in6_addr) : sizeof(struct in_addr);
+	struct nlmsghdr *nlmsg;
+	struct rtmsg *rtm;
+	int oif;
+
+	nlmsg = _nlbatch_add(batch, RTM_NEWROUTE, NLM_F_CREATE|NLM_F_EXCL,
+			sizeof(struct rtmsg));
+
+	rtm = (struct rtmsg *) NLMSG_DATA(nlmsg);
+
+	rtm->rtm_family   = family;
+	rtm->rtm_table    = RT_TABLE_MAIN;
+	rtm->rtm_scope    = RT_SCOPE_UNIVERSE;
+	rtm->rtm_protocol = RTPROT_BOOT;
+	rtm->rtm_type     = RTN_UNICAST;
+	rtm->rtm_dst_len  = dst_len;
+
+	if (dst_len)
+		_nlmsg_put(nlmsg, RTA_DST, dst, addrlen);
+
+	if (gateway) {
+		_nlmsg_put(nlmsg, RTA_GATEWAY, gateway, addrlen);
+		return;
+	}
+
+	rtm->rtm_scope = RT_SCOPE_LINK;
+	if (!(oif = if_nametoindex(ifname))) {
+		printErr("failed to get interface index");
+	}
+	_nlmsg_put(nlmsg, RTA_OIF, &oif, sizeof(oif));
+}
+
+/* ip link add link <parent> name <ifname> netns <netns_fd> type macvlan
+ * mode bridge, or type ipvlan mode l2|l3: the interface is born in the
+ * namespace of the container */
+static void nl_sublink_add(struct nl_batch *batch, char *ifname, int netns_fd)
+{
+	struct nlmsghdr *nlmsg;
+	struct ifinfomsg *ifmsg;
+	struct rtattr *nest1, *nest2;
+	__u32 macvlan_mode = MACVLAN_MODE_BRIDGE;
+	__u16 ipvlan_mode = net_spec.mode == NET_MODE_IPVLAN_L3
+		? IPVLAN_MODE_L3 : IPVLAN_MODE_L2;
+
+	nlmsg = _nlbatch_add(batch, RTM_NEWLINK, NLM_F_CREATE|NLM_F_EXCL,
+			sizeof(struct ifinfomsg));
+
+	ifmsg = (struct ifinfomsg *) NLMSG_DATA(nlmsg);
+	ifmsg->ifi_family = AF_UNSPEC;
+
+	NLMSG_STRING(nlmsg, IFLA_IFNAME, ifname);
+	_nlmsg_put(nlmsg, IFLA_LINK, &parent_index, sizeof(parent_index));
+	_nlmsg_put(nlmsg, IFLA_NET_NS_FD, &netns_fd, sizeof(netns_fd));
+
+	if (net_spec.mtu)
+		_nlmsg_put(nlmsg, IFLA_MTU, &net_spec.mtu, sizeof(net_spec.mtu));
+
+	nest1 = NLMSG_TAIL(nlmsg);
+	NLMSG_ATTR(nlmsg, IFLA_LINKINFO);
+
+	if (net_spec.mode == NET_MODE_MACVLAN) {
+		NLMSG_STRING(nlmsg, IFLA_INFO_KIND, "macvlan");
+		nest2 = NLMSG_TAIL(nlmsg);
+		NLMSG_ATTR(nlmsg, IFLA_INFO_DATA);
+		_nlmsg_put(nlmsg, IFLA_MACVLAN_MODE, &macvlan_mode,
+			sizeof(macvlan_mode));
+	} else {
+		NLMSG_STRING(nlmsg, IFLA_INFO_KIND, "ipvlan");
+		nest2 = NLMSG_TAIL(nlmsg);
+		NLMSG_ATTR(nlmsg, IFLA_INFO_DATA);
+		_nlmsg_put(nlmsg, IFLA_IPVLAN_MODE, &ipvlan_mode,
+			sizeof(ipvlan_mode));
+	}
+
+	nest2->rta_len = (unsigned char *)NLMSG_TAIL(nlmsg) - (unsigned char *)nest2;
+	nest1->rta_len = (unsigned char *)NLMSG_TAIL(nlmsg) - (unsigned char *)nest1;
+}
+
+/* ip link set <ifname> master <master_index> up */
+static void nl_link_enslave(struct nl_batch *batch, char *ifname,
+	int master_index)
+{
+	struct nlmsghdr *nlmsg;
+
+	nl_link_up(batch, ifname);
+	nlmsg = batch->last;
+
+	_nlmsg_put(nlmsg, IFLA_MASTER, &master_index, sizeof(master_index));
+}
+
+/* The traffic of the subnet leaving the host is masqueraded by a single
+ * rule, the containers reach each other through the bridge without NAT.
+ * The rules are installed with the bridge, once per host: in one nftables
+ * batch, or one libiptc commit per rule on the kernels without nf_tables. */
+/* is the filter table of the legacy iptables (x_tables) loaded? */
+static int legacy_filter_loaded()
+{
+	char name[32];
+	int found = 0;
+	FILE *file;
+
+	if (!(file = fopen("/proc/net/ip_tables_names", "r")))
+		return 0;
+
+	while (!found && fscanf(file, "%31s", name) == 1)
+		found = !strcmp(name, "filter");
+
+	fclose(file);
+	return found;
+}
+
+/* the interface of the IPv4 default route with the lowest metric, or
+ * NET_PARENT on the hosts without one */
+static void find_uplink()
+{
+	char line[256], name[IFNAMSIZ];
+	unsigned int dst, mask, flags, metric, best = ~0U;
+	FILE *file;
+
+	strcpy(net_uplink, NET_PARENT);
+
+	if (!(file = fopen("/proc/net/route", "r")))
+		goto out;
+
+	/* the first line holds the column names */
+	if (!fgets(line, sizeof(line), file)) {
+		fclose(file);
+		goto out;
+	}
+
+	while (fgets(line, sizeof(line), file)) {
+		if (sscanf(line, "%15s %x %*x %x %*d %*d %u %x",
+				name, &dst, &flags, &metric, &mask) != 5)
+			continue;
+
+		if (dst || mask || !(flags & RTF_UP) || metric >= best)
+			continue;
+
+		best = metric;
+		strcpy(net_uplink, name);
+	}
+
+	fclose(file);
+out:
+	if (best == ~0U)
+		fprintf(stderr, "=> no default route, masquerading on %s\n",
+			net_uplink);
+}
+
+/* accept the forwarding between the bridge and the uplink in the FORWARD
+ * chain of the legacy iptables */
+static void ipt_forward()
+{
+	struct _rule *r = malloc(sizeof(struct _rule));
+	memset(r, 0, sizeof(struct _rule));
+	r->table = "filter";
+	r->entry = "FORWARD";
+	r->type  = "ACCEPT";
+	r->oface = net_uplink;
+	r->iface = NET_BRIDGE;
+	_ipt_rule(r);
+
+	r->oface = NET_BRIDGE;
+	r->iface = net_uplink;
+	_ipt_rule(r);
+
+	free(r);
+}
+
+static void prepare_nat()
+{
+	find_uplink();
+
+	if (nft_prepare_nat(net_subnet, NET_BRIDGE, net_uplink) == 0) {
+		/* a drop policy there would still drop the containers */
+		if (legacy_filter_loaded())
+			ipt_forward();
+		return;
+	}
+
+	fprintf(stderr, "=> nftables not available, using iptables\n");
+
+	// nat
+	struct _rule *r = malloc(sizeof(struct _rule));
+	memset(r, 0, sizeof(struct _rule));
+	r->table = "nat";
+	r->entry = "POSTROUTING";
+	r->type  = "MASQUERADE";
+	r->saddr = net_subnet;
+	r->oface = net_uplink;
+	_ipt_rule(r);
+	free(r);
+
+	ipt_forward();
+}
+
+/* The bridge of the host, created by the first run with the gateway
+ * address of the subnet. The lock keeps concurrent first runs from
+ * creating it, and its rules, twice. */
+static void prepare_bridge()
+{
+	struct nl_batch batch;
+	struct nlmsghdr *nlmsg;
+	struct ifinfomsg *ifmsg;
+	struct rtattr *nest;
 	struct in_addr addr;
+	char gateway[INET_ADDRSTRLEN], bcast[INET_ADDRSTRLEN];
+	int lock_fd, fd;
+
+	if (mkdir(RUN_DIR, S_IRUSR | S_IWUSR | S_IXUSR) && errno != EEXIST) {
+		printErr("mkdir at prepare_bridge");
+	}
+
+	lock_fd = open(RUN_DIR "/" NET_BRIDGE ".lock",
+		O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+
+	if (lock_fd == -1 || flock(lock_fd, LOCK_EX) == -1) {
+		printErr("locking the bridge");
+	}
+
+	if ((bridge_index = if_nametoindex(NET_BRIDGE))) {
+		close(lock_fd);
+		return;
+	}
+
+	addr.s_addr = htonl(net_base + 1);
+	inet_ntop(AF_INET, &addr, gateway, sizeof(gateway));
+	addr.s_addr = htonl(net_base | ((1U << (32 - net_prefix)) - 1));
+	inet_ntop(AF_INET, &addr, bcast, sizeof(bcast));
+
+	if ((fd = _nl_socket_init()) == 0)
+		exit(1);
+
+	// ip link add NET_BRIDGE type bridge
+	_nlbatch_init(&batch);
+	nlmsg = _nlbatch_add(&batch, RTM_NEWLINK, NLM_F_CREATE|NLM_F_EXCL,
+			sizeof(struct ifinfomsg));
+
+	ifmsg = (struct ifinfomsg *) NLMSG_DATA(nlmsg);
+	ifmsg->ifi_family = AF_UNSPEC;
+
+	NLMSG_STRING(nlmsg, IFLA_IFNAME, NET_BRIDGE);
+
+	nest = NLMSG_TAIL(nlmsg);
+	NLMSG_ATTR(nlmsg, IFLA_LINKINFO);
+	NLMSG_STRING(nlmsg, IFLA_INFO_KIND, "bridge");
+	nest->rta_len = (unsigned char *)NLMSG_TAIL(nlmsg) - (unsigned char *)nest;
+
+	if (_nlbatch_commit(fd, &batch) != 0) {
+		close(fd);
+		exit(1);
+	}
+
+	// the default gateway of the containers
+	_nlbatch_init(&batch);
+	nl_addr_add(&batch, NET_BRIDGE, gateway, net_prefix, bcast);
+	nl_link_up(&batch, NET_BRIDGE);
+
+	if (_nlbatch_commit(fd, &batch) != 0) {
+		close(fd);
+		exit(1);
+	}
+
+	close(fd);
+
+	if (!(bridge_index = if_nametoindex(NET_BRIDGE))) {
+		printErr("bridge index");
+	}
+
+	prepare_nat();
+	close(lock_fd);
+}
+
+static void parse_subnet(const char *subnet)
+{
+	char addr[INET_ADDRSTRLEN];
+	struct in_addr base;
+	int prefix;
+
+	if (sscanf(subnet, "%15[0-9.]/%d", addr, &prefix) != 2
+			|| inet_pton(AF_INET, addr, &base) != 1
+			|| prefix < NET_MIN_PREFIX || prefix > NET_MAX_PREFIX) {
+		fprintf(stderr, "=> invalid subnet %s, a.b.c.d/[%d-%d]\n", subnet,
+			NET_MIN_PREFIX, NET_MAX_PREFIX);
+		exit(EXIT_FAILURE);
+	}
+
+	net_base = ntohl(base.s_addr) & ~((1U << (32 - prefix)) - 1);
+	net_prefix = prefix;
+
+	/* but the network, the gateway and the broadcast addresses */
+	n_blocks = (1 << (32 - prefix)) - 3;
+	if (n_blocks > NET_MAX_PAIRS)
+		n_blocks = NET_MAX_PAIRS;
+
+	base.s_addr = htonl(net_base);
+	inet_ntop(AF_INET, &base, addr, sizeof(addr));
+	snprintf(net_subnet, sizeof(net_subnet), "%s/%d", addr, prefix);
+}
+
+/* the names and addresses of the container address index */
+static void lease_fill(struct net_lease *lease, int index)
+{
+	/* index < NET_MAX_PAIRS: the names always fit in IFNAMSIZ */
+	unsigned short n = index + 1;
+	struct in6_addr addr6;
+	struct in_addr addr;
+
+	lease->index = index;
+	lease->prefix = net_prefix;
+
+	if (net_spec.mode == NET_MODE_BRIDGE) {
+		snprintf(lease->veth, sizeof(lease->veth), "veth%hu", n);
+		snprintf(lease->vpeer, sizeof(lease->vpeer), "vpeer%hu", n);
+	} else {
+		/* only the sub-interface, in the container */
+		lease->veth[0] = '\0';
+		snprintf(lease->vpeer, sizeof(lease->vpeer), "%s%hu",
+			net_spec.mode == NET_MODE_MACVLAN ? "macvlan" : "ipvlan", n);
+	}
+
+	addr.s_addr = htonl(net_base + 1);
+	inet_ntop(AF_INET, &addr, lease->gateway_ip, sizeof(lease->gateway_ip));
+	addr.s_addr = htonl(net_base + index + 2);
+	inet_ntop(AF_INET, &addr, lease->child_ip, sizeof(lease->child_ip));
+	addr.s_addr = htonl(net_base | ((1U << (32 - net_prefix)) - 1));
+	inet_ntop(AF_INET, &addr, lease->bcast_ip, sizeof(lease->bcast_ip));
+
+	if (!(lease->prefix6 = net_spec.prefix6))
+		return;
+
+	/* the host bits of subnet6 are clear and at least 16 */
+	addr6 = net_spec.subnet6;
+	addr6.s6_addr32[3] = htonl(ntohl(addr6.s6_addr32[3]) + 1);
+	inet_ntop(AF_INET6, &addr6, lease->gateway_ip6,
+		sizeof(lease->gateway_ip6));
+	addr6.s6_addr32[3] = htonl(ntohl(addr6.s6_addr32[3]) + index + 1);
+	inet_ntop(AF_INET6, &addr6, lease->child_ip6, sizeof(lease->child_ip6));
+}
+
+/* lock block index for the caller, -1 if another process holds it */
+static int lock_block(int index)
+{
+	char lock_path[64];
+	int fd;
+
+	if (mkdir(RUN_DIR, S_IRUSR | S_IWUSR | S_IXUSR) && errno != EEXIST) {
+		printErr("mkdir at lock_block");
+	}
+
+	snprintf(lock_path, sizeof(lock_path), RUN_DIR "/veth-%d.lock", index);
+
+	if ((fd = open(lock_path, O_RDWR | O_CREAT | O_CLOEXEC, 0600)) == -1) {
+		printErr("open at lock_block");
+	}
+
+	if (flock(fd, LOCK_EX | LOCK_NB) == -1) {
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+/* Create the pair of a locked address if it does not exist: one batch for
+ * the pair, one to enslave veth to the bridge and set it up. A veth whose
+ * vpeer is not in the host belongs to a container left behind by a crashed
+ * run: -1, the address is skipped. */
+static int warm_pair(struct net_lease *lease)
+{
+	struct nl_batch batch;
+	struct nlmsghdr *nlmsg;
 	struct ifinfomsg *ifmsg;
-*/
+	struct rtattr *nest1, *nest2, *nest3;
+	int has_veth, has_vpeer, fd;
+
+	has_veth = if_nametoindex(lease->veth) != 0;
+	has_vpeer = if_nametoindex(lease->vpeer) != 0;
+
+	if (has_veth && has_vpeer)
+		return 0;
+	if (has_veth || has_vpeer)
+		return -1;
+
 	// create socket
-	int fd;
 	if ((fd = _nl_socket_init()) == 0)
 		exit(1);
 
 	// create veth pair -> veth1 - vpeer1
-	struct nlmsghdr *nlmsg = malloc(4096);
-	memset(nlmsg, 0, 4096);
-	nlmsg->nlmsg_len   = NLMSG_LENGTH(sizeof(struct ifinfomsg));
-	nlmsg->nlmsg_type  = RTM_NEWLINK;
-	nlmsg->nlmsg_flags = NLM_F_REQUEST|NLM_F_CREATE|NLM_F_EXCL|NLM_F_ACK;
-	nlmsg->nlmsg_seq   = time(NULL);
+	_nlbatch_init(&batch);
+	nlmsg = _nlbatch_add(&batch, RTM_NEWLINK, NLM_F_CREATE|NLM_F_EXCL,
+			sizeof(struct ifinfomsg));
 
-	struct ifinfomsg *ifmsg;
 	ifmsg = (struct ifinfomsg *) NLMSG_DATA(nlmsg);
 	ifmsg->ifi_family = AF_UNSPEC;
 
-	struct rtattr *nest1, *nest2, *nest3;
-
-	NLMSG_STRING(nlmsg, IFLA_IFNAME, "veth1");
+	NLMSG_STRING(nlmsg, IFLA_IFNAME, lease->veth);
 
 	nest1 = NLMSG_TAIL(nlmsg);
 	NLMSG_ATTR(nlmsg, IFLA_LINKINFO);
@@ -59,238 +531,284 @@ void prepare_netns(int cmd_pid)
 
 	nlmsg->nlmsg_len += sizeof(struct ifinfomsg);
 
-	NLMSG_STRING(nlmsg, IFLA_IFNAME, "vpeer1");
+	NLMSG_STRING(nlmsg, IFLA_IFNAME, lease->vpeer);
 
 	nest3->rta_len = (unsigned char *)NLMSG_TAIL(nlmsg) - (unsigned char *)nest3;
 	nest2->rta_len = (unsigned char *)NLMSG_TAIL(nlmsg) - (unsigned char *)nest2;
 	nest1->rta_len = (unsigned char *)NLMSG_TAIL(nlmsg) - (unsigned char *)nest1;
 
-	if (_nlmsg_send(fd, nlmsg) != 0)
+	if (_nlbatch_commit(fd, &batch) != 0) {
+		close(fd);
 		exit(1);
+	}
 
-	if (_nlmsg_recieve(fd) != 0) {
+	// host side of the pair, a port of the bridge
+	_nlbatch_init(&batch);
+	nl_link_enslave(&batch, lease->veth, bridge_index);
+
+	if (_nlbatch_commit(fd, &batch) != 0) {
 		close(fd);
 		exit(1);
 	}
 
-	int addrlen = sizeof(struct in_addr);
-	free(nlmsg);
-	nlmsg = malloc(4096);
-	memset(nlmsg, 0, 4096);
-	nlmsg->nlmsg_len   = NLMSG_LENGTH(sizeof(struct ifaddrmsg));
-	nlmsg->nlmsg_flags = NLM_F_ACK|NLM_F_REQUEST|NLM_F_CREATE|NLM_F_EXCL;
-	nlmsg->nlmsg_type  = RTM_NEWADDR;
-	nlmsg->nlmsg_seq   = time(NULL);
+	close(fd);
+	return 0;
+}
 
-	struct ifaddrmsg *ifa;
-	ifa = (struct ifaddrmsg *) NLMSG_DATA(nlmsg);
-	ifa->ifa_prefixlen = atoi("24");
-	if (!(ifa->ifa_index = if_nametoindex("veth1"))) {
-		printErr("failed to get veth1");
-	}
-	ifa->ifa_family = AF_INET;
-	ifa->ifa_scope = 0;
+/* The IPv6 gateway of subnet6, added by every run opening the pool: the
+ * request replaces the address if the bridge already has it. */
+static void prepare_bridge6()
+{
+	struct nl_batch batch;
+	struct in6_addr addr6 = net_spec.subnet6;
+	char gateway[INET6_ADDRSTRLEN];
+	int fd;
 
-	struct in_addr addr;
-	struct in_addr bcast;
+	addr6.s6_addr32[3] = htonl(ntohl(addr6.s6_addr32[3]) + 1);
+	inet_ntop(AF_INET6, &addr6, gateway, sizeof(gateway));
 
-	if (inet_pton(AF_INET, "172.16.1.1", &addr) < 0)
-		exit(1);
-	if (inet_pton(AF_INET, "172.16.1.255", &bcast) < 0)
+	if ((fd = _nl_socket_init()) == 0)
 		exit(1);
 
-	_nlmsg_put(nlmsg, IFA_LOCAL,     &addr,  addrlen);
-	_nlmsg_put(nlmsg, IFA_ADDRESS,   &addr,  addrlen);
-	_nlmsg_put(nlmsg, IFA_BROADCAST, &bcast, addrlen);
+	_nlbatch_init(&batch);
+	nl_addr6_add(&batch, NET_BRIDGE, gateway, net_spec.prefix6);
 
-	if (_nlmsg_send(fd, nlmsg) != 0)
-		exit(1);
-	if (_nlmsg_recieve(fd) != 0) {
+	if (_nlbatch_commit(fd, &batch) != 0) {
 		close(fd);
 		exit(1);
 	}
 
+	close(fd);
+}
 
-/*
-    int sock_fd = create_socket(
-            PF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+static void pool_open_default()
+{
+	parse_subnet(net_subnet);
+
+	if (net_spec.mode != NET_MODE_BRIDGE) {
+		if (!net_spec.parent[0])
+			strcpy(net_spec.parent, NET_PARENT);
+
+		if (!(parent_index = if_nametoindex(net_spec.parent))) {
+			fprintf(stderr, "=> no parent device %s for the %s mode\n",
+				net_spec.parent, net_mode_name(net_spec.mode));
+			exit(EXIT_FAILURE);
+		}
+		return;
+	}
 
-    create_veth(sock_fd, veth, vpeer);
+	prepare_bridge();
 
-    if_up(veth, veth_addr, netmask);
-*/
-    int mynetns = get_netns_fd(getpid());
-    int child_netns = get_netns_fd(cmd_pid);
+	if (net_spec.prefix6)
+		prepare_bridge6();
+}
 
-	// move vpeer1 in the child
-	free(nlmsg);
-	nlmsg = malloc(4096);
-	memset(nlmsg, 0, 4096);
-	nlmsg->nlmsg_len   = NLMSG_LENGTH(sizeof(struct ifinfomsg));
-	nlmsg->nlmsg_type  = RTM_NEWLINK;
-	nlmsg->nlmsg_flags = NLM_F_REQUEST|NLM_F_ACK;
-	nlmsg->nlmsg_seq   = time(NULL);
+void net_pool_open(const char *subnet, const struct net_spec *spec, int warm)
+{
+	struct net_lease lease;
+	int index, fd;
 
-	ifmsg = (struct ifinfomsg *) NLMSG_DATA(nlmsg);
-	ifmsg->ifi_family = AF_UNSPEC;
-	if (!(ifmsg->ifi_index = if_nametoindex("vpeer1"))) {
-		printErr("failed to get vpeer1");
-	}
-	//int nsfd = netns_get_fd("ns1");
-	_nlmsg_put(nlmsg, IFLA_NET_NS_FD, &child_netns, sizeof(child_netns));
+	if (subnet)
+		snprintf(net_subnet, sizeof(net_subnet), "%s", subnet);
 
-	if (_nlmsg_send(fd, nlmsg) != 0)
-		exit(1);
-	if (_nlmsg_recieve(fd) != 0) {
-		close(fd);
-		exit(1);
+	if (spec) {
+		net_spec = *spec;
+
+		for (index = 0; index < N_OFFLOADS; ++index)
+			has_offloads |= spec->offloads[index] != OFFLOAD_KEEP;
 	}
 
-	// set UP veth1 on the parent
-	free(nlmsg);
-	nlmsg = malloc(4096);
-	memset(nlmsg, 0, 4096);
-	nlmsg->nlmsg_len   = NLMSG_LENGTH(sizeof(struct ifinfomsg));
-	nlmsg->nlmsg_flags = NLM_F_ACK|NLM_F_REQUEST;
-	nlmsg->nlmsg_type  = RTM_NEWLINK;
-	nlmsg->nlmsg_seq   = time(NULL);
+	pthread_once(&pool_once, pool_open_default);
 
-	ifmsg = (struct ifinfomsg *) NLMSG_DATA(nlmsg);
-	ifmsg->ifi_family  = AF_UNSPEC;
-	ifmsg->ifi_change |= IFF_UP;
-	ifmsg->ifi_flags  |= IFF_UP;
-	if (!(ifmsg->ifi_index = if_nametoindex("veth1"))) {
-		printErr("failed to get veth1");
-	}
+	/* the sub-interfaces are created with their container */
+	if (net_spec.mode != NET_MODE_BRIDGE)
+		return;
 
-	if (_nlmsg_send(fd, nlmsg) != 0)
-		exit(1);
-	if (_nlmsg_recieve(fd) != 0) {
+	/* off the start path of the containers */
+	for (index = 0; index < warm && index < n_blocks; ++index) {
+		if ((fd = lock_block(index)) == -1)
+			continue;
+
+		lease_fill(&lease, index);
+		warm_pair(&lease);
 		close(fd);
-		exit(1);
 	}
+}
 
-	close(fd);
-	// enter in the child netns
-	if (setns(child_netns, CLONE_NEWNET))
-       printErr("setns");
+int net_pool_size()
+{
+	pthread_once(&pool_once, pool_open_default);
 
-	if ((fd = _nl_socket_init()) == 0)
-		exit(1);
-	// assign an ip address to vpeer1 (child)
-	free(nlmsg);
-	nlmsg = malloc(4096);
-	memset(nlmsg, 0, 4096);
-	nlmsg->nlmsg_len   = NLMSG_LENGTH(sizeof(struct ifaddrmsg));
-	nlmsg->nlmsg_flags = NLM_F_ACK|NLM_F_REQUEST|NLM_F_CREATE|NLM_F_EXCL;
-	nlmsg->nlmsg_type  = RTM_NEWADDR;
-	nlmsg->nlmsg_seq   = time(NULL);
-
-	struct ifaddrmsg *ifa_child;
-	ifa_child = (struct ifaddrmsg *) NLMSG_DATA(nlmsg);
-	ifa_child->ifa_prefixlen = atoi("24");
-	if (!(ifa_child->ifa_index = if_nametoindex("vpeer1"))) {
-		printErr("failed to get veth1");
+	return n_blocks;
+}
+
+/* the first block neither used by the process nor seen locked */
+static int free_block()
+{
+	uint64_t busy;
+	int word;
+
+	for (word = 0; word * 64 < n_blocks; ++word) {
+		busy = used_blocks[word] | foreign_blocks[word];
+
+		if (~busy && word * 64 + __builtin_ctzll(~busy) < n_blocks)
+			return word * 64 + __builtin_ctzll(~busy);
 	}
-	ifa_child->ifa_family = AF_INET;
-	ifa_child->ifa_scope = 0;
 
-	struct in_addr addr_child;
-	struct in_addr bcast_child;
+	return -1;
+}
 
-	if (inet_pton(AF_INET, "172.16.1.2", &addr_child) < 0)
-		exit(1);
-	if (inet_pton(AF_INET, "172.16.1.255", &bcast_child) < 0)
-		exit(1);
+void net_pool_acquire(struct net_lease *lease)
+{
+	int index, fd, retried = 0;
 
-	_nlmsg_put(nlmsg, IFA_LOCAL,     &addr_child,  addrlen);
-	_nlmsg_put(nlmsg, IFA_ADDRESS,   &addr_child,  addrlen);
-	_nlmsg_put(nlmsg, IFA_BROADCAST, &bcast_child, addrlen);
+	pthread_once(&pool_once, pool_open_default);
 
-	if (_nlmsg_send(fd, nlmsg) != 0)
-		exit(1);
-	if (_nlmsg_recieve(fd) != 0) {
-		close(fd);
-		exit(1);
-	}
+	pthread_mutex_lock(&pool_lock);
 
-	// put vpeer1 UP
-	free(nlmsg);
-	nlmsg = malloc(4096);
-	memset(nlmsg, 0, 4096);
-	nlmsg->nlmsg_len   = NLMSG_LENGTH(sizeof(struct ifinfomsg));
-	nlmsg->nlmsg_flags = NLM_F_ACK|NLM_F_REQUEST;
-	nlmsg->nlmsg_type  = RTM_NEWLINK;
-	nlmsg->nlmsg_seq   = time(NULL);
+	for (;;) {
+		if ((index = free_block()) == -1) {
+			/* the blocks of the other processes may be free by now */
+			if (retried++) {
+				fprintf(stderr, "=> no free address in %s\n", net_subnet);
+				exit(EXIT_FAILURE);
+			}
+			memset(foreign_blocks, 0, sizeof(foreign_blocks));
+			continue;
+		}
 
-	ifmsg = (struct ifinfomsg *) NLMSG_DATA(nlmsg);
-	ifmsg->ifi_family  = AF_UNSPEC;
-	ifmsg->ifi_change |= IFF_UP;
-	ifmsg->ifi_flags  |= IFF_UP;
-	if (!(ifmsg->ifi_index = if_nametoindex("vpeer1"))) {
-		printf("failed to get veth1 name: %s\n", strerror(errno));
-		exit(1);
-	}
+		lease_fill(lease, index);
 
-	if (_nlmsg_send(fd, nlmsg) != 0)
-		exit(1);
-	if (_nlmsg_recieve(fd) != 0) {
-		close(fd);
-		exit(1);
+		if ((fd = lock_block(index)) != -1
+				&& (net_spec.mode != NET_MODE_BRIDGE || warm_pair(lease) == 0))
+			break;
+
+		if (fd != -1)
+			close(fd);
+		foreign_blocks[index / 64] |= 1ULL << (index % 64);
 	}
 
+	used_blocks[index / 64] |= 1ULL << (index % 64);
+	pthread_mutex_unlock(&pool_lock);
 
-	// put UP lo
-	free(nlmsg);
-	nlmsg = malloc(4096);
-	memset(nlmsg, 0, 4096);
-	nlmsg->nlmsg_len   = NLMSG_LENGTH(sizeof(struct ifinfomsg));
-	nlmsg->nlmsg_flags = NLM_F_ACK|NLM_F_REQUEST;
-	nlmsg->nlmsg_type  = RTM_NEWLINK;
-	nlmsg->nlmsg_seq   = time(NULL);
+	lease->lock_fd = fd;
+	lease->netns_fd = -1;
+}
 
+/* the MTU of both ends, always set as the pairs are reused, and vpeer
+ * moved to netns_fd */
+static void nl_pair_move(struct nl_batch *batch, struct net_lease *lease,
+	int netns_fd)
+{
+	int mtu = net_spec.mtu ? net_spec.mtu : ETH_DATA_LEN;
+	struct nlmsghdr *nlmsg;
+	struct ifinfomsg *ifmsg;
+
+	nlmsg = _nlbatch_add(batch, RTM_NEWLINK, 0, sizeof(struct ifinfomsg));
 	ifmsg = (struct ifinfomsg *) NLMSG_DATA(nlmsg);
-	ifmsg->ifi_family  = AF_UNSPEC;
-	ifmsg->ifi_change |= IFF_UP;
-	ifmsg->ifi_flags  |= IFF_UP;
-	if (!(ifmsg->ifi_index = if_nametoindex("lo"))) {
-		printErr("failed to get veth1");
-	}
+	ifmsg->ifi_family = AF_UNSPEC;
+	NLMSG_STRING(nlmsg, IFLA_IFNAME, lease->veth);
+	_nlmsg_put(nlmsg, IFLA_MTU, &mtu, sizeof(mtu));
 
-	if (_nlmsg_send(fd, nlmsg) != 0)
+	nlmsg = _nlbatch_add(batch, RTM_NEWLINK, 0, sizeof(struct ifinfomsg));
+	ifmsg = (struct ifinfomsg *) NLMSG_DATA(nlmsg);
+	ifmsg->ifi_family = AF_UNSPEC;
+	NLMSG_STRING(nlmsg, IFLA_IFNAME, lease->vpeer);
+	_nlmsg_put(nlmsg, IFLA_NET_NS_FD, &netns_fd, sizeof(netns_fd));
+	_nlmsg_put(nlmsg, IFLA_MTU, &mtu, sizeof(mtu));
+}
+
+/* A warm pair is already a port of the bridge and only needs vpeer to be
+ * moved, so the whole configuration costs two sendmsg() calls instead of
+ * one round trip per request, whatever the spec:
+ *   1 - host side: MTU of veth, vpeer moved to the child with its MTU, or
+ *     the macvlan/ipvlan interface created in the child
+ *   2 - child side: addresses and link up of vpeer, lo up, default routes
+ *     through the bridge and the routes of the spec
+ * and a third one to the ethtool family when the spec has offloads,
+ * switched on both ends before vpeer leaves the host, or on the
+ * sub-interface once in the child.
+ *
+ * Different pairs can be set up concurrently. */
+void prepare_netns(int cmd_pid, struct net_lease *lease)
+{
+	struct nl_batch batch;
+	struct net_route *route;
+	struct in6_addr gateway6;
+	struct in_addr gateway;
+	char *pair[] = { lease->vpeer, lease->veth };
+	int bridged = net_spec.mode == NET_MODE_BRIDGE;
+	int routed = net_spec.mode == NET_MODE_IPVLAN_L3;
+	int fd, i;
+
+	if (bridged && has_offloads
+			&& ethtool_set_offloads(pair, 2, &net_spec) == -1)
+		fprintf(stderr, "=> cannot set the offloads of %s\n", lease->veth);
+
+	// create socket
+	if ((fd = _nl_socket_init()) == 0)
 		exit(1);
-	if (_nlmsg_recieve(fd) != 0) {
+
+	int mynetns = get_netns_fd(getpid());
+	int child_netns = get_netns_fd(cmd_pid);
+
+	_nlbatch_init(&batch);
+
+	if (bridged)
+		nl_pair_move(&batch, lease, child_netns);
+	else
+		nl_sublink_add(&batch, lease->vpeer, child_netns);
+
+	if (_nlbatch_commit(fd, &batch) != 0) {
 		close(fd);
 		exit(1);
 	}
 
-	// default GW to the child
-	free(nlmsg);
-	nlmsg = malloc(4096);
-	memset(nlmsg, 0, 4096);
-	nlmsg->nlmsg_len   = NLMSG_LENGTH(sizeof(struct rtmsg));
-	nlmsg->nlmsg_flags = NLM_F_ACK|NLM_F_REQUEST|NLM_F_CREATE|NLM_F_EXCL;
-	nlmsg->nlmsg_type  = RTM_NEWROUTE;
-	nlmsg->nlmsg_seq   = time(NULL);
+	close(fd);
+	// enter in the child netns
+	if (setns(child_netns, CLONE_NEWNET))
+       printErr("setns");
 
-	struct rtmsg *rtm;
-	rtm = (struct rtmsg *) NLMSG_DATA(nlmsg);
+	if (!bridged && has_offloads
+			&& ethtool_set_offloads(pair, 1, &net_spec) == -1)
+		fprintf(stderr, "=> cannot set the offloads of %s\n", lease->vpeer);
 
-	rtm->rtm_family   = AF_INET;
-	rtm->rtm_table    = RT_TABLE_MAIN;
-	rtm->rtm_scope    = RT_SCOPE_UNIVERSE;
-	rtm->rtm_protocol = RTPROT_BOOT;
-	rtm->rtm_type     = RTN_UNICAST;
-	rtm->rtm_dst_len  = 0;
+	if ((fd = _nl_socket_init()) == 0)
+		exit(1);
 
-	if (inet_pton(AF_INET, "172.16.1.1", &addr) < 0)
+	if (inet_pton(AF_INET, lease->gateway_ip, &gateway) != 1)
+		exit(1);
+	if (lease->prefix6 && inet_pton(AF_INET6, lease->gateway_ip6,
+			&gateway6) != 1)
 		exit(1);
 
-	_nlmsg_put(nlmsg, RTA_GATEWAY, &addr, addrlen);
+	// child side of the pair
+	_nlbatch_init(&batch);
+	nl_addr_add(&batch, lease->vpeer, lease->child_ip, lease->prefix,
+		lease->bcast_ip);
+	if (lease->prefix6)
+		nl_addr6_add(&batch, lease->vpeer, lease->child_ip6, lease->prefix6);
+	nl_link_up(&batch, lease->vpeer);
+	nl_link_up(&batch, "lo");
+
+	// default GW to the child, the host routes the ipvlan-l3 packets
+	nl_route_add(&batch, AF_INET, NULL, 0, routed ? NULL : &gateway,
+		lease->vpeer);
+	if (lease->prefix6)
+		nl_route_add(&batch, AF_INET6, NULL, 0, routed ? NULL : &gateway6,
+			lease->vpeer);
+
+	for (i = 0; i < net_spec.n_routes; ++i) {
+		route = &net_spec.routes[i];
+
+		nl_route_add(&batch, route->family, route->dst, route->dst_len,
+			route->has_via ? (void *) route->via
+			: routed ? NULL
+			: route->family == AF_INET6 ? (void *) &gateway6
+			: (void *) &gateway, lease->vpeer);
+	}
 
-	if (_nlmsg_send(fd, nlmsg) != 0)
-		exit(1);
-	if (_nlmsg_recieve(fd) != 0) {
+	if (_nlbatch_commit(fd, &batch) != 0) {
 		close(fd);
 		exit(1);
 	}
@@ -300,43 +818,60 @@ void prepare_netns(int cmd_pid)
     if (setns(mynetns, CLONE_NEWNET))
         printErr("restore previous net namespace");
 
+	close(mynetns);
 
-	if ((fd = _nl_socket_init()) == 0)
-		exit(1);
+	/* keeps the namespace, and vpeer, alive until the release */
+	lease->netns_fd = child_netns;
+}
 
-	// nat and forwarding
-	struct _rule *r = malloc(sizeof(struct _rule));
-	memset(r, 0, sizeof(struct _rule));
-	r->table = "nat";
-	r->entry = "POSTROUTING";
-	r->type  = "MASQUERADE";
-	r->saddr = "172.16.1.0/24";
-	r->oface = "eth0";
-	_ipt_rule(r);
+/* The namespace of a terminated container lives as long as netns_fd:
+ * vpeer is moved back to the host from inside it, its address goes away
+ * with the move. If that fails the namespace takes the pair with it and
+ * the next user of the block creates it again. A macvlan or ipvlan
+ * interface is deleted instead: ipvlan refuses an address still held by
+ * an interface of a namespace being torn down. */
+void net_pool_release(struct net_lease *lease)
+{
+	struct nl_batch batch;
+	struct nlmsghdr *nlmsg;
+	struct ifinfomsg *ifmsg;
+	int mynetns, fd;
 
-	r->saddr = 0;
-	r->table = "filter";
-	r->entry = "FORWARD";
-	r->type  = "ACCEPT";
-	r->oface = "eth0";
-	r->iface = "veth0";
-	_ipt_rule(r);
+	if (lease->index == -1)
+		return;
 
-	r->oface = "veth0";
-	r->iface = "eth0";
-	_ipt_rule(r);
+	if (lease->netns_fd != -1) {
+		mynetns = get_netns_fd(getpid());
 
-/*
+		if (setns(lease->netns_fd, CLONE_NEWNET))
+			printErr("setns");
 
-    move_if_to_pid_netns(sock_fd, vpeer, child_netns);
+		if ((fd = _nl_socket_init()) != 0) {
+			_nlbatch_init(&batch);
+			nlmsg = _nlbatch_add(&batch, net_spec.mode == NET_MODE_BRIDGE
+					? RTM_NEWLINK : RTM_DELLINK, 0, sizeof(struct ifinfomsg));
+			ifmsg = (struct ifinfomsg *) NLMSG_DATA(nlmsg);
+			ifmsg->ifi_family = AF_UNSPEC;
+			NLMSG_STRING(nlmsg, IFLA_IFNAME, lease->vpeer);
+			if (net_spec.mode == NET_MODE_BRIDGE)
+				_nlmsg_put(nlmsg, IFLA_NET_NS_FD, &mynetns, sizeof(mynetns));
 
-    if (setns(child_netns, CLONE_NEWNET))
-        printErr("setns");
+			_nlbatch_commit(fd, &batch);
+			close(fd);
+		}
 
-    if_up(vpeer, vpeer_addr, netmask);
+		if (setns(mynetns, CLONE_NEWNET))
+			printErr("restore previous net namespace");
 
-    if (setns(mynetns, CLONE_NEWNET))
-        printErr("restore previous net namespace");
-*/
-    close(fd);
-}
\ No newline at end of file
+		close(mynetns);
+		close(lease->netns_fd);
+		lease->netns_fd = -1;
+	}
+
+	pthread_mutex_lock(&pool_lock);
+	used_blocks[lease->index / 64] &= ~(1ULL << (lease->index % 64));
+	pthread_mutex_unlock(&pool_lock);
+
+	close(lease->lock_fd);
+	lease->index = -1;
+}
@@ -53,5 +53,80 @@
  * We can then call out to the executable from within our process (running
  * as non-root user) as and when we need to.
  */
+
+#ifndef NETWORK_H
+#define NETWORK_H
+
+#include <sys/types.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "netspec.h"
+
+#define NET_SUBNET      "172.16.1.0/24"     /* default subnet of the pool */
+#define NET_MIN_PREFIX  16
+#define NET_MAX_PREFIX  29
+#define NET_MAX_PAIRS   4096                /* container addresses used */
+#define NET_BRIDGE      "mydocker0"         /* gateway of the subnet */
+#define NET_WARM_PAIRS  8                   /* pairs created ahead */
+
 void start_network(pid_t child_pid);
-void prepare_netns(int cmd_pid);
\ No newline at end of file
+
+/* A veth pair of the pool and the address of the container using it.
+ *
+ * The containers of the host share the bridge NET_BRIDGE, created once
+ * with the first address of the subnet, their default gateway, and a
+ * single MASQUERADE rule for the whole subnet: the containers talk to
+ * each other through the bridge, without NAT.
+ *
+ * The pool keeps the pairs of the host warm: veth<n> is a port of the
+ * bridge (IFLA_MASTER) and is up, vpeer<n> waits in the host namespace.
+ * A container only takes vpeer into its namespace, which gives it back
+ * when the container is released. Address n-1 of the subnet, after the
+ * gateway, is the pair n and is locked with a flock() on
+ * RUN_DIR/veth-<n-1>.lock, so the processes of the host never share a
+ * pair and a crashed one releases its pairs by itself; they must all use
+ * the same subnet.
+ *
+ * The addresses are handed out from a bitmap, a free one is found with a
+ * single scan of its words.
+ *
+ * In the macvlan and ipvlan modes of the spec (see netspec.h) there is no
+ * bridge nor pair: vpeer is a sub-interface of the parent device, created
+ * in the namespace of the container and deleted at the release. */
+struct net_lease {
+	int index;                  /* address of the pair, -1 if none */
+	int lock_fd;                /* holds the address lock */
+	int netns_fd;               /* namespace holding vpeer, -1 if none */
+	char veth[IFNAMSIZ], vpeer[IFNAMSIZ];   /* no veth but in bridge mode */
+	char gateway_ip[INET_ADDRSTRLEN];   /* the bridge */
+	char child_ip[INET_ADDRSTRLEN];     /* vpeer */
+	char bcast_ip[INET_ADDRSTRLEN];
+	int prefix;
+	char gateway_ip6[INET6_ADDRSTRLEN]; /* with a subnet6 spec */
+	char child_ip6[INET6_ADDRSTRLEN];
+	int prefix6;                        /* 0 without IPv6 */
+};
+
+/* Hand the addresses of subnet, "a.b.c.d/len", out to the containers,
+ * create the bridge if needed and the first warm pairs. The interfaces of
+ * the containers follow spec if not NULL (see netspec.h). Otherwise the
+ * pool opens NET_SUBNET on the first net_pool_acquire(). */
+void net_pool_open(const char *subnet, const struct net_spec *spec, int warm);
+
+/* the number of addresses, and of veth pairs, of the pool */
+int net_pool_size();
+
+/* take a free block of the pool and its pair, created if needed */
+void net_pool_acquire(struct net_lease *lease);
+
+/* connect the network namespace of cmd_pid to the host through the veth
+ * pair of lease */
+void prepare_netns(int cmd_pid, struct net_lease *lease);
+
+/* give vpeer back to the host and free the block, once the container
+ * terminated */
+void net_pool_release(struct net_lease *lease);
+
+#endif //NETWORK_H
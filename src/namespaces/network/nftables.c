@@ -0,0 +1,571 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <stdint.h>
+#include <net/if.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/netfilter.h>
+#include <linux/netfilter_ipv4.h>
+#include <linux/netfilter/nfnetlink.h>
+#include <linux/netfilter/nf_tables.h>
+
+#include "nftables.h"
+#include "../../helpers/helpers.h"
+
+#define ATTR_DATA(attr)     ((char *) (attr) + NLA_HDRLEN)
+#define ATTR_LEN(attr)      ((attr)->nla_len - NLA_HDRLEN)
+
+/* the messages of a batch, built in place */
+struct nft_batch {
+	char buf[NFT_BATCH_SIZE];
+	size_t len;
+	struct nlmsghdr *msg;       /* message being built */
+	__u32 seq;                  /* sequence number of the next message */
+	__u32 last_acked;           /* the last message asking for an ACK */
+};
+
+/* a chain, or a rule, of a table of the host */
+struct nft_ref {
+	int family;
+	char table[NFT_NAME_MAXLEN];
+	char chain[NFT_NAME_MAXLEN];
+	__u64 handle;               /* of a rule, big endian */
+};
+
+/* what the host has on the forward hook */
+struct nft_host {
+	struct nft_ref chains[NFT_MAX_HOST_CHAINS];
+	int n_chains;
+	struct nft_ref tagged[NFT_MAX_TAGGED];     /* added by a previous run */
+	int n_tagged;
+};
+
+static void *batch_reserve(struct nft_batch *batch, size_t len)
+{
+	void *p = batch->buf + batch->len;
+
+	if (batch->len + NLMSG_ALIGN(len) > NFT_BATCH_SIZE) {
+		fprintf(stderr, "nftables batch full\n");
+		exit(EXIT_FAILURE);
+	}
+
+	memset(p, 0, NLMSG_ALIGN(len));
+	batch->len += NLMSG_ALIGN(len);
+	return p;
+}
+
+/* account the attributes appended to the message being built */
+static void msg_end(struct nft_batch *batch)
+{
+	if (!batch->msg)
+		return;
+
+	batch->msg->nlmsg_len = batch->buf + batch->len - (char *) batch->msg;
+	batch->msg = NULL;
+}
+
+/* start a message of the nf_tables subsystem, or a batch delimiter */
+static void msg_begin(struct nft_batch *batch, int type, int flags,
+	int family)
+{
+	struct nfgenmsg *nfg;
+
+	msg_end(batch);
+
+	batch->msg = batch_reserve(batch, NLMSG_HDRLEN);
+	batch->msg->nlmsg_type  = type;
+	batch->msg->nlmsg_flags = NLM_F_REQUEST | flags;
+	batch->msg->nlmsg_seq   = batch->seq++;
+
+	if (flags & NLM_F_ACK)
+		batch->last_acked = batch->msg->nlmsg_seq;
+
+	nfg = batch_reserve(batch, sizeof(struct nfgenmsg));
+	nfg->nfgen_family = family;
+	nfg->version = NFNETLINK_V0;
+	nfg->res_id = htons(NFNL_SUBSYS_NFTABLES);
+}
+
+static void attr_put(struct nft_batch *batch, int type, const void *data,
+	size_t len)
+{
+	struct nlattr *attr = batch_reserve(batch, NLA_HDRLEN + len);
+
+	attr->nla_type = type;
+	attr->nla_len  = NLA_HDRLEN + len;
+	memcpy((char *) attr + NLA_HDRLEN, data, len);
+}
+
+static void attr_put_str(struct nft_batch *batch, int type, const char *str)
+{
+	attr_put(batch, type, str, strlen(str) + 1);
+}
+
+/* nf_tables integers are big endian */
+static void attr_put_u32(struct nft_batch *batch, int type, __u32 value)
+{
+	value = htonl(value);
+	attr_put(batch, type, &value, sizeof(value));
+}
+
+static struct nlattr *nest_begin(struct nft_batch *batch, int type)
+{
+	struct nlattr *nest = batch_reserve(batch, NLA_HDRLEN);
+
+	nest->nla_type = NLA_F_NESTED | type;
+	return nest;
+}
+
+static void nest_end(struct nft_batch *batch, struct nlattr *nest)
+{
+	nest->nla_len = batch->buf + batch->len - (char *) nest;
+}
+
+/* the element of NFTA_RULE_EXPRESSIONS of an expression, its attributes
+ * go in the returned nest */
+static struct nlattr *expr_begin(struct nft_batch *batch, const char *name,
+	struct nlattr **elem)
+{
+	*elem = nest_begin(batch, NFTA_LIST_ELEM);
+	attr_put_str(batch, NFTA_EXPR_NAME, name);
+	return nest_begin(batch, NFTA_EXPR_DATA);
+}
+
+static void expr_end(struct nft_batch *batch, struct nlattr *data,
+	struct nlattr *elem)
+{
+	nest_end(batch, data);
+	nest_end(batch, elem);
+}
+
+/* a NFTA_DATA_VALUE nested in type */
+static void data_put(struct nft_batch *batch, int type, const void *value,
+	size_t len)
+{
+	struct nlattr *nest = nest_begin(batch, type);
+
+	attr_put(batch, NFTA_DATA_VALUE, value, len);
+	nest_end(batch, nest);
+}
+
+/* ip saddr & mask == addr */
+static void expr_saddr(struct nft_batch *batch, __u32 addr, __u32 mask)
+{
+	struct nlattr *elem, *data;
+	__u32 zero = 0;
+
+	data = expr_begin(batch, "payload", &elem);
+	attr_put_u32(batch, NFTA_PAYLOAD_DREG, NFT_REG_1);
+	attr_put_u32(batch, NFTA_PAYLOAD_BASE, NFT_PAYLOAD_NETWORK_HEADER);
+	attr_put_u32(batch, NFTA_PAYLOAD_OFFSET, 12);
+	attr_put_u32(batch, NFTA_PAYLOAD_LEN, sizeof(__u32));
+	expr_end(batch, data, elem);
+
+	data = expr_begin(batch, "bitwise", &elem);
+	attr_put_u32(batch, NFTA_BITWISE_SREG, NFT_REG_1);
+	attr_put_u32(batch, NFTA_BITWISE_DREG, NFT_REG_1);
+	attr_put_u32(batch, NFTA_BITWISE_LEN, sizeof(__u32));
+	data_put(batch, NFTA_BITWISE_MASK, &mask, sizeof(mask));
+	data_put(batch, NFTA_BITWISE_XOR, &zero, sizeof(zero));
+	expr_end(batch, data, elem);
+
+	data = expr_begin(batch, "cmp", &elem);
+	attr_put_u32(batch, NFTA_CMP_SREG, NFT_REG_1);
+	attr_put_u32(batch, NFTA_CMP_OP, NFT_CMP_EQ);
+	data_put(batch, NFTA_CMP_DATA, &addr, sizeof(addr));
+	expr_end(batch, data, elem);
+}
+
+/* iifname or oifname, the whole IFNAMSIZ buffer is compared */
+static void expr_ifname(struct nft_batch *batch, int key, const char *name)
+{
+	struct nlattr *elem, *data;
+	char ifname[IFNAMSIZ] = { 0 };
+
+	strncpy(ifname, name, IFNAMSIZ - 1);
+
+	data = expr_begin(batch, "meta", &elem);
+	attr_put_u32(batch, NFTA_META_KEY, key);
+	attr_put_u32(batch, NFTA_META_DREG, NFT_REG_1);
+	expr_end(batch, data, elem);
+
+	data = expr_begin(batch, "cmp", &elem);
+	attr_put_u32(batch, NFTA_CMP_SREG, NFT_REG_1);
+	attr_put_u32(batch, NFTA_CMP_OP, NFT_CMP_EQ);
+	data_put(batch, NFTA_CMP_DATA, ifname, sizeof(ifname));
+	expr_end(batch, data, elem);
+}
+
+static void expr_accept(struct nft_batch *batch)
+{
+	struct nlattr *elem, *data, *imm, *verdict;
+
+	data = expr_begin(batch, "immediate", &elem);
+	attr_put_u32(batch, NFTA_IMMEDIATE_DREG, NFT_REG_VERDICT);
+	imm = nest_begin(batch, NFTA_IMMEDIATE_DATA);
+	verdict = nest_begin(batch, NFTA_DATA_VERDICT);
+	attr_put_u32(batch, NFTA_VERDICT_CODE, NF_ACCEPT);
+	nest_end(batch, verdict);
+	nest_end(batch, imm);
+	expr_end(batch, data, elem);
+}
+
+static void expr_masq(struct nft_batch *batch)
+{
+	struct nlattr *elem;
+
+	elem = nest_begin(batch, NFTA_LIST_ELEM);
+	attr_put_str(batch, NFTA_EXPR_NAME, "masq");
+	nest_end(batch, elem);
+}
+
+static void msg_table(struct nft_batch *batch, int type, int flags)
+{
+	msg_begin(batch, NFNL_SUBSYS_NFTABLES << 8 | type, flags | NLM_F_ACK,
+		NFPROTO_IPV4);
+	attr_put_str(batch, NFTA_TABLE_NAME, NFT_TABLE);
+}
+
+static void msg_chain(struct nft_batch *batch, const char *name,
+	const char *chain_type, int hook, int priority)
+{
+	struct nlattr *nest;
+
+	msg_begin(batch, NFNL_SUBSYS_NFTABLES << 8 | NFT_MSG_NEWCHAIN,
+		NLM_F_CREATE | NLM_F_ACK, NFPROTO_IPV4);
+	attr_put_str(batch, NFTA_CHAIN_TABLE, NFT_TABLE);
+	attr_put_str(batch, NFTA_CHAIN_NAME, name);
+
+	nest = nest_begin(batch, NFTA_CHAIN_HOOK);
+	attr_put_u32(batch, NFTA_HOOK_HOOKNUM, hook);
+	attr_put_u32(batch, NFTA_HOOK_PRIORITY, priority);
+	nest_end(batch, nest);
+
+	attr_put_str(batch, NFTA_CHAIN_TYPE, chain_type);
+	attr_put_u32(batch, NFTA_CHAIN_POLICY, NF_ACCEPT);
+}
+
+/* start a rule appended to chain, or inserted first, its expressions go
+ * in the returned nest */
+static struct nlattr *msg_rule(struct nft_batch *batch, int family,
+	const char *table, const char *chain, int insert)
+{
+	msg_begin(batch, NFNL_SUBSYS_NFTABLES << 8 | NFT_MSG_NEWRULE,
+		NLM_F_CREATE | (insert ? 0 : NLM_F_APPEND) | NLM_F_ACK, family);
+	attr_put_str(batch, NFTA_RULE_TABLE, table);
+	attr_put_str(batch, NFTA_RULE_CHAIN, chain);
+
+	return nest_begin(batch, NFTA_RULE_EXPRESSIONS);
+}
+
+static void msg_delrule(struct nft_batch *batch, const struct nft_ref *rule)
+{
+	msg_begin(batch, NFNL_SUBSYS_NFTABLES << 8 | NFT_MSG_DELRULE, NLM_F_ACK,
+		rule->family);
+	attr_put_str(batch, NFTA_RULE_TABLE, rule->table);
+	attr_put_str(batch, NFTA_RULE_CHAIN, rule->chain);
+	attr_put(batch, NFTA_RULE_HANDLE, &rule->handle, sizeof(rule->handle));
+}
+
+/* The comment of the rules added to the chains of the host, in the user
+ * data format of nft, so that "nft list" shows it: a comment type, its
+ * length and the string with its NUL. */
+static size_t rule_tag(char *tag)
+{
+	tag[0] = 0;
+	tag[1] = sizeof(NFT_TABLE);
+	memcpy(tag + 2, NFT_TABLE, sizeof(NFT_TABLE));
+
+	return 2 + sizeof(NFT_TABLE);
+}
+
+/* iifname <iface> oifname <oface> accept, first in a chain of the host */
+static void host_accept(struct nft_batch *batch, const struct nft_ref *chain,
+	const char *iface, const char *oface)
+{
+	char tag[2 + sizeof(NFT_TABLE)];
+	struct nlattr *exprs;
+
+	exprs = msg_rule(batch, chain->family, chain->table, chain->chain, 1);
+	expr_ifname(batch, NFT_META_IIFNAME, iface);
+	expr_ifname(batch, NFT_META_OIFNAME, oface);
+	expr_accept(batch);
+	nest_end(batch, exprs);
+
+	attr_put(batch, NFTA_RULE_USERDATA, tag, rule_tag(tag));
+}
+
+/* index the attributes of len bytes at attr by type, up to max */
+static void attr_parse(struct nlattr *attr, int len, struct nlattr **tb,
+	int max)
+{
+	memset(tb, 0, (max + 1) * sizeof(*tb));
+
+	while (len >= NLA_HDRLEN && attr->nla_len >= NLA_HDRLEN
+			&& attr->nla_len <= len) {
+		if ((attr->nla_type & NLA_TYPE_MASK) <= max)
+			tb[attr->nla_type & NLA_TYPE_MASK] = attr;
+
+		len -= NLA_ALIGN(attr->nla_len);
+		attr = (struct nlattr *) ((char *) attr + NLA_ALIGN(attr->nla_len));
+	}
+}
+
+static void msg_parse(struct nlmsghdr *nlmsg, struct nlattr **tb, int max)
+{
+	attr_parse((struct nlattr *) ((char *) NLMSG_DATA(nlmsg)
+		+ NLA_ALIGN(sizeof(struct nfgenmsg))), nlmsg->nlmsg_len
+		- NLMSG_LENGTH(NLA_ALIGN(sizeof(struct nfgenmsg))), tb, max);
+}
+
+static void ref_set(struct nft_ref *ref, int family, struct nlattr *table,
+	struct nlattr *chain)
+{
+	ref->family = family;
+	snprintf(ref->table, sizeof(ref->table), "%.*s", ATTR_LEN(table),
+		ATTR_DATA(table));
+	snprintf(ref->chain, sizeof(ref->chain), "%.*s", ATTR_LEN(chain),
+		ATTR_DATA(chain));
+}
+
+/* a base chain of the forward hook, of a table of the host */
+static void parse_chain(struct nlmsghdr *nlmsg, struct nft_host *host)
+{
+	struct nfgenmsg *nfg = NLMSG_DATA(nlmsg);
+	struct nlattr *tb[NFTA_CHAIN_MAX + 1], *hook[NFTA_HOOK_MAX + 1];
+
+	if (nfg->nfgen_family != NFPROTO_IPV4 && nfg->nfgen_family != NFPROTO_INET)
+		return;
+
+	msg_parse(nlmsg, tb, NFTA_CHAIN_MAX);
+	if (!tb[NFTA_CHAIN_TABLE] || !tb[NFTA_CHAIN_NAME] || !tb[NFTA_CHAIN_HOOK])
+		return;
+
+	attr_parse((struct nlattr *) ATTR_DATA(tb[NFTA_CHAIN_HOOK]),
+		ATTR_LEN(tb[NFTA_CHAIN_HOOK]), hook, NFTA_HOOK_MAX);
+	if (!hook[NFTA_HOOK_HOOKNUM]
+			|| ntohl(*(__u32 *) ATTR_DATA(hook[NFTA_HOOK_HOOKNUM]))
+				!= NF_INET_FORWARD)
+		return;
+
+	if (nfg->nfgen_family == NFPROTO_IPV4
+			&& !strcmp(ATTR_DATA(tb[NFTA_CHAIN_TABLE]), NFT_TABLE))
+		return;
+
+	if (host->n_chains == NFT_MAX_HOST_CHAINS) {
+		fprintf(stderr, "=> more than %d forward chains, some are "
+			"skipped\n", NFT_MAX_HOST_CHAINS);
+		return;
+	}
+
+	ref_set(&host->chains[host->n_chains++], nfg->nfgen_family,
+		tb[NFTA_CHAIN_TABLE], tb[NFTA_CHAIN_NAME]);
+}
+
+/* a rule added to a chain of the host by a previous run */
+static void parse_rule(struct nlmsghdr *nlmsg, struct nft_host *host)
+{
+	struct nfgenmsg *nfg = NLMSG_DATA(nlmsg);
+	struct nlattr *tb[NFTA_RULE_MAX + 1];
+	char tag[2 + sizeof(NFT_TABLE)];
+	size_t tag_len = rule_tag(tag);
+	struct nft_ref *rule;
+
+	msg_parse(nlmsg, tb, NFTA_RULE_MAX);
+	if (!tb[NFTA_RULE_TABLE] || !tb[NFTA_RULE_CHAIN] || !tb[NFTA_RULE_HANDLE]
+			|| !tb[NFTA_RULE_USERDATA]
+			|| ATTR_LEN(tb[NFTA_RULE_USERDATA]) != tag_len
+			|| memcmp(ATTR_DATA(tb[NFTA_RULE_USERDATA]), tag, tag_len)
+			|| host->n_tagged == NFT_MAX_TAGGED)
+		return;
+
+	rule = &host->tagged[host->n_tagged++];
+	ref_set(rule, nfg->nfgen_family, tb[NFTA_RULE_TABLE],
+		tb[NFTA_RULE_CHAIN]);
+	memcpy(&rule->handle, ATTR_DATA(tb[NFTA_RULE_HANDLE]),
+		sizeof(rule->handle));
+}
+
+/* Dump the chains (NFT_MSG_GETCHAIN) or the rules (NFT_MSG_GETRULE) of
+ * every table of the host into host. Returns 0, or -1 without nf_tables. */
+static int host_dump(int type, struct nft_host *host)
+{
+	struct {
+		struct nlmsghdr n;
+		struct nfgenmsg g;
+	} req;
+	struct sockaddr_nl sa = { .nl_family = AF_NETLINK };
+	struct nlmsghdr *ret;
+	int fd, result = -1;
+	ssize_t len;
+	char *buf;
+
+	memset(&req, 0, sizeof(req));
+	req.n.nlmsg_len   = NLMSG_LENGTH(sizeof(struct nfgenmsg));
+	req.n.nlmsg_type  = NFNL_SUBSYS_NFTABLES << 8 | type;
+	req.n.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+	req.g.nfgen_family = NFPROTO_UNSPEC;
+	req.g.version = NFNETLINK_V0;
+
+	if (!(buf = malloc(NFT_DUMP_SIZE)))
+		printErr("malloc at host_dump");
+
+	if ((fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_NETFILTER))
+			== -1) {
+		free(buf);
+		return -1;
+	}
+
+	if (sendto(fd, &req, req.n.nlmsg_len, 0, (struct sockaddr *) &sa,
+			sizeof(sa)) == -1)
+		goto out;
+
+	for (;;) {
+		if ((len = recv(fd, buf, NFT_DUMP_SIZE, 0)) <= 0) {
+			if (len == -1 && errno == EINTR)
+				continue;
+			goto out;
+		}
+
+		for (ret = (struct nlmsghdr *) buf; NLMSG_OK(ret, len);
+				ret = NLMSG_NEXT(ret, len)) {
+			if (ret->nlmsg_type == NLMSG_DONE) {
+				result = 0;
+				goto out;
+			}
+
+			if (ret->nlmsg_type == NLMSG_ERROR)
+				goto out;
+
+			if (type == NFT_MSG_GETCHAIN)
+				parse_chain(ret, host);
+			else
+				parse_rule(ret, host);
+		}
+	}
+
+out:
+	close(fd);
+	free(buf);
+	return result;
+}
+
+/* Send the batch and wait for the ACK of its last message. The kernel
+ * applies the whole batch or nothing: the first error is enough. */
+static int batch_commit(struct nft_batch *batch)
+{
+	struct sockaddr_nl sa = { .nl_family = AF_NETLINK };
+	char buf[NFT_BATCH_SIZE];
+	struct nlmsghdr *ret;
+	struct nlmsgerr *err;
+	ssize_t len;
+	int fd;
+
+	msg_end(batch);
+
+	if ((fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_NETFILTER))
+			== -1)
+		return -1;
+
+	if (sendto(fd, batch->buf, batch->len, 0, (struct sockaddr *) &sa,
+			sizeof(sa)) == -1) {
+		close(fd);
+		return -1;
+	}
+
+	for (;;) {
+		if ((len = recv(fd, buf, sizeof(buf), 0)) <= 0) {
+			if (len == -1 && errno == EINTR)
+				continue;
+			close(fd);
+			return -1;
+		}
+
+		for (ret = (struct nlmsghdr *) buf; NLMSG_OK(ret, len);
+				ret = NLMSG_NEXT(ret, len)) {
+			if (ret->nlmsg_type != NLMSG_ERROR)
+				continue;
+
+			err = (struct nlmsgerr *) NLMSG_DATA(ret);
+
+			if (err->error < 0) {
+				fprintf(stderr, "=> nftables request %u: %s\n",
+					ret->nlmsg_seq, strerror(-err->error));
+				close(fd);
+				return -1;
+			}
+
+			if (ret->nlmsg_seq == batch->last_acked) {
+				close(fd);
+				return 0;
+			}
+		}
+	}
+}
+
+int nft_prepare_nat(const char *subnet, const char *bridge, const char *oface)
+{
+	struct nft_batch *batch;
+	struct nft_host *host;
+	struct _addr_t *addr;
+	struct nlattr *exprs;
+	int result, i;
+
+	if (!(host = calloc(1, sizeof(*host))))
+		printErr("malloc at nft_prepare_nat");
+
+	/* the forward chains of the host, and the accepts of a previous run */
+	if (host_dump(NFT_MSG_GETCHAIN, host) == -1
+			|| host_dump(NFT_MSG_GETRULE, host) == -1) {
+		free(host);
+		return -1;
+	}
+
+	if (!(batch = malloc(sizeof(*batch))))
+		printErr("malloc at nft_prepare_nat");
+
+	batch->len = 0;
+	batch->msg = NULL;
+	batch->seq = time(NULL);
+
+	msg_begin(batch, NFNL_MSG_BATCH_BEGIN, 0, AF_UNSPEC);
+
+	/* replace the table as a whole */
+	msg_table(batch, NFT_MSG_NEWTABLE, NLM_F_CREATE);
+	msg_table(batch, NFT_MSG_DELTABLE, 0);
+	msg_table(batch, NFT_MSG_NEWTABLE, NLM_F_CREATE);
+
+	msg_chain(batch, "postrouting", "nat", NF_INET_POST_ROUTING,
+		NF_IP_PRI_NAT_SRC);
+
+	addr = _init_addr(subnet);
+	exprs = msg_rule(batch, NFPROTO_IPV4, NFT_TABLE, "postrouting", 0);
+	expr_saddr(batch, addr->addr, addr->mask);
+	expr_ifname(batch, NFT_META_OIFNAME, oface);
+	expr_masq(batch);
+	nest_end(batch, exprs);
+	_free_addr(addr);
+
+	/* and the accepts in the chains of the host */
+	for (i = 0; i < host->n_tagged; ++i)
+		msg_delrule(batch, &host->tagged[i]);
+
+	for (i = 0; i < host->n_chains; ++i) {
+		host_accept(batch, &host->chains[i], bridge, oface);
+		host_accept(batch, &host->chains[i], oface, bridge);
+	}
+
+	msg_begin(batch, NFNL_MSG_BATCH_END, 0, AF_UNSPEC);
+
+	result = batch_commit(batch);
+	free(batch);
+	free(host);
+
+	return result;
+}
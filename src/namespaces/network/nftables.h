@@ -0,0 +1,50 @@
+/**
+ * nftables backend.
+ *
+ * libiptc reads the whole table of the host from the kernel, appends an
+ * entry and writes the whole table back, once per rule: its cost grows
+ * with every rule of the host. The masquerading of the containers is
+ * instead kept in a table of its own, NFT_TABLE, written with a single
+ * atomic nfnetlink batch:
+ *
+ *   table ip mydocker {
+ *       chain postrouting {
+ *           type nat hook postrouting priority 100;
+ *           ip saddr <subnet> oifname <oface> masquerade
+ *       }
+ *   }
+ *
+ * A forwarded packet must be accepted by every base chain of the forward
+ * hook, an accept of our own table would not get it through the filter
+ * FORWARD chain of a host whose policy is drop (Docker, firewalld). The
+ * same batch inserts first in each forward chain of the ip and inet
+ * tables of the host:
+ *
+ *   iifname <bridge> oifname <oface> accept comment "mydocker"
+ *   iifname <oface> oifname <bridge> accept comment "mydocker"
+ *
+ * The batch creates, deletes and creates the table again, and deletes
+ * the rules commented "mydocker" of a previous run: everything is replaced
+ * as a whole, however it was left. The chains and those rules are the
+ * only things of the host read, with one dump each.
+ *
+ * The FORWARD chain of the legacy iptables (x_tables) is out of reach of
+ * nf_tables: the accepts also go there through libiptc when its filter
+ * table is loaded (see network.c).
+ */
+#ifndef NFTABLES_H
+#define NFTABLES_H
+
+#define NFT_TABLE           "mydocker"
+#define NFT_BATCH_SIZE      16384
+#define NFT_DUMP_SIZE       65536   /* a read of a dump of the host */
+#define NFT_MAX_HOST_CHAINS 16      /* forward chains of the host */
+#define NFT_MAX_TAGGED      64      /* accepts left by previous runs */
+
+/* Install the masquerading of subnet, "a.b.c.d/len", leaving through
+ * oface and accept the forwarding between bridge and oface in the forward
+ * chains of the host. Returns 0, or -1 if the kernel has no nf_tables,
+ * nothing is installed then. */
+int nft_prepare_nat(const char *subnet, const char *bridge, const char *oface);
+
+#endif //NFTABLES_H
@@ -14,21 +14,61 @@
 #include <sys/mman.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <stdint.h>
 #include "runc.h"
 #include "../config.h"
 #include "helpers/helpers.h"
+#include "helpers/phases.h"
+#include "helpers/trace.h"
 #include "namespaces/user/user.h"
 #include "namespaces/mount/mount.h"
 #include "seccomp/seccomp_config.h"
+#include "seccomp/profiler.h"
+#include "seccomp/supervisor.h"
 #include "namespaces/cgroup/cgroup.h"
+#include "namespaces/cgroup/stats.h"
+#include "namespaces/cgroup/events.h"
+#include "namespaces/cgroup/tuner.h"
 #include "capabilities/capabilities.h"
 #include "namespaces/network/network.h"
-
+#include "zygote/zygote.h"
+#include "image/image.h"
+
+#ifndef CLONE_INTO_CGROUP
+#define CLONE_INTO_CGROUP 0x200000000ULL
+#endif
+
+/* struct clone_args of clone3(2), <linux/sched.h> cannot be included
+ * because its name clashes with our struct clone_args */
+struct clone3_args {
+    uint64_t flags;
+    uint64_t pidfd;
+    uint64_t child_tid;
+    uint64_t parent_tid;
+    uint64_t exit_signal;
+    uint64_t stack;
+    uint64_t stack_size;
+    uint64_t tls;
+    uint64_t set_tid;
+    uint64_t set_tid_size;
+    uint64_t cgroup;
+};
 
 int child_fn(void *args_par)
 {
     struct clone_args *args = (struct clone_args *) args_par;
+    const char *rootfs;
+    int listener;
     char ch;
+
+    /* taken by clone_child() */
+    funlockfile(stderr);
+    funlockfile(stdout);
+
+    if (args->notify_sock[0] != -1)
+        close(args->notify_sock[0]);
     
     if (args->has_userns) {
 	    /* We are the consumer*/
@@ -54,6 +94,8 @@ int child_fn(void *args_par)
     /* setting new hostname */
     set_container_hostname();
 
+    phase_begin(PHASE_ROOTFS);
+
     /* Be sure umount events are not propagated to the host. */
     if(mount("","/","", MS_SLAVE | MS_REC, "") == -1)
 	    printErr("mount failed");
@@ -66,17 +108,9 @@ int child_fn(void *args_par)
     if (mount("", "/", "", MS_PRIVATE, "") == 1)
 	    printErr("mount-MS_PRIVATE");
  
-   /* Ensure that 'new_root' is a mount point. 
-    * By default, when a directory is bind mounted, only that directory is
-    * mounted; if there are any submounts under the directory tree, they
-    * are not bind mounted.  If the MS_REC flag is also specified, then a
-    * recursive bind mount operation is performed: all submounts under the
-    * source subtree (other than unbindable mounts) are also bind mounted
-    * at the corresponding location in the target subtree.*/
-    if (mount(FILE_SYSTEM_PATH,FILE_SYSTEM_PATH,
-            "bind",
-            MS_BIND | MS_REC, "") == -1)
-	    printErr("mount-MS_BIND");
+   /* 'new_root' is a private overlay of the shared root_fs, it is a
+    * mount point as required by pivot_root (see mount.h) */
+    rootfs = mount_rootfs(args->lowerdir);
 
    /* Actually it is needed to mount everything we need before unmounting
     * the old root. This is because it is not allowed to mount a fs in an
@@ -86,20 +120,37 @@ int child_fn(void *args_par)
     * but if we detach the old root we lost them, being not able to mount
     * anything.
     */
-    prepare_rootfs(args->has_userns);
+    prepare_rootfs(args->has_userns, rootfs);
+
+    phase_end(PHASE_ROOTFS);
+    phase_begin(PHASE_PIVOT_ROOT);
 
     /* mounting the new container file system */
-    perform_pivot_root(args->has_userns);
+    perform_pivot_root(args->has_userns, rootfs);
 
     prepare_dev_fd();
 
+    phase_end(PHASE_PIVOT_ROOT);
+
+    /* a pooled child parks here until the zygote hands it a command */
+    if (args->zygote_fd != -1)
+        zygote_wait_command(args);
+
    /* The root user inside the container must have less privileges than
     * the real host root, so drop some capablities */
     //drop_caps();
 
-    /* disallowing system calls using seccomp */
-    //sys_filter();
+    /* disallowing system calls using seccomp, the program has been
+     * compiled by the parent (see seccomp_config.h) */
+    phase_begin(PHASE_SECCOMP);
+    if (args->traced)
+        profiler_traceme();
+    if (args->filter && (listener = sys_filter_load(args->filter)) != -1)
+        supervisor_send_listener(args->notify_sock[1], listener);
+    phase_end(PHASE_SECCOMP);
       
+    phase_begin(PHASE_EXEC);
+
     if (execvp(args->command[0], args->command) != 0)
         printErr("command exec failed");
 
@@ -108,20 +159,40 @@ abort:
     exit(EXIT_FAILURE);
 }
 
-void runc(struct runc_args *runc_arguments)
+/* Allocate a fresh stack and clone the containered process. When a user
+ * namespace is requested the child is left blocked until
+ * map_child_user() has been called. */
+static pid_t do_clone_child(struct clone_args *args, int clone_flags)
 {
-
     pid_t child_pid;
     void *child_stack;
-    char *uid_map = NULL;
-    char *gid_map = NULL;
-    struct clone_args args;
 
-    args.command = runc_arguments->child_entrypoint;
-    args.command_size = runc_arguments->child_entrypoint_size;
-    args.has_userns = runc_arguments->has_userns;
+    /* On cgroup v2 the child is created directly inside its cgroup:
+     * there is no tasks file to write and no migration afterwards. No
+     * stack is given to clone3() so the child runs on a copy of ours,
+     * exactly like fork(). */
+    if (args->resources && args->resources->cgroup_fd != -1) {
+        struct clone3_args cl_args;
 
-    print_running_infos(&args);
+        if (args->has_userns
+                && (pipe2(args->sync_uid_gid_map_fd, O_CLOEXEC) == -1))
+            printErr("pipe");
+
+        if (args->has_userns)
+            clone_flags |= CLONE_NEWUSER;
+
+        memset(&cl_args, 0, sizeof(cl_args));
+        cl_args.flags = (uint64_t) (unsigned int) clone_flags | CLONE_INTO_CGROUP;
+        cl_args.exit_signal = SIGCHLD;
+        cl_args.cgroup = args->resources->cgroup_fd;
+
+        child_pid = syscall(SYS_clone3, &cl_args, sizeof(cl_args));
+
+        if (child_pid == 0)
+            exit(child_fn(args));
+
+        return child_pid;
+    }
 
     /* child stack allocation */
     child_stack = mmap(NULL, STACK_SIZE, PROT_READ | PROT_WRITE,
@@ -129,8 +200,6 @@ void runc(struct runc_args *runc_arguments)
 
     if (child_stack == MAP_FAILED)
         printErr("child stack allocation");
-    
-    printf("Booting up your container...\n\n");
 
     /*  We use a pipe to synchronize the parent and child, in order to 
         ensure that the parent sets the UID and GID maps before the child 
@@ -141,9 +210,114 @@ void runc(struct runc_args *runc_arguments)
         its capabilities if it performed an execve() with nonzero 
         user IDs (see the capabilities(7) man page for details of the 
         transformation of a process's capabilities during execve()). */
-    if (runc_arguments->has_userns && (pipe(args.sync_uid_gid_map_fd) == -1)) 
+    if (args->has_userns
+            && (pipe2(args->sync_uid_gid_map_fd, O_CLOEXEC) == -1))
         printErr("pipe");
 
+    /* CLONE_NEWUSER if required */
+    if (args->has_userns)
+	    clone_flags |= CLONE_NEWUSER;
+
+    child_pid = clone(child_fn, child_stack + STACK_SIZE,
+                        clone_flags | SIGCHLD, args);
+
+    /* the child runs on its own copy of the stack */
+    munmap(child_stack, STACK_SIZE);
+
+    return child_pid;
+}
+
+pid_t clone_child(struct clone_args *args, int clone_flags)
+{
+    pid_t child_pid;
+
+    prepare_rootfs_scratch();
+
+    /* the child sends the listener of its filter to the supervisor */
+    args->notify_sock[0] = args->notify_sock[1] = -1;
+    if (args->filter && args->filter->notify && socketpair(AF_UNIX,
+            SOCK_SEQPACKET | SOCK_CLOEXEC, 0, args->notify_sock) == -1)
+        printErr("seccomp socketpair");
+
+    /* The child only gets a copy of the calling thread: a stdio lock held
+     * by another thread at clone time would never be released in the
+     * child. Holding both of them across the clone makes the child their
+     * owner, child_fn() releases them. The malloc arenas get no such
+     * care and no fork handler runs for a raw clone: the child must not
+     * allocate before execvp(). */
+    flockfile(stdout);
+    flockfile(stderr);
+
+    child_pid = do_clone_child(args, clone_flags);
+
+    funlockfile(stderr);
+    funlockfile(stdout);
+
+    if (args->notify_sock[1] != -1) {
+        close(args->notify_sock[1]);
+        supervisor_watch(args->notify_sock[0]);
+    }
+
+    return child_pid;
+}
+
+/* We force a mapping of 0 1000 1, this means that in the child namespace there will
+ * be only UID 0. 
+ * Any call to setuid different from 0 fails because we does not specify
+ * any other UID in the child namespace.
+ * 
+ * Update the UID and GUI maps in the child (see user.h).
+ *    
+ * 1. The /proc/PID/uid_map file is owned by the user ID that created the
+ *    namespace, and is writeable only by that user. 
+ * 2. After the creation of a new user namespace, the uid_map file of one of
+ *    the processes in the namespace may be written to once to define the
+ *    mapping of user IDs in the new user namespace. An attempt to write
+ *    more than once to a uid_map file in a user namespace fails with the
+ *    error EPERM. Similar rules apply for gid_map files.
+ */
+void map_child_user(struct clone_args *args, pid_t child_pid)
+{
+    if (!args->has_userns)
+        return;
+
+    fprintf(stderr,"=> uid and gid mapping ...");
+
+    /* We are the producer*/
+    close(args->sync_uid_gid_map_fd[0]);
+    
+    map_uid_gid(child_pid); 
+
+    fprintf(stderr," done.\n");
+
+    /* Notify child that the mapping is done. */
+    close(args->sync_uid_gid_map_fd[1]);	
+}
+
+pid_t runc_start(struct runc_args *runc_arguments, struct clone_args *args)
+{
+    pid_t child_pid;
+    int exec_sync_fd[2] = { -1, -1 };
+    char ch;
+
+    args->command = runc_arguments->child_entrypoint;
+    args->command_size = runc_arguments->child_entrypoint_size;
+    args->has_userns = runc_arguments->has_userns;
+    args->resources = runc_arguments->resources;
+    args->zygote_fd = -1;
+
+    trace_container();
+
+    /* an index lookup, the child only mounts the layers */
+    args->lowerdir = image_resolve(runc_arguments->image);
+
+    /* compiled once, then mapped from the cache */
+    args->filter = runc_arguments->has_seccomp ? sys_filter_prepare() : NULL;
+    args->traced = runc_arguments->syscall_profile != NULL;
+
+    /* a warm pair, before anything is cloned */
+    net_pool_acquire(&args->net);
+
     /* 
     * Here we can specify the namespace we want by using the appropriate
     * flags
@@ -170,81 +344,103 @@ void runc(struct runc_args *runc_arguments)
     * created without root permissions, which means we can now drop the
     * sudo and run our program as a non-root user!
     */
-    int clone_flags =
-                CLONE_NEWNS  	|
-                CLONE_NEWUTS 	|
-                CLONE_NEWIPC 	|
-                CLONE_NEWPID 	|
-                CLONE_NEWNET;
+    int clone_flags = CONTAINER_CLONE_FLAGS;
     
     /* CLONE_NEWGROUP if required */
     if (runc_arguments->resources) {
         clone_flags |= CLONE_NEWCGROUP;
-        args.resources = runc_arguments->resources;
 
         /* apply resource limitations */
-        apply_cgroups(args.resources);
+        phase_begin(PHASE_CGROUP);
+        apply_cgroups(args->resources);
+        phase_end(PHASE_CGROUP);
     }
 
-    /* CLONE_NEWUSER if required */
-    if (runc_arguments->has_userns)
-	    clone_flags |= CLONE_NEWUSER;
+    /* the write end is closed by the execve() of the child */
+    if (phase_timing_get() && pipe2(exec_sync_fd, O_CLOEXEC) == -1)
+        printErr("exec sync pipe");
 
-    child_pid = clone(child_fn, child_stack + STACK_SIZE,
-                        clone_flags | SIGCHLD, &args);
+    phase_begin(PHASE_CLONE);
+    child_pid = clone_child(args, clone_flags);
+    phase_end(PHASE_CLONE);
 
     if (child_pid < 0) {
-        free_cgroup_resources();
+        free_cgroup_resources(args->resources);
         printErr("Unable to create child process");
     }
    
     /* Set up the network for the child. */
-    prepare_netns(child_pid);
-
-    /* We force a mapping of 0 1000 1, this means that in the child namespace there will
-     * be only UID 0. 
-     * Any call to setuid different from 0 fails because we does not specify
-     * any other UID in the child namespace.
-     * 
-     * Update the UID and GUI maps in the child (see user.h).
-     *    
-     * 1. The /proc/PID/uid_map file is owned by the user ID that created the
-     *    namespace, and is writeable only by that user. 
-     * 2. After the creation of a new user namespace, the uid_map file of one of
-     *    the processes in the namespace may be written to once to define the
-     *    mapping of user IDs in the new user namespace. An attempt to write
-     *    more than once to a uid_map file in a user namespace fails with the
-     *    error EPERM. Similar rules apply for gid_map files.
-     */
-
-    if (args.has_userns) {
-	    fprintf(stderr,"=> uid and gid mapping ...");
-
-	    /* We are the producer*/
-	    close(args.sync_uid_gid_map_fd[0]);
-	    
-	    map_uid_gid(child_pid); 
-
-	    fprintf(stderr," done.\n");
-
-	    /* Notify child that the mapping is done. */
-	    close(args.sync_uid_gid_map_fd[1]);	
+    phase_begin(PHASE_NETNS);
+    prepare_netns(child_pid, &args->net);
+    phase_end(PHASE_NETNS);
+
+    phase_begin(PHASE_UID_MAP);
+    map_child_user(args, child_pid);
+    phase_end(PHASE_UID_MAP);
+
+    if (exec_sync_fd[0] != -1) {
+        close(exec_sync_fd[1]);
+        while (read(exec_sync_fd[0], &ch, 1) == -1 && errno == EINTR)
+            ;
+        phase_end(PHASE_EXEC);
+        close(exec_sync_fd[0]);
     }
  
-    if (waitpid(child_pid, NULL, 0) == -1)
+    /* the child is already inside its cgroups and running */
+    leave_cgroups(args->resources);
+    stats_watch(args->resources, child_pid);
+    events_watch(args->resources, child_pid);
+    tuner_watch(args->resources, child_pid);
+
+    return child_pid;
+}
+
+void runc_finish(struct clone_args *args)
+{
+    trace_flush();
+
+    free(args->lowerdir);
+    args->lowerdir = NULL;
+
+    /* the last sample and events, before the slot goes to another
+     * container */
+    tuner_unwatch(args->resources);
+    events_unwatch(args->resources);
+    stats_unwatch(args->resources);
+
+    /* releasing the cgroup slot associated with the child process */
+    free_cgroup_resources(args->resources);
+
+    /* the veth pair goes back to the pool, warm */
+    net_pool_release(&args->net);
+}
+
+void runc(struct runc_args *runc_arguments)
+{
+    struct clone_args args;
+    pid_t child_pid;
+
+    args.command = runc_arguments->child_entrypoint;
+    args.command_size = runc_arguments->child_entrypoint_size;
+
+    print_running_infos(&args);
+
+    printf("Booting up your container...\n\n");
+
+    child_pid = runc_start(runc_arguments, &args);
+
+    if (runc_arguments->syscall_profile)
+        profiler_run(child_pid, runc_arguments->syscall_profile);
+    else if (waitpid(child_pid, NULL, 0) == -1)
         printErr("waitpid");
 
-    /* removing the cgroup folder associated with the child process */
-    free_cgroup_resources();
+    runc_finish(&args);
     fprintf(stdout, "\nContainer process terminated.\n");
 }
 
 void set_container_hostname()
 {
-    char *hostname = strdup(HOSTNAME);
-    int ret = sethostname(hostname, sizeof(hostname)+1);
-    
-    if (ret < 0)
+    if (sethostname(HOSTNAME, strlen(HOSTNAME)) < 0)
         printErr("hostname");
 }
 
@@ -1,5 +1,16 @@
+#ifndef RUNC_H
+#define RUNC_H
+
+#include "namespaces/network/network.h"
+
 #define STACK_SIZE (1024 * 1024)
 
+/* namespaces every container is cloned into (see runc()) */
+#define CONTAINER_CLONE_FLAGS   (CLONE_NEWNS | CLONE_NEWUTS | CLONE_NEWIPC | \
+                                 CLONE_NEWPID | CLONE_NEWNET)
+
+
+struct sys_filter;
 
 /* This structure identifies the runc arguments */
 struct runc_args {
@@ -7,6 +18,9 @@ struct runc_args {
     size_t child_entrypoint_size;   /* lenght of the child_entrypoint table */
     struct cgroup_args *resources;  /* cgroup support parameters */
     int has_userns;	        	    /* create new USERNS or not */
+    char *image;                    /* image of the store, NULL for root_fs */
+    int has_seccomp;                /* filter the syscalls of the container */
+    char *syscall_profile;          /* profile the syscalls to this file or NULL */
 };
 
 /* This structure identifies the child_fn arguments */
@@ -16,13 +30,39 @@ struct clone_args {
    size_t command_size;           /* lenght of the command table */
    struct cgroup_args *resources; /* cgroups resources limitations structure */
    int has_userns;         		  /* create new USERNS or not */
+   int zygote_fd;                 /* command channel of a pooled child or -1 */
+   char *lowerdir;                /* overlay lower layers of the rootfs */
+   const struct sys_filter *filter; /* seccomp program or NULL */
+   int notify_sock[2];            /* seccomp listener to the supervisor */
+   int traced;                    /* traced by the syscall profiler */
+   struct net_lease net;          /* veth pair of the container */
 };
 
+/* entrypoint of the cloned process */
+int child_fn(void *args_par);
+
+/* clone a new containered process running child_fn */
+pid_t clone_child(struct clone_args *args, int clone_flags);
+
+/* write the uid/gid maps of a child cloned with a user namespace */
+void map_child_user(struct clone_args *args, pid_t child_pid);
+
 /* create and run a new containered process */
 void runc(struct runc_args *runc_arguments);
 
+/* Set up and start a new containered process without waiting for it.
+ * args is filled for the matching runc_finish(). Each container takes its
+ * own veth pair from the pool, so containers can be started concurrently
+ * by different threads. */
+pid_t runc_start(struct runc_args *runc_arguments, struct clone_args *args);
+
+/* release what runc_start() acquired, once the child has been reaped */
+void runc_finish(struct clone_args *args);
+
 /* set your new hostname */
 void set_container_hostname();
 
 /* print the container pid and command name */
 void print_running_infos(struct clone_args *args);
+
+#endif //RUNC_H
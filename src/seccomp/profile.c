@@ -0,0 +1,215 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <seccomp.h>
+#include "profile.h"
+#include "../helpers/helpers.h"
+
+/* parse an action, returns -1 if it is not one */
+static int parse_action(const char *token, uint32_t *action)
+{
+	char *end;
+	long err;
+
+	if (!strcmp(token, "allow")) {
+		*action = SCMP_ACT_ALLOW;
+	} else if (!strcmp(token, "log")) {
+		*action = SCMP_ACT_LOG;
+	} else if (!strcmp(token, "kill")) {
+		*action = SCMP_ACT_KILL;
+	} else if (!strcmp(token, "notify")) {
+		*action = SCMP_ACT_NOTIFY;
+	} else if (!strcmp(token, "errno")) {
+		*action = SCMP_ACT_ERRNO(EPERM);
+	} else if (!strncmp(token, "errno:", 6)) {
+		err = strtol(token + 6, &end, 10);
+		if (*end != '\0' || err < 1 || err > 4095)
+			return -1;
+		*action = SCMP_ACT_ERRNO(err);
+	} else {
+		return -1;
+	}
+
+	return 0;
+}
+
+static void profile_error(const char *path, int line, const char *msg)
+{
+	fprintf(stderr, "=> %s:%d: %s\n", path, line, msg);
+	exit(EXIT_FAILURE);
+}
+
+static void profile_add(struct seccomp_profile *profile,
+	const struct seccomp_rule *rule)
+{
+	if (profile->n_rules == PROFILE_MAX_RULES) {
+		fprintf(stderr, "=> more than %d seccomp rules\n",
+			PROFILE_MAX_RULES);
+		exit(EXIT_FAILURE);
+	}
+
+	profile->rules = realloc(profile->rules,
+		(profile->n_rules + 1) * sizeof(struct seccomp_rule));
+	if (!profile->rules)
+		printErr("realloc at profile_add");
+
+	profile->rules[profile->n_rules++] = *rule;
+}
+
+void profile_load(struct seccomp_profile *profile, const char *path)
+{
+	char line[PROFILE_MAX_LINE];
+	char *token[5], *saveptr, *end;
+	struct seccomp_rule rule;
+	int n_tokens, n_line = 0;
+	FILE *file;
+
+	memset(profile, 0, sizeof(*profile));
+	profile->default_action = SCMP_ACT_ALLOW;
+
+	if (!(file = fopen(path, "r")))
+		printErr("open seccomp profile");
+
+	while (fgets(line, sizeof(line), file)) {
+		++n_line;
+
+		if (!strchr(line, '\n') && !feof(file))
+			profile_error(path, n_line, "line too long");
+
+		/* comments can also follow a rule */
+		if ((end = strchr(line, '#')))
+			*end = '\0';
+
+		n_tokens = 0;
+		token[0] = strtok_r(line, " \t\r\n", &saveptr);
+		while (token[n_tokens] && n_tokens < 4)
+			token[++n_tokens] = strtok_r(NULL, " \t\r\n", &saveptr);
+
+		if (n_tokens == 0)
+			continue;
+
+		if (n_tokens == 4 && token[4])
+			profile_error(path, n_line, "too many fields");
+
+		if (!strcmp(token[0], "layout")) {
+			if (n_tokens == 2 && !strcmp(token[1], "tree"))
+				profile->layout = LAYOUT_TREE;
+			else if (n_tokens == 2 && !strcmp(token[1], "priority"))
+				profile->layout = LAYOUT_PRIORITY;
+			else
+				profile_error(path, n_line, "invalid layout");
+			continue;
+		}
+
+		if (!strcmp(token[0], "default")) {
+			if (n_tokens != 2
+			    || parse_action(token[1], &profile->default_action))
+				profile_error(path, n_line, "invalid default action");
+			continue;
+		}
+
+		if (n_tokens != 2 && n_tokens != 4)
+			profile_error(path, n_line,
+				"expected <action> <syscall> [<arg> <mask>]");
+
+		if (parse_action(token[0], &rule.action))
+			profile_error(path, n_line, "invalid action");
+
+		/* Pseudo syscall numbers of the syscalls missing on this
+		 * architecture are negative but valid, libseccomp skips them. */
+		rule.syscall = seccomp_syscall_resolve_name(token[1]);
+		if (rule.syscall == __NR_SCMP_ERROR)
+			profile_error(path, n_line, "unknown syscall");
+
+		rule.arg = RULE_ANY_ARG;
+		rule.mask = 0;
+
+		/* the order of the file, only used by LAYOUT_PRIORITY */
+		rule.priority = profile->n_rules < UINT8_MAX
+			? UINT8_MAX - profile->n_rules : 0;
+
+		if (n_tokens == 4) {
+			rule.arg = strtol(token[2], &end, 10);
+			if (*end != '\0' || rule.arg < 0 || rule.arg > 5)
+				profile_error(path, n_line, "argument index not in [0-5]");
+
+			errno = 0;
+			rule.mask = strtoull(token[3], &end, 0);
+			if (*end != '\0' || errno || rule.mask == 0)
+				profile_error(path, n_line, "invalid mask");
+		}
+
+		profile_add(profile, &rule);
+	}
+
+	if (ferror(file))
+		printErr("read seccomp profile");
+
+	fclose(file);
+
+	profile_dedup(profile);
+}
+
+void profile_from_rules(struct seccomp_profile *profile,
+	uint32_t default_action, const struct seccomp_rule *rules,
+	size_t n_rules)
+{
+	memset(profile, 0, sizeof(*profile));
+	profile->default_action = default_action;
+	profile->layout = LAYOUT_TREE;
+
+	for (size_t i = 0; i < n_rules; ++i)
+		profile_add(profile, &rules[i]);
+
+	profile_dedup(profile);
+}
+
+/* the match of a rule, the action is not part of it */
+static int compare_rule(const void *a, const void *b)
+{
+	const struct seccomp_rule *x = a, *y = b;
+
+	if (x->syscall != y->syscall)
+		return (x->syscall > y->syscall) - (x->syscall < y->syscall);
+	if (x->arg != y->arg)
+		return (x->arg > y->arg) - (x->arg < y->arg);
+	return (x->mask > y->mask) - (x->mask < y->mask);
+}
+
+void profile_dedup(struct seccomp_profile *profile)
+{
+	size_t n = 0;
+
+	if (profile->n_rules == 0)
+		return;
+
+	qsort(profile->rules, profile->n_rules, sizeof(struct seccomp_rule),
+		compare_rule);
+
+	for (size_t i = 1; i < profile->n_rules; ++i) {
+		if (compare_rule(&profile->rules[n], &profile->rules[i])) {
+			profile->rules[++n] = profile->rules[i];
+			continue;
+		}
+
+		if (profile->rules[n].action != profile->rules[i].action) {
+			fprintf(stderr, "=> conflicting seccomp rules for %s\n",
+				seccomp_syscall_resolve_num_arch(SCMP_ARCH_NATIVE,
+					profile->rules[i].syscall));
+			exit(EXIT_FAILURE);
+		}
+
+		if (profile->rules[i].priority > profile->rules[n].priority)
+			profile->rules[n].priority = profile->rules[i].priority;
+	}
+
+	profile->n_rules = n + 1;
+}
+
+void profile_free(struct seccomp_profile *profile)
+{
+	free(profile->rules);
+	memset(profile, 0, sizeof(*profile));
+}
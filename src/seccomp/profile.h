@@ -0,0 +1,77 @@
+/**
+ * Seccomp profiles.
+ *
+ * A profile is the list of rules compiled into the syscall filter. The
+ * built-in one is in seccomp_config.c, others are read from a text file
+ * with one rule per line:
+ *
+ *   # comment
+ *   default allow
+ *   errno     ptrace
+ *   errno:38  kexec_load
+ *   errno     chmod 1 0x800
+ *   kill      reboot
+ *
+ * "default <action>" sets what happens to the syscalls not listed. Then
+ * comes a rule: an action, a syscall name and optionally an argument
+ * index with a mask. A rule with a mask only matches when all the bits of
+ * the mask are set in that argument. The actions are allow, log, kill,
+ * errno (EPERM, or the given errno) and notify (the supervisor of the
+ * parent decides, see supervisor.h).
+ *
+ * The rules are sorted by syscall and deduplicated: the same rule listed
+ * twice is kept once, while the same match with two different actions is
+ * an error.
+ *
+ * "layout <tree|priority>" chooses how the filter is laid out. By default
+ * the syscalls are found with a binary search on their number. With
+ * "priority" they are checked one after the other in the order of the
+ * file: the first rules should be the most frequent syscalls, like in the
+ * allowlists generated by the syscall profiler (see profiler.h).
+ */
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define PROFILE_MAX_RULES   1024
+#define PROFILE_MAX_LINE    256
+
+/* the rule matches any call */
+#define RULE_ANY_ARG        -1
+
+enum profile_layout {
+	LAYOUT_TREE,                /* binary search on the syscall number */
+	LAYOUT_PRIORITY,            /* linear, by decreasing priority */
+};
+
+struct seccomp_rule {
+	int syscall;                /* number on the native architecture */
+	uint32_t action;            /* SCMP_ACT_* */
+	int arg;                    /* compared argument or RULE_ANY_ARG */
+	uint64_t mask;              /* bits that must be set in arg */
+	uint8_t priority;           /* LAYOUT_PRIORITY: higher is checked first */
+};
+
+struct seccomp_profile {
+	uint32_t default_action;
+	enum profile_layout layout;
+	struct seccomp_rule *rules;
+	size_t n_rules;
+};
+
+/* load the profile at path, exits on a malformed file */
+void profile_load(struct seccomp_profile *profile, const char *path);
+
+/* a profile holding a copy of n_rules rules */
+void profile_from_rules(struct seccomp_profile *profile,
+	uint32_t default_action, const struct seccomp_rule *rules,
+	size_t n_rules);
+
+/* sort the rules by syscall and drop the duplicates */
+void profile_dedup(struct seccomp_profile *profile);
+
+void profile_free(struct seccomp_profile *profile);
+
+#endif //PROFILE_H
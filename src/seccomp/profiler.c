@@ -0,0 +1,169 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/ptrace.h>
+#include <sys/wait.h>
+#include <seccomp.h>
+#include "profiler.h"
+#include "../helpers/helpers.h"
+
+#define PTRACE_OPTIONS  (PTRACE_O_TRACESECCOMP | PTRACE_O_TRACEFORK | \
+                         PTRACE_O_TRACEVFORK | PTRACE_O_TRACECLONE | \
+                         PTRACE_O_TRACEEXEC | PTRACE_O_EXITKILL)
+
+struct syscall_count {
+	int nr;
+	unsigned long count;
+};
+
+void profiler_traceme()
+{
+	if (ptrace(PTRACE_TRACEME, 0, NULL, NULL) == -1)
+		printErr("ptrace traceme");
+
+	/* wait for the parent to set the options */
+	if (raise(SIGSTOP))
+		printErr("raise SIGSTOP");
+}
+
+static int compare_count(const void *a, const void *b)
+{
+	const struct syscall_count *x = a, *y = b;
+
+	if (x->count != y->count)
+		return (x->count < y->count) - (x->count > y->count);
+	return (x->nr > y->nr) - (x->nr < y->nr);
+}
+
+/* the allowlist, most frequent syscalls first */
+static void profiler_write(const char *path, const unsigned long *counts)
+{
+	struct syscall_count used[PROFILER_MAX_SYSCALLS];
+	unsigned long total = 0;
+	int n_used = 0;
+	char *name;
+	FILE *out;
+
+	for (int nr = 0; nr < PROFILER_MAX_SYSCALLS; ++nr) {
+		if (!counts[nr])
+			continue;
+
+		used[n_used].nr = nr;
+		used[n_used].count = counts[nr];
+		total += counts[nr];
+		++n_used;
+	}
+
+	qsort(used, n_used, sizeof(*used), compare_count);
+
+	if (!(out = fopen(path, "w")))
+		printErr("open syscall profile");
+
+	fprintf(out, "# allowlist of %d syscalls, %lu calls traced\n",
+		n_used, total);
+	fprintf(out, "layout priority\n");
+	fprintf(out, "default errno\n");
+
+	for (int i = 0; i < n_used; ++i) {
+		name = seccomp_syscall_resolve_num_arch(SCMP_ARCH_NATIVE,
+			used[i].nr);
+
+		if (!name) {
+			fprintf(stderr, "=> unknown syscall %d skipped\n", used[i].nr);
+			continue;
+		}
+
+		fprintf(out, "allow %-24s # %lu\n", name, used[i].count);
+		free(name);
+	}
+
+	if (fclose(out))
+		printErr("write syscall profile");
+
+	fprintf(stderr, "=> %d syscalls written to %s\n", n_used, path);
+}
+
+/* count the syscall a tracee is stopped on */
+static void profiler_count(pid_t pid, unsigned long *counts)
+{
+	struct __ptrace_syscall_info info;
+
+	if (ptrace(PTRACE_GET_SYSCALL_INFO, pid, sizeof(info), &info) == -1) {
+		/* killed while stopped */
+		if (errno == ESRCH)
+			return;
+		printErr("ptrace get_syscall_info");
+	}
+
+	if (info.op != PTRACE_SYSCALL_INFO_SECCOMP
+	    || info.arch != seccomp_arch_native())
+		return;
+
+	if (info.seccomp.nr < PROFILER_MAX_SYSCALLS)
+		++counts[info.seccomp.nr];
+}
+
+int profiler_run(pid_t child_pid, const char *path)
+{
+	unsigned long *counts;
+	int child_status = 0;
+	int traced = 0;
+	int status, sig;
+	pid_t pid;
+
+	if (!(counts = calloc(PROFILER_MAX_SYSCALLS, sizeof(*counts))))
+		printErr("calloc at profiler_run");
+
+	fprintf(stderr, "=> profiling the syscalls of %ld\n", (long) child_pid);
+
+	/* every descendant of the container is traced too */
+	for (;;) {
+		if ((pid = waitpid(-1, &status, __WALL)) == -1) {
+			if (errno == EINTR)
+				continue;
+			if (errno == ECHILD)
+				break;
+			printErr("waitpid");
+		}
+
+		if (WIFEXITED(status) || WIFSIGNALED(status)) {
+			if (pid == child_pid)
+				child_status = status;
+			continue;
+		}
+
+		if (!WIFSTOPPED(status))
+			continue;
+
+		sig = 0;
+
+		if (status >> 8 == (SIGTRAP | (PTRACE_EVENT_SECCOMP << 8))) {
+			profiler_count(pid, counts);
+		} else if (status >> 16) {
+			/* fork, clone, exec: the new tracees stop on their own */
+		} else if (WSTOPSIG(status) == SIGSTOP) {
+			/* Stopped by profiler_traceme() or the first stop of a new
+			 * tracee. A SIGSTOP sent by the workload is dropped too. */
+			if (pid == child_pid && !traced) {
+				if (ptrace(PTRACE_SETOPTIONS, pid, NULL,
+				           PTRACE_OPTIONS) == -1)
+					printErr("ptrace setoptions");
+				traced = 1;
+			}
+		} else {
+			sig = WSTOPSIG(status);
+		}
+
+		if (ptrace(PTRACE_CONT, pid, NULL, sig) == -1 && errno != ESRCH)
+			printErr("ptrace cont");
+	}
+
+	profiler_write(path, counts);
+	free(counts);
+
+	return child_status;
+}
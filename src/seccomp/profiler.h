@@ -0,0 +1,35 @@
+/**
+ * Syscall profiler.
+ *
+ * Runs a container with a filter returning SCMP_ACT_TRACE for every
+ * syscall (see sys_filter_set_trace()) and counts the syscalls of the
+ * entrypoint and of all its descendants:
+ *
+ *   child:  pivot_root -> PTRACE_TRACEME, SIGSTOP -> filter -> execve ...
+ *   parent:               PTRACE_SETOPTIONS, then every syscall stops the
+ *                         caller with PTRACE_EVENT_SECCOMP: count, resume
+ *
+ * Once the container terminates the counts are written as an allowlist
+ * profile (see profile.h): everything else fails with EPERM, and the
+ * syscalls are listed from the most to the least frequent with the
+ * priority layout, so the hot ones are checked first by the filter.
+ *
+ * A run only sees the code paths the entrypoint took: the profile should
+ * come from a representative workload.
+ */
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <sys/types.h>
+
+#define PROFILER_MAX_SYSCALLS   1024    /* counted syscall numbers */
+
+/* in the child, before the filter: let the parent trace us */
+void profiler_traceme();
+
+/* Trace the container child_pid until it terminates and write the
+ * allowlist of the syscalls it used to path.
+ * Returns the wait status of child_pid. */
+int profiler_run(pid_t child_pid, const char *path);
+
+#endif //PROFILER_H
@@ -1,147 +1,360 @@
 #define _GNU_SOURCE
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
 #include <seccomp.h>
+#include <linux/seccomp.h>
 #include <sched.h>
 #include <sys/ioctl.h>
 #include <errno.h>
 #include "./seccomp_config.h"
+#include "profile.h"
+#include "../helpers/helpers.h"
+#include "../helpers/sha256.h"
+#include "../../config.h"
 
-void sys_filter()
+/* The built-in profile, used when no profile file is given.
+ *
+ * - action : what happens to the thread calling a syscall matching the rule.
+ *            SCMP_ACT_ERRNO(EPERM) causes a Permission Denied error.
+ *
+ * - syscall : While it is possible to specify the syscall value directly using
+ *             the standard __NR_syscall values, in order to ensure proper
+ *             operation across multiple architectures it is highly recommended
+ *             to use the SCMP_SYS() macro instead.
+ *
+ * - arg, mask : used to filter a syscall based on its argument. The rule only
+ *               matches when the bits of mask are all set in the argument at
+ *               index arg. For chmod, arg 1 is the mode and the masks are:
+ *                   S_ISUID: set effective user id of the process
+ *                   S_ISGID: set effective group id of the process
+ *
+ * mount is not denied by the filter itself: the supervisor only allows the
+ * tmpfs mounts of its policy (see supervisor.c).
+ */
+#define DENY(name) \
+	{ SCMP_SYS(name), SCMP_ACT_ERRNO(EPERM), RULE_ANY_ARG, 0 }
+#define DENY_MASK(name, arg, mask) \
+	{ SCMP_SYS(name), SCMP_ACT_ERRNO(EPERM), (arg), (mask) }
+#define NOTIFY(name) \
+	{ SCMP_SYS(name), SCMP_ACT_NOTIFY, RULE_ANY_ARG, 0 }
+
+static const struct seccomp_rule default_rules[] = {
+	DENY_MASK(chmod, 1, S_ISUID),
+	DENY_MASK(chmod, 1, S_ISGID),
+	DENY_MASK(fchmod, 1, S_ISUID),
+	DENY_MASK(fchmod, 1, S_ISGID),
+	DENY_MASK(fchmodat, 2, S_ISUID),
+	DENY_MASK(fchmodat, 2, S_ISGID),
+	DENY_MASK(unshare, 0, CLONE_NEWUSER),
+	DENY_MASK(clone, 0, CLONE_NEWUSER),
+	DENY_MASK(ioctl, 1, TIOCSTI),
+	/* From docker default seccomp policies */
+	DENY(acct),
+	DENY(add_key),
+	DENY(adjtimex),
+	DENY(bpf),
+	DENY(clock_adjtime),
+	DENY(clock_settime),
+	DENY(create_module),
+	DENY(delete_module),
+	DENY(finit_module),
+	DENY(get_kernel_syms),
+	DENY(get_mempolicy),
+	DENY(init_module),
+	DENY(ioperm),
+	DENY(iopl),
+	DENY(kcmp),
+	DENY(kexec_file_load),
+	DENY(kexec_load),
+	DENY(keyctl),
+	DENY(lookup_dcookie),
+	DENY(mbind),
+	NOTIFY(mount),
+	DENY(move_pages),
+	DENY(name_to_handle_at),
+	DENY(nfsservctl),
+	DENY(open_by_handle_at),
+	DENY(perf_event_open),
+	DENY(personality),
+	DENY(pivot_root),
+	DENY(process_vm_readv),
+	DENY(process_vm_writev),
+	DENY(ptrace),
+	DENY(query_module),
+	DENY(quotactl),
+	DENY(reboot),
+	DENY(request_key),
+	DENY(set_mempolicy),
+	DENY(setns),
+	DENY(settimeofday),
+	DENY(socket),
+	DENY(stime),
+	DENY(swapon),
+	DENY(swapoff),
+	DENY(sysfs),
+	DENY(_sysctl),
+	DENY(umount),
+	DENY(umount2),
+	DENY(unshare),
+	DENY(uselib),
+	DENY(userfaultfd),
+	DENY(ustat),
+	DENY(vm86),
+	DENY(vm86old),
+};
+
+#define N_DEFAULT_RULES (sizeof(default_rules) / sizeof(*default_rules))
+
+/* SCMP_ACT_ALLOW : The seccomp filter will have no effect on the thread
+ *                  calling the syscall if it does not match any of the
+ *                  configured seccomp filter rules. */
+#define DEFAULT_ACTION SCMP_ACT_ALLOW
+
+static pthread_once_t filter_once = PTHREAD_ONCE_INIT;
+static struct sys_filter filter;
+static const char *profile_path = NULL;
+static int trace_all = 0;
+static struct seccomp_profile profile;
+
+void sys_filter_set_profile(const char *path)
+{
+	profile_path = path;
+}
+
+void sys_filter_set_trace()
+{
+	trace_all = 1;
+}
+
+/* the cache key: everything the compiled program depends on */
+static void sys_filter_hash(char *hex)
+{
+	const struct scmp_version *version = seccomp_version();
+	struct sha256_ctx ctx;
+	uint32_t word;
+	uint64_t mask;
+
+	sha256_init(&ctx);
+
+	word = seccomp_arch_native();
+	sha256_update(&ctx, &word, sizeof(word));
+	sha256_update(&ctx, version, sizeof(*version));
+
+	word = SECCOMP_OPTIMIZE;
+	sha256_update(&ctx, &word, sizeof(word));
+	word = profile.layout;
+	sha256_update(&ctx, &word, sizeof(word));
+	word = profile.default_action;
+	sha256_update(&ctx, &word, sizeof(word));
+
+	/* field by field, the padding of the rules is not hashed */
+	for (size_t i = 0; i < profile.n_rules; ++i) {
+		word = profile.rules[i].syscall;
+		sha256_update(&ctx, &word, sizeof(word));
+		word = profile.rules[i].action;
+		sha256_update(&ctx, &word, sizeof(word));
+		word = profile.rules[i].arg;
+		sha256_update(&ctx, &word, sizeof(word));
+		mask = profile.rules[i].mask;
+		sha256_update(&ctx, &mask, sizeof(mask));
+		word = profile.rules[i].priority;
+		sha256_update(&ctx, &word, sizeof(word));
+	}
+
+	sha256_final_hex(&ctx, hex);
+}
+
+/* the priority of a syscall is the highest one of its rules, which are
+ * next to each other starting from rule first */
+static uint8_t syscall_priority(size_t first)
 {
+	uint8_t priority = 0;
 
+	for (size_t i = first; i < profile.n_rules
+	        && profile.rules[i].syscall == profile.rules[first].syscall; ++i) {
+		if (profile.rules[i].priority > priority)
+			priority = profile.rules[i].priority;
+	}
+
+	return priority;
+}
+
+/* compile the rules with libseccomp and write the BPF program to fd */
+static void sys_filter_compile(int fd)
+{
+	const struct seccomp_rule *rule;
 	scmp_filter_ctx ctx;
+	struct scmp_arg_cmp cmp;
+	int err = 0;
 
-	/* Intialize filter contex.
-	 *
-	 * - SCMP_ACT_ALLOW : The seccomp filter will have no effect on the thread calling
-	 *                    the syscall if it does not match any of the configured seccomp
-	 *                    filter rules.       
-	 */
-	ctx = seccomp_init(SCMP_ACT_ALLOW);
+	ctx = seccomp_init(profile.default_action);
 
 	if (ctx == NULL) {
 		fprintf(stderr,"=> ERR: seccomp_init.\n");
-		seccomp_release(ctx);
 		exit(EXIT_FAILURE);
 	}
 
-	/*
-	 * - ctx : the context of the filter
-	 *
-	 * - SCMP_ACT_ERRNO(EPERM) : action field, The process will be killed by the kernel when it calls a
-     *     			     syscall that matches the filter rule.
-	 *
-	 * - SCMP_SYS(syscall_name) : While it is possible to specify the syscall value directly using the
-     *        		      standard __NR_syscall values, in order to ensure proper operation
-     *                            across multiple architectures it is highly recommended to use the
-     *                            SCMP_SYS() macro instead.
-     *
-	 * - 1 : arg_cont
-	 *
-	 * - SCMP_A1 : used to filter syscall based on its argument. A_1 means that it is referring to a specific
-	 *             argument, in this case the one at index 1 (the second one). In the case of chmod it is 
-	 *             referring to the mode option:
-	 *             				S_ISUID: set effective user id of the process 
-	 *             				S_ISGID: set effective group id of the process
-	 */
-
-	//SCMP_ACT_ERRNO(EPERM) The effect of SCMP_ACT_ERRNO is to cause a Permission Denied error
-	
-	if (!(
-	         seccomp_rule_add(ctx, SCMP_ACT_ERRNO(EPERM), SCMP_SYS(chmod), 1,
-			 					SCMP_A1(SCMP_CMP_MASKED_EQ, S_ISUID, S_ISUID))
-	      || seccomp_rule_add(ctx, SCMP_ACT_ERRNO(EPERM), SCMP_SYS(chmod), 1,
-		  						SCMP_A1(SCMP_CMP_MASKED_EQ, S_ISGID, S_ISGID))
-	      || seccomp_rule_add(ctx, SCMP_ACT_ERRNO(EPERM), SCMP_SYS(fchmod), 1,
-		  						SCMP_A1(SCMP_CMP_MASKED_EQ, S_ISUID, S_ISUID))
-	      || seccomp_rule_add(ctx, SCMP_ACT_ERRNO(EPERM), SCMP_SYS(fchmod), 1,
-		  						SCMP_A1(SCMP_CMP_MASKED_EQ, S_ISGID, S_ISGID))
-	      || seccomp_rule_add(ctx, SCMP_ACT_ERRNO(EPERM), SCMP_SYS(fchmodat), 1,
-		  						SCMP_A2(SCMP_CMP_MASKED_EQ, S_ISUID, S_ISUID))
-	      || seccomp_rule_add(ctx, SCMP_ACT_ERRNO(EPERM), SCMP_SYS(fchmodat), 1,
-		  						SCMP_A2(SCMP_CMP_MASKED_EQ, S_ISGID, S_ISGID))
-	      || seccomp_rule_add(ctx, SCMP_ACT_ERRNO(EPERM), SCMP_SYS(unshare), 1,
-		  						SCMP_A0(SCMP_CMP_MASKED_EQ, CLONE_NEWUSER, CLONE_NEWUSER))
-	      || seccomp_rule_add(ctx, SCMP_ACT_ERRNO(EPERM), SCMP_SYS(clone), 1,
-		  						SCMP_A0(SCMP_CMP_MASKED_EQ, CLONE_NEWUSER, CLONE_NEWUSER))
-	      || seccomp_rule_add(ctx, SCMP_ACT_ERRNO(EPERM), SCMP_SYS(ioctl), 1,
-		  						SCMP_A1(SCMP_CMP_MASKED_EQ, TIOCSTI, TIOCSTI))
-	      || seccomp_rule_add(ctx, SCMP_ACT_ERRNO(EPERM), SCMP_SYS(keyctl), 0)
-	      || seccomp_rule_add(ctx, SCMP_ACT_ERRNO(EPERM), SCMP_SYS(add_key), 0)
-	      || seccomp_rule_add(ctx, SCMP_ACT_ERRNO(EPERM), SCMP_SYS(request_key), 0)
-	      || seccomp_rule_add(ctx, SCMP_ACT_ERRNO(EPERM), SCMP_SYS(ptrace), 0)
-	      /* From docker default seccomp policies */
-	      || seccomp_rule_add(ctx, SCMP_ACT_ERRNO(EPERM), SCMP_SYS(acct), 0)
-	      || seccomp_rule_add(ctx, SCMP_ACT_ERRNO(EPERM), SCMP_SYS(add_key), 0)
-	      || seccomp_rule_add(ctx, SCMP_ACT_ERRNO(EPERM), SCMP_SYS(adjtimex), 0)
-	      || seccomp_rule_add(ctx, SCMP_ACT_ERRNO(EPERM), SCMP_SYS(bpf), 0)
-	      || seccomp_rule_add(ctx, SCMP_ACT_ERRNO(EPERM), SCMP_SYS(clock_adjtime), 0)
-	      || seccomp_rule_add(ctx, SCMP_ACT_ERRNO(EPERM), SCMP_SYS(clock_settime), 0)
-	      || seccomp_rule_add(ctx, SCMP_ACT_ERRNO(EPERM), SCMP_SYS(create_module), 0)
-	      || seccomp_rule_add(ctx, SCMP_ACT_ERRNO(EPERM), SCMP_SYS(delete_module), 0)
-	      || seccomp_rule_add(ctx, SCMP_ACT_ERRNO(EPERM), SCMP_SYS(finit_module), 0)
-	      || seccomp_rule_add(ctx, SCMP_ACT_ERRNO(EPERM), SCMP_SYS(get_kernel_syms), 0)
-	      || seccomp_rule_add(ctx, SCMP_ACT_ERRNO(EPERM), SCMP_SYS(get_mempolicy), 0)
-	      || seccomp_rule_add(ctx, SCMP_ACT_ERRNO(EPERM), SCMP_SYS(init_module), 0)
-	      || seccomp_rule_add(ctx, SCMP_ACT_ERRNO(EPERM), SCMP_SYS(ioperm), 0)
-	      || seccomp_rule_add(ctx, SCMP_ACT_ERRNO(EPERM), SCMP_SYS(iopl), 0)
-	      || seccomp_rule_add(ctx, SCMP_ACT_ERRNO(EPERM), SCMP_SYS(kcmp), 0)
-	      || seccomp_rule_add(ctx, SCMP_ACT_ERRNO(EPERM), SCMP_SYS(kexec_file_load), 0)
-	      || seccomp_rule_add(ctx, SCMP_ACT_ERRNO(EPERM), SCMP_SYS(kexec_load), 0)
-	      || seccomp_rule_add(ctx, SCMP_ACT_ERRNO(EPERM), SCMP_SYS(keyctl), 0)
-	      || seccomp_rule_add(ctx, SCMP_ACT_ERRNO(EPERM), SCMP_SYS(lookup_dcookie), 0)
-	      || seccomp_rule_add(ctx, SCMP_ACT_ERRNO(EPERM), SCMP_SYS(mbind), 0)
-	      || seccomp_rule_add(ctx, SCMP_ACT_ERRNO(EPERM), SCMP_SYS(mount), 0)
-	      || seccomp_rule_add(ctx, SCMP_ACT_ERRNO(EPERM), SCMP_SYS(move_pages), 0)
-	      || seccomp_rule_add(ctx, SCMP_ACT_ERRNO(EPERM), SCMP_SYS(name_to_handle_at), 0)
-	      || seccomp_rule_add(ctx, SCMP_ACT_ERRNO(EPERM), SCMP_SYS(nfsservctl), 0)
-	      || seccomp_rule_add(ctx, SCMP_ACT_ERRNO(EPERM), SCMP_SYS(open_by_handle_at), 0)
-	      || seccomp_rule_add(ctx, SCMP_ACT_ERRNO(EPERM), SCMP_SYS(perf_event_open), 0)
-          || seccomp_rule_add(ctx, SCMP_ACT_ERRNO(EPERM), SCMP_SYS(personality), 0)
-	      || seccomp_rule_add(ctx, SCMP_ACT_ERRNO(EPERM), SCMP_SYS(pivot_root), 0)
-	      || seccomp_rule_add(ctx, SCMP_ACT_ERRNO(EPERM), SCMP_SYS(process_vm_readv), 0)
-	      || seccomp_rule_add(ctx, SCMP_ACT_ERRNO(EPERM), SCMP_SYS(process_vm_writev), 0)
-	      || seccomp_rule_add(ctx, SCMP_ACT_ERRNO(EPERM), SCMP_SYS(ptrace), 0)
-	      || seccomp_rule_add(ctx, SCMP_ACT_ERRNO(EPERM), SCMP_SYS(query_module), 0)
-	      || seccomp_rule_add(ctx, SCMP_ACT_ERRNO(EPERM), SCMP_SYS(quotactl), 0)
-	      || seccomp_rule_add(ctx, SCMP_ACT_ERRNO(EPERM), SCMP_SYS(reboot), 0)
-	      || seccomp_rule_add(ctx, SCMP_ACT_ERRNO(EPERM), SCMP_SYS(request_key), 0)
-	      || seccomp_rule_add(ctx, SCMP_ACT_ERRNO(EPERM), SCMP_SYS(set_mempolicy), 0)
-	      || seccomp_rule_add(ctx, SCMP_ACT_ERRNO(EPERM), SCMP_SYS(setns), 0)
-	      || seccomp_rule_add(ctx, SCMP_ACT_ERRNO(EPERM), SCMP_SYS(settimeofday), 0)
-	      || seccomp_rule_add(ctx, SCMP_ACT_ERRNO(EPERM), SCMP_SYS(socket), 0)
-	      || seccomp_rule_add(ctx, SCMP_ACT_ERRNO(EPERM), SCMP_SYS(stime), 0)
-	      || seccomp_rule_add(ctx, SCMP_ACT_ERRNO(EPERM), SCMP_SYS(swapon), 0)
-	      || seccomp_rule_add(ctx, SCMP_ACT_ERRNO(EPERM), SCMP_SYS(swapoff), 0)
-	      || seccomp_rule_add(ctx, SCMP_ACT_ERRNO(EPERM), SCMP_SYS(sysfs), 0)
-	      || seccomp_rule_add(ctx, SCMP_ACT_ERRNO(EPERM), SCMP_SYS(_sysctl), 0)
-	      || seccomp_rule_add(ctx, SCMP_ACT_ERRNO(EPERM), SCMP_SYS(umount), 0)
-	      || seccomp_rule_add(ctx, SCMP_ACT_ERRNO(EPERM), SCMP_SYS(umount2), 0)
-	      || seccomp_rule_add(ctx, SCMP_ACT_ERRNO(EPERM), SCMP_SYS(unshare), 0)
-	      || seccomp_rule_add(ctx, SCMP_ACT_ERRNO(EPERM), SCMP_SYS(uselib), 0)
-	      || seccomp_rule_add(ctx, SCMP_ACT_ERRNO(EPERM), SCMP_SYS(userfaultfd), 0)
-	      || seccomp_rule_add(ctx, SCMP_ACT_ERRNO(EPERM), SCMP_SYS(ustat), 0)
-	      || seccomp_rule_add(ctx, SCMP_ACT_ERRNO(EPERM), SCMP_SYS(vm86), 0)
-	      || seccomp_rule_add(ctx, SCMP_ACT_ERRNO(EPERM), SCMP_SYS(vm86old), 0)
-	  )) {
-		    /* Successfully added filter's rules.
-			   Now load the filter into the Kernel. */
-			int lv = seccomp_load(ctx);
-		    
-			if (lv < 0) {
-				fprintf(stderr,"=> ERR: seccomp_load failed.\n");
-			  	seccomp_release(ctx);
-				exit(EXIT_FAILURE);		
-			}
+	/* Without it the syscalls are checked one after the other, in the
+	 * order of their priority. Older versions do not know the attribute
+	 * and keep the linear filter. */
+	if (profile.layout == LAYOUT_TREE && seccomp_attr_set(ctx,
+	        SCMP_FLTATR_CTL_OPTIMIZE, SECCOMP_OPTIMIZE))
+		fprintf(stderr, "=> binary tree filter not supported, "
+			"using a linear one\n");
 
+	for (size_t i = 0; i < profile.n_rules && !err; ++i) {
+		rule = &profile.rules[i];
+
+		if (profile.layout == LAYOUT_PRIORITY
+		    && (i == 0 || profile.rules[i - 1].syscall != rule->syscall)
+		    && (err = seccomp_syscall_priority(ctx, rule->syscall,
+		            syscall_priority(i))))
+			break;
+
+		if (rule->arg == RULE_ANY_ARG) {
+			err = seccomp_rule_add(ctx, rule->action, rule->syscall, 0);
 		} else {
-			fprintf(stderr,"=> ERR: seccomp_rule_add failed.\n");
-			seccomp_release(ctx);
-			exit(EXIT_FAILURE);		
+			cmp = SCMP_CMP(rule->arg, SCMP_CMP_MASKED_EQ, rule->mask,
+					rule->mask);
+			err = seccomp_rule_add_array(ctx, rule->action,
+					rule->syscall, 1, &cmp);
 		}
+	}
+
+	if (err) {
+		fprintf(stderr,"=> ERR: seccomp_rule_add failed.\n");
+		seccomp_release(ctx);
+		exit(EXIT_FAILURE);
+	}
+
+	if (seccomp_export_bpf(ctx, fd) < 0) {
+		fprintf(stderr,"=> ERR: seccomp_export_bpf failed.\n");
+		seccomp_release(ctx);
+		exit(EXIT_FAILURE);
+	}
 
 	seccomp_release(ctx);
+}
+
+/* Open the cached program, compiling it first when it is missing. The
+ * program is written to a temporary file and renamed, concurrent
+ * compilations of the same rules just replace each other. */
+static int sys_filter_open(const char *path)
+{
+	char tmp[PATH_MAX];
+	int fd;
+
+	if ((fd = open(path, O_RDONLY | O_CLOEXEC)) != -1 || errno != ENOENT)
+		return fd;
+
+	if (mkdir(RUN_DIR, 0755) == -1 && errno != EEXIST)
+		printErr("mkdir " RUN_DIR);
+	if (mkdir(SECCOMP_CACHE_PATH, 0700) == -1 && errno != EEXIST)
+		printErr("mkdir " SECCOMP_CACHE_PATH);
+
+	if (snprintf(tmp, sizeof(tmp), "%s.XXXXXX", path) >= sizeof(tmp)) {
+		fprintf(stderr, "=> seccomp cache path too long\n");
+		exit(EXIT_FAILURE);
+	}
+	if ((fd = mkostemp(tmp, O_CLOEXEC)) == -1)
+		printErr("mkostemp seccomp cache");
+
+	fprintf(stderr, "=> compiling the syscall filter...");
+	sys_filter_compile(fd);
+	fprintf(stderr, "done.\n");
+
+	close(fd);
+
+	if (rename(tmp, path) == -1) {
+		unlink(tmp);
+		printErr("rename seccomp cache");
+	}
+
+	return open(path, O_RDONLY | O_CLOEXEC);
+}
+
+static void sys_filter_map()
+{
+	char path[PATH_MAX];
+	char hex[SHA256_HEX_LEN + 1];
+	struct stat st;
+	void *prog;
+	int fd;
+
+	if (trace_all)
+		profile_from_rules(&profile, SCMP_ACT_TRACE(0), NULL, 0);
+	else if (profile_path)
+		profile_load(&profile, profile_path);
+	else
+		profile_from_rules(&profile, DEFAULT_ACTION, default_rules,
+			N_DEFAULT_RULES);
+
+	sys_filter_hash(hex);
+	snprintf(path, sizeof(path), SECCOMP_CACHE_PATH "/%s.bpf", hex);
+
+	if ((fd = sys_filter_open(path)) == -1)
+		printErr("open seccomp cache");
+
+	if (fstat(fd, &st) == -1)
+		printErr("fstat seccomp cache");
+
+	if (st.st_size == 0 || st.st_size % sizeof(struct sock_filter)
+			|| st.st_size / sizeof(struct sock_filter) > BPF_MAXINSNS) {
+		fprintf(stderr, "=> %s is not a valid BPF program\n", path);
+		exit(EXIT_FAILURE);
+	}
+
+	prog = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (prog == MAP_FAILED)
+		printErr("mmap seccomp cache");
+
+	close(fd);
+
+	filter.prog.len = st.st_size / sizeof(struct sock_filter);
+	filter.prog.filter = prog;
+
+	for (size_t i = 0; i < profile.n_rules; ++i) {
+		if (profile.rules[i].action == SCMP_ACT_NOTIFY)
+			filter.notify = 1;
+	}
+
+	profile_free(&profile);
+}
+
+const struct sys_filter *sys_filter_prepare()
+{
+	pthread_once(&filter_once, sys_filter_map);
+	return &filter;
+}
+
+int sys_filter_load(const struct sys_filter *compiled)
+{
+	int listener = -1;
+
+	/* what seccomp_load() does by default: without CAP_SYS_ADMIN a
+	 * filter can only be installed with no_new_privs */
+	if (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) == -1)
+		printErr("prctl no_new_privs");
+
+	/* only seccomp(2) returns the listener of the notifications */
+	if (compiled->notify) {
+		listener = syscall(SYS_seccomp, SECCOMP_SET_MODE_FILTER,
+			SECCOMP_FILTER_FLAG_NEW_LISTENER, &compiled->prog);
+		if (listener == -1)
+			printErr("seccomp new_listener");
+	} else if (prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &compiled->prog) == -1) {
+		printErr("prctl seccomp");
+	}
+
 	fprintf(stderr,"=> syscall filtering done.\n");
-}
\ No newline at end of file
+	return listener;
+}
@@ -1,3 +1,57 @@
+/**
+ * Syscall filtering.
+ *
+ * The rules come from a profile (see profile.h), the built-in one or a
+ * file. libseccomp compiles them into a BPF program once and the program
+ * is kept on disk, so a container start does not pay for the compilation
+ * again:
+ *
+ *   SECCOMP_CACHE_PATH/<sha256>.bpf
+ *
+ * The name is the sha256 of the deduplicated rules, the native
+ * architecture and the libseccomp version: changing any of them gives a
+ * new program.
+ *
+ * The program is compiled as a binary tree sorted by syscall number: a
+ * syscall is found in O(log n) checks instead of walking every rule.
+ *
+ * The parent maps the program with sys_filter_prepare() before the clone,
+ * the child installs it with a single prctl(PR_SET_SECCOMP) before
+ * execve().
+ *
+ * Rules with the notify action are not decided by the filter: the child
+ * installs it with seccomp(SECCOMP_FILTER_FLAG_NEW_LISTENER) and hands the
+ * listener to the supervisor of the parent (see supervisor.h).
+ */
+#ifndef SECCOMP_CONFIG_H
+#define SECCOMP_CONFIG_H
+
 #define _GNU_SOURCE
 
-void sys_filter();
\ No newline at end of file
+#include <linux/filter.h>
+
+#define SECCOMP_OPTIMIZE    2       /* SCMP_FLTATR_CTL_OPTIMIZE: binary tree */
+
+/* use the profile file at path instead of the built-in profile, to be
+ * called before the first sys_filter_prepare() */
+void sys_filter_set_profile(const char *path);
+
+/* a compiled filter */
+struct sys_filter {
+	struct sock_fprog prog;
+	int notify;                 /* some rules use SCMP_ACT_NOTIFY */
+};
+
+/* Instead of a profile, trace every syscall with SCMP_ACT_TRACE: the
+ * filter of the syscall profiler (see profiler.h). */
+void sys_filter_set_trace();
+
+/* The compiled filter, mapped read-only. Built and cached on the first
+ * call, the same program is returned to every thread afterwards. */
+const struct sys_filter *sys_filter_prepare();
+
+/* Install the filter in the calling process, no libseccomp involved.
+ * Returns the notification listener of a notify filter, -1 otherwise. */
+int sys_filter_load(const struct sys_filter *filter);
+
+#endif //SECCOMP_CONFIG_H
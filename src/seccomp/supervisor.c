@@ -0,0 +1,347 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sched.h>
+#include <signal.h>
+#include <pthread.h>
+#include <seccomp.h>
+#include <sys/epoll.h>
+#include <sys/mount.h>
+#include <sys/wait.h>
+#include "supervisor.h"
+#include "../helpers/helpers.h"
+
+#define HELPER_STACK_SIZE   (64 * 1024)
+#define MAX_MOUNT_DATA      256
+
+/* what a fd of the epoll set is */
+enum watched_type {
+	WATCH_SOCKET,               /* a child will send its listener here */
+	WATCH_LISTENER,             /* notifications of a container */
+};
+
+struct watched {
+	int fd;
+	enum watched_type type;
+};
+
+/* the tmpfs a container can mount */
+struct tmpfs_policy {
+	const char *target;
+	unsigned long flags;        /* flags the container may ask for */
+};
+
+static const struct tmpfs_policy tmpfs_policies[] = {
+	{ "/tmp",       MS_NOEXEC | MS_NOATIME | MS_RDONLY },
+	{ "/run",       MS_NOEXEC | MS_NOATIME },
+	{ "/dev/shm",   MS_NOEXEC | MS_NOATIME },
+};
+
+/* the options the container may give to tmpfs */
+static const char *tmpfs_options[] = { "size=", "nr_inodes=", "mode=" };
+
+/* every mount of the supervisor gets them */
+#define FORCED_FLAGS    (MS_NOSUID | MS_NODEV)
+
+static int handle_mount(int listener, const struct seccomp_notif *req);
+
+/* The syscalls the supervisor handles. A handler returns 0 or -errno,
+ * the result of the syscall in the container. */
+struct notify_policy {
+	int syscall;
+	int (*handle)(int listener, const struct seccomp_notif *req);
+};
+
+static const struct notify_policy policies[] = {
+	{ SCMP_SYS(mount), handle_mount },
+};
+
+#define N_ELEMS(array) (sizeof(array) / sizeof(*(array)))
+
+static pthread_once_t supervisor_once = PTHREAD_ONCE_INIT;
+static int epoll_fd = -1;
+
+/* only used by the supervisor thread, a helper runs on a copy of it */
+static char helper_stack[HELPER_STACK_SIZE];
+
+/* read a NUL terminated string of the calling process */
+static int read_string(int mem_fd, uint64_t addr, char *buf, size_t size)
+{
+	ssize_t len;
+
+	if ((len = pread(mem_fd, buf, size, addr)) <= 0)
+		return -EFAULT;
+
+	if (!memchr(buf, '\0', len))
+		return len == size ? -ENAMETOOLONG : -EFAULT;
+
+	return 0;
+}
+
+/* every option is one of tmpfs_options with a plain value */
+static int tmpfs_data_allowed(char *data)
+{
+	char *option, *saveptr;
+	size_t i;
+
+	for (option = strtok_r(data, ",", &saveptr); option;
+	     option = strtok_r(NULL, ",", &saveptr)) {
+		for (i = 0; i < N_ELEMS(tmpfs_options); ++i) {
+			if (!strncmp(option, tmpfs_options[i], strlen(tmpfs_options[i])))
+				break;
+		}
+
+		if (i == N_ELEMS(tmpfs_options)
+		    || option[strspn(option, "abcdefghijklmnopqrstuvwxyz_="
+		                     "0123456789kmgKMG%")] != '\0')
+			return 0;
+	}
+
+	return 1;
+}
+
+struct mount_request {
+	int ns_fd;
+	const char *target;
+	unsigned long flags;
+	const char *data;
+};
+
+/* setns() of a mount namespace is refused to a threaded process: the
+ * mount is done by a child, which returns the errno as exit status */
+static int mount_helper(void *arg)
+{
+	struct mount_request *request = arg;
+
+	if (setns(request->ns_fd, CLONE_NEWNS) == -1)
+		return errno;
+
+	if (mount("tmpfs", request->target, "tmpfs", request->flags,
+	          request->data) == -1)
+		return errno;
+
+	return 0;
+}
+
+static int mount_in_ns(struct mount_request *request)
+{
+	int status;
+	pid_t pid;
+
+	/* No exit signal: the helper is only seen by waitpid(__WCLONE) and
+	 * never by the reapers of the containers. */
+	pid = clone(mount_helper, helper_stack + HELPER_STACK_SIZE, 0, request);
+	if (pid == -1)
+		return errno;
+
+	while (waitpid(pid, &status, __WCLONE) == -1) {
+		if (errno != EINTR)
+			return errno;
+	}
+
+	return WIFEXITED(status) ? WEXITSTATUS(status) : EIO;
+}
+
+/* mount("tmpfs", <target of the policy>, "tmpfs", flags, data) */
+static int handle_mount(int listener, const struct seccomp_notif *req)
+{
+	char target[PATH_MAX], fstype[16], data[MAX_MOUNT_DATA], path[64];
+	const struct tmpfs_policy *policy = NULL;
+	struct mount_request request;
+	unsigned long flags = req->data.args[3];
+	char options[MAX_MOUNT_DATA];
+	int mem_fd, err;
+
+	snprintf(path, sizeof(path), "/proc/%u/mem", req->pid);
+	if ((mem_fd = open(path, O_RDONLY | O_CLOEXEC)) == -1)
+		return -EPERM;
+
+	/* a fstype too long for the buffer is not tmpfs anyway */
+	if (read_string(mem_fd, req->data.args[2], fstype, sizeof(fstype))
+	    || strcmp(fstype, "tmpfs")) {
+		close(mem_fd);
+		return -EPERM;
+	}
+
+	err = read_string(mem_fd, req->data.args[1], target, sizeof(target));
+
+	data[0] = '\0';
+	if (!err && req->data.args[4])
+		err = read_string(mem_fd, req->data.args[4], data, sizeof(data));
+
+	close(mem_fd);
+
+	if (err)
+		return err;
+
+	/* the magic number of the old mount(2) API, still accepted */
+	if ((flags & MS_MGC_MSK) == MS_MGC_VAL)
+		flags &= ~MS_MGC_MSK;
+
+	for (size_t i = 0; i < N_ELEMS(tmpfs_policies); ++i) {
+		if (!strcmp(target, tmpfs_policies[i].target))
+			policy = &tmpfs_policies[i];
+	}
+
+	if (!policy || flags & ~(policy->flags | FORCED_FLAGS | MS_SILENT))
+		return -EPERM;
+
+	strcpy(options, data);
+	if (!tmpfs_data_allowed(options))
+		return -EPERM;
+
+	snprintf(path, sizeof(path), "/proc/%u/ns/mnt", req->pid);
+	if ((request.ns_fd = open(path, O_RDONLY | O_CLOEXEC)) == -1)
+		return -EPERM;
+
+	/* The pid could belong to another process by now: once the
+	 * namespace is open, make sure the caller is still waiting. */
+	if (seccomp_notify_id_valid(listener, req->id)) {
+		close(request.ns_fd);
+		return -ENOENT;
+	}
+
+	request.target = target;
+	request.flags = flags | FORCED_FLAGS;
+	request.data = data[0] ? data : NULL;
+
+	err = mount_in_ns(&request);
+	close(request.ns_fd);
+
+	return -err;
+}
+
+static void supervisor_handle(int listener, struct seccomp_notif *req,
+	struct seccomp_notif_resp *resp)
+{
+	int err = -EPERM;
+
+	/* the buffer must be zeroed before every receive */
+	memset(req, 0, sizeof(*req));
+
+	/* the caller may have been killed meanwhile */
+	if (seccomp_notify_receive(listener, req) < 0)
+		return;
+
+	if (req->data.arch == seccomp_arch_native()) {
+		for (size_t i = 0; i < N_ELEMS(policies); ++i) {
+			if (policies[i].syscall == req->data.nr)
+				err = policies[i].handle(listener, req);
+		}
+	}
+
+	memset(resp, 0, sizeof(*resp));
+	resp->id = req->id;
+	resp->error = err;
+
+	/* ENOENT: the caller is gone, nobody waits for the answer */
+	seccomp_notify_respond(listener, resp);
+}
+
+static void supervisor_add(int fd, enum watched_type type)
+{
+	struct epoll_event ev;
+	struct watched *watched;
+
+	if (!(watched = malloc(sizeof(*watched))))
+		printErr("malloc at supervisor_add");
+
+	watched->fd = fd;
+	watched->type = type;
+
+	ev.events = EPOLLIN;
+	ev.data.ptr = watched;
+
+	if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) == -1)
+		printErr("supervisor epoll_ctl");
+}
+
+static void supervisor_remove(struct watched *watched)
+{
+	epoll_ctl(epoll_fd, EPOLL_CTL_DEL, watched->fd, NULL);
+	close(watched->fd);
+	free(watched);
+}
+
+/* the message of a child: its listener, or EOF if it died before */
+static void supervisor_receive_listener(struct watched *sock)
+{
+	int listener, n_fds = 1;
+	char ch;
+
+	if (recv_fds(sock->fd, &ch, 1, &listener, &n_fds) > 0 && n_fds == 1)
+		supervisor_add(listener, WATCH_LISTENER);
+
+	supervisor_remove(sock);
+}
+
+static void *supervisor_loop(void *unused)
+{
+	struct epoll_event events[SUPERVISOR_MAX_EVENTS];
+	struct seccomp_notif_resp *resp;
+	struct seccomp_notif *req;
+	struct watched *watched;
+	int n;
+
+	/* sized for the running kernel */
+	if (seccomp_notify_alloc(&req, &resp))
+		printErr("seccomp_notify_alloc");
+
+	for (;;) {
+		if ((n = epoll_wait(epoll_fd, events, SUPERVISOR_MAX_EVENTS, -1)) == -1) {
+			if (errno == EINTR)
+				continue;
+			printErr("supervisor epoll_wait");
+		}
+
+		for (int i = 0; i < n; ++i) {
+			watched = events[i].data.ptr;
+
+			if (watched->type == WATCH_SOCKET)
+				supervisor_receive_listener(watched);
+			else if (events[i].events & EPOLLIN)
+				supervisor_handle(watched->fd, req, resp);
+			else
+				/* no task uses the filter anymore */
+				supervisor_remove(watched);
+		}
+	}
+
+	return NULL;
+}
+
+static void supervisor_start()
+{
+	pthread_t thread;
+	int err;
+
+	if ((epoll_fd = epoll_create1(EPOLL_CLOEXEC)) == -1)
+		printErr("supervisor epoll_create");
+
+	if ((err = pthread_create(&thread, NULL, supervisor_loop, NULL))) {
+		errno = err;
+		printErr("pthread_create supervisor");
+	}
+
+	pthread_detach(thread);
+}
+
+void supervisor_watch(int sock)
+{
+	pthread_once(&supervisor_once, supervisor_start);
+	supervisor_add(sock, WATCH_SOCKET);
+}
+
+void supervisor_send_listener(int sock, int listener)
+{
+	if (send_fds(sock, "l", 1, &listener, 1) == -1)
+		printErr("send seccomp listener");
+
+	close(listener);
+	close(sock);
+}
@@ -0,0 +1,37 @@
+/**
+ * Seccomp supervisor.
+ *
+ * The syscalls a profile sends to the notify action (SCMP_ACT_NOTIFY) are
+ * decided by a thread of the parent instead of the filter. The calling
+ * thread of the container sleeps until the supervisor answers, so a few
+ * privileged operations can be done on its behalf while the container
+ * keeps its restrictions:
+ *
+ *   child:   filter -> listener --(socketpair)--> supervisor   -> execve
+ *   child:   mount("tmpfs", "/tmp", ...) ... blocked ... returns 0
+ *                 |                                   ^
+ *                 v                                   |
+ *   parent:  [supervisor thread] epoll -> policy table -> mount helper
+ *
+ * One thread serves every container of the process (batch mode, zygote):
+ * the socket of each container and then its listener are added to the
+ * same epoll set. A listener is closed once no task uses its filter
+ * anymore.
+ *
+ * The policy table lists the syscalls the supervisor can handle, anything
+ * else fails with EPERM. The arguments are read from /proc/<pid>/mem and
+ * the notification is checked to be still alive before acting on them.
+ */
+#ifndef SUPERVISOR_H
+#define SUPERVISOR_H
+
+#define SUPERVISOR_MAX_EVENTS   16
+
+/* Watch the parent end of the socket a child sends its listener to. The
+ * supervisor thread is started by the first call. */
+void supervisor_watch(int sock);
+
+/* in the child: send the listener to the supervisor and close both */
+void supervisor_send_listener(int sock, int listener);
+
+#endif //SUPERVISOR_H
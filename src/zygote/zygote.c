@@ -0,0 +1,384 @@
+#define _GNU_SOURCE
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/signalfd.h>
+#include "zygote.h"
+#include "../runc.h"
+#include "../helpers/helpers.h"
+#include "../helpers/phases.h"
+#include "../helpers/trace.h"
+#include "../image/image.h"
+#include "../seccomp/seccomp_config.h"
+#include "../../config.h"
+
+#define ZYGOTE_MAX_JOBS     256     /* max number of running entrypoints */
+
+/* a container parked in the pool, waiting for an entrypoint */
+struct zygote_child {
+    pid_t pid;
+    int ctl_fd;                     /* server end of the command channel */
+};
+
+/* a container handed out to a client */
+struct zygote_job {
+    pid_t pid;
+    int client_fd;                  /* where the exit status is reported */
+};
+
+static struct zygote_child pool[ZYGOTE_MAX_POOL];
+static size_t n_parked = 0;
+static struct zygote_job jobs[ZYGOTE_MAX_JOBS];
+static size_t n_jobs = 0;
+static char *lowerdir = NULL;          /* rootfs layers of every child */
+static const struct sys_filter *filter = NULL; /* seccomp of every child */
+
+static int zygote_listen_socket()
+{
+    struct sockaddr_un addr;
+    int fd;
+
+    if ((fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0)) == -1)
+        printErr("zygote socket");
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, ZYGOTE_SOCKET_PATH, sizeof(addr.sun_path) - 1);
+
+    /* no other user can create the socket before the server */
+    if (mkdir(RUN_DIR, 0755) == -1 && errno != EEXIST)
+        printErr("mkdir " RUN_DIR);
+
+    /* a stale socket left by a previous server */
+    unlink(ZYGOTE_SOCKET_PATH);
+
+    if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) == -1)
+        printErr("zygote bind");
+
+    if (chmod(ZYGOTE_SOCKET_PATH, S_IRUSR | S_IWUSR) == -1)
+        printErr("zygote chmod");
+
+    if (listen(fd, SOMAXCONN) == -1)
+        printErr("zygote listen");
+
+    return fd;
+}
+
+/* clone a new child and leave it parked in the pool */
+static void zygote_park_child(int has_userns)
+{
+    struct clone_args args;
+    int ctl[2];
+    pid_t pid;
+
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, ctl) == -1)
+        printErr("zygote socketpair");
+
+    memset(&args, 0, sizeof(args));
+    args.has_userns = has_userns;
+    args.zygote_fd = ctl[1];
+    args.lowerdir = lowerdir;
+    args.filter = filter;
+
+    trace_container();
+
+    phase_begin(PHASE_CLONE);
+    if ((pid = clone_child(&args, CONTAINER_CLONE_FLAGS)) < 0)
+        printErr("zygote clone");
+    phase_end(PHASE_CLONE);
+
+    close(ctl[1]);
+
+    phase_begin(PHASE_UID_MAP);
+    map_child_user(&args, pid);
+    phase_end(PHASE_UID_MAP);
+
+    pool[n_parked].pid = pid;
+    pool[n_parked].ctl_fd = ctl[0];
+    ++n_parked;
+}
+
+static void zygote_close_fds(int *fds, int n_fds)
+{
+    for (int i = 0; i < n_fds; ++i)
+        close(fds[i]);
+}
+
+/* hand the entrypoint of a new client to a parked child */
+static void zygote_serve_client(int listen_fd)
+{
+    char cmd[ZYGOTE_MAX_CMD];
+    int fds[ZYGOTE_STDIO_FDS];
+    int n_fds = ZYGOTE_STDIO_FDS;
+    struct zygote_child child;
+    struct ucred cred;
+    socklen_t cred_len = sizeof(cred);
+    int client_fd;
+    ssize_t len;
+
+    if ((client_fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC)) == -1) {
+        fprintf(stderr, "=> zygote accept failed: %s\n", strerror(errno));
+        return;
+    }
+
+    /* the containers are started as root: so must the clients be */
+    if (getsockopt(client_fd, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len) == -1
+            || cred.uid != 0) {
+        fprintf(stderr, "=> zygote client rejected, it is not root\n");
+        close(client_fd);
+        return;
+    }
+
+    len = recv_fds(client_fd, cmd, sizeof(cmd), fds, &n_fds);
+    if (len <= 0 || n_jobs == ZYGOTE_MAX_JOBS || n_parked == 0)
+        goto reject;
+
+    child = pool[--n_parked];
+
+    if (send_fds(child.ctl_fd, cmd, len, fds, n_fds) != len) {
+        /* it will be reaped as an unknown child */
+        kill(child.pid, SIGKILL);
+        close(child.ctl_fd);
+        goto reject;
+    }
+
+    close(child.ctl_fd);
+    zygote_close_fds(fds, n_fds);
+
+    jobs[n_jobs].pid = child.pid;
+    jobs[n_jobs].client_fd = client_fd;
+    ++n_jobs;
+
+    send(client_fd, &child.pid, sizeof(child.pid), MSG_NOSIGNAL);
+    return;
+
+reject:
+    zygote_close_fds(fds, n_fds);
+    close(client_fd);
+}
+
+/* collect every terminated child, reporting the exit status of the
+ * entrypoints to their clients */
+static void zygote_reap_children(int sig_fd)
+{
+    struct signalfd_siginfo info;
+    int status;
+    pid_t pid;
+    size_t i;
+
+    /* SIGCHLD is not queued: just drain it and wait for everything */
+    while (read(sig_fd, &info, sizeof(info)) == sizeof(info))
+        ;
+
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+        for (i = 0; i < n_jobs; ++i) {
+            if (jobs[i].pid != pid)
+                continue;
+
+            send(jobs[i].client_fd, &status, sizeof(status), MSG_NOSIGNAL);
+            close(jobs[i].client_fd);
+            jobs[i] = jobs[--n_jobs];
+            break;
+        }
+
+        /* a parked child that failed its setup */
+        for (i = 0; i < n_parked; ++i) {
+            if (pool[i].pid != pid)
+                continue;
+
+            fprintf(stderr, "=> parked container %ld died\n", (long) pid);
+            close(pool[i].ctl_fd);
+            pool[i] = pool[--n_parked];
+            break;
+        }
+    }
+}
+
+void zygote_serve(int pool_size, int has_userns, int has_seccomp,
+    char *image)
+{
+    struct pollfd pfd[2];
+    int listen_fd, sig_fd;
+    sigset_t mask;
+
+    if (pool_size < 1 || pool_size > ZYGOTE_MAX_POOL) {
+        fprintf(stderr, "=> zygote pool size must be in [1-%d]\n",
+            ZYGOTE_MAX_POOL);
+        exit(EXIT_FAILURE);
+    }
+
+    /* Children are reaped from a signalfd so that the event loop never
+     * blocks in waitpid(). The mask is inherited by the parked children,
+     * which restore it in zygote_wait_command(). */
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    if (sigprocmask(SIG_BLOCK, &mask, NULL) == -1)
+        printErr("sigprocmask");
+
+    if ((sig_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC)) == -1)
+        printErr("signalfd");
+
+    listen_fd = zygote_listen_socket();
+
+    lowerdir = image_resolve(image);
+
+    if (has_seccomp)
+        filter = sys_filter_prepare();
+
+    fprintf(stderr, "=> warming up %d containers...", pool_size);
+    while (n_parked < pool_size)
+        zygote_park_child(has_userns);
+    fprintf(stderr, "done.\n");
+
+    fprintf(stdout, "Zygote listening on %s\n", ZYGOTE_SOCKET_PATH);
+    fflush(stdout);
+
+    pfd[0].fd = listen_fd;
+    pfd[0].events = POLLIN;
+    pfd[1].fd = sig_fd;
+    pfd[1].events = POLLIN;
+
+    for (;;) {
+        if (poll(pfd, 2, -1) == -1) {
+            if (errno == EINTR)
+                continue;
+            printErr("zygote poll");
+        }
+
+        if (pfd[1].revents & POLLIN) {
+            zygote_reap_children(sig_fd);
+            trace_flush();
+        }
+
+        if (pfd[0].revents & POLLIN)
+            zygote_serve_client(listen_fd);
+
+        /* the client already has its pid, refill the pool */
+        while (n_parked < pool_size)
+            zygote_park_child(has_userns);
+    }
+}
+
+int zygote_request(char **entrypoint, size_t entrypoint_size)
+{
+    int fds[ZYGOTE_STDIO_FDS] = { STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO };
+    char cmd[ZYGOTE_MAX_CMD];
+    struct sockaddr_un addr;
+    size_t len = 0;
+    int fd, status;
+    pid_t pid;
+
+    if (entrypoint_size == 0 || entrypoint_size > ZYGOTE_MAX_ARGS) {
+        fprintf(stderr, "=> invalid entrypoint for the zygote\n");
+        exit(EXIT_FAILURE);
+    }
+
+    /* the argv is sent as a sequence of NUL terminated strings */
+    for (size_t i = 0; i < entrypoint_size; ++i) {
+        size_t arg_len = strlen(entrypoint[i]) + 1;
+
+        if (len + arg_len > sizeof(cmd)) {
+            fprintf(stderr, "=> entrypoint too long for the zygote\n");
+            exit(EXIT_FAILURE);
+        }
+        memcpy(&cmd[len], entrypoint[i], arg_len);
+        len += arg_len;
+    }
+
+    if ((fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0)) == -1)
+        printErr("zygote socket");
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, ZYGOTE_SOCKET_PATH, sizeof(addr.sun_path) - 1);
+
+    if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) == -1)
+        printErr("zygote connect");
+
+    if (send_fds(fd, cmd, len, fds, ZYGOTE_STDIO_FDS) != len)
+        printErr("zygote send");
+
+    if (recv(fd, &pid, sizeof(pid), 0) != sizeof(pid)) {
+        fprintf(stderr, "=> the zygote refused the request\n");
+        exit(EXIT_FAILURE);
+    }
+
+    fprintf(stderr, "ProcessID: %ld\n", (long) pid);
+
+    if (recv(fd, &status, sizeof(status), 0) != sizeof(status))
+        printErr("zygote exit status");
+
+    close(fd);
+
+    if (WIFSIGNALED(status))
+        return 128 + WTERMSIG(status);
+
+    return WEXITSTATUS(status);
+}
+
+void zygote_wait_command(struct clone_args *args)
+{
+    static char cmd[ZYGOTE_MAX_CMD];
+    static char *argv[ZYGOTE_MAX_ARGS + 1];
+    int fds[ZYGOTE_STDIO_FDS];
+    int n_fds = ZYGOTE_STDIO_FDS;
+    size_t argc = 0, off = 0;
+    sigset_t mask;
+    ssize_t len;
+
+    /* do not outlive the server while parked */
+    if (prctl(PR_SET_PDEATHSIG, SIGKILL) == -1)
+        printErr("prctl PR_SET_PDEATHSIG");
+
+    len = recv_fds(args->zygote_fd, cmd, sizeof(cmd) - 1, fds, &n_fds);
+    if (len <= 0)
+        exit(EXIT_FAILURE);
+
+    close(args->zygote_fd);
+    cmd[len] = '\0';
+
+    while (off < (size_t) len && argc < ZYGOTE_MAX_ARGS) {
+        argv[argc++] = &cmd[off];
+        off += strlen(&cmd[off]) + 1;
+    }
+    argv[argc] = NULL;
+
+    if (argc == 0)
+        exit(EXIT_FAILURE);
+
+    /* the entrypoint talks to the client terminal. The fds came with
+     * MSG_CMSG_CLOEXEC: one already in place must lose the flag, dup2()
+     * clears it on the others. */
+    for (int i = 0; i < n_fds; ++i) {
+        if (fds[i] == i) {
+            if (fcntl(i, F_SETFD, 0) == -1)
+                printErr("fcntl client stdio");
+            continue;
+        }
+        if (dup2(fds[i], i) == -1)
+            printErr("dup2 client stdio");
+        close(fds[i]);
+    }
+
+    if (prctl(PR_SET_PDEATHSIG, 0) == -1)
+        printErr("prctl PR_SET_PDEATHSIG");
+
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    if (sigprocmask(SIG_UNBLOCK, &mask, NULL) == -1)
+        printErr("sigprocmask");
+
+    args->command = argv;
+    args->command_size = argc;
+}
@@ -0,0 +1,54 @@
+/**
+ * Zygote mode.
+ *
+ * Most of the cost of starting a container is paid before the entrypoint
+ * is executed: the stack allocation, the clone() into the new namespaces,
+ * the uid/gid mapping and the whole rootfs preparation up to
+ * perform_pivot_root(). None of these steps depend on the command that
+ * will be run, so they can be done in advance.
+ *
+ * A zygote server keeps a pool of children that have already been cloned
+ * and pivoted into their root file system. Each one is parked on its own
+ * command channel, waiting for an entrypoint. Clients connect to the
+ * server socket and send the entrypoint argv together with their stdio
+ * file descriptors; the server hands them to a parked child, which only
+ * has to call execvp(). The pool is refilled after the client has been
+ * answered, so the refill never sits on the request path.
+ *
+ *      client                 zygote server               parked child
+ *        |   argv + stdio fds     |                             |
+ *        | ---------------------> |   argv + stdio fds          |
+ *        |                        | --------------------------> |
+ *        |          pid           |                          execvp()
+ *        | <--------------------- |                             |
+ *        |                        |  (refill the pool)          |
+ *        |      exit status       |                             |
+ *        | <--------------------- | <--------- SIGCHLD -------- |
+ *
+ * The server socket, ZYGOTE_SOCKET_PATH, lives in RUN_DIR where only root
+ * can create it, and the clients that are not root are turned away: a
+ * client hands its terminal to the server and gets a root container.
+ *
+ * Pooled children do not get cgroup limits nor a veth pair: both are
+ * currently bound to a single container per host.
+ */
+
+#define ZYGOTE_MAX_POOL     64      /* max number of parked children */
+#define ZYGOTE_MAX_ARGS     64      /* max entrypoint argv length */
+#define ZYGOTE_MAX_CMD      4096    /* max size of a serialized entrypoint */
+#define ZYGOTE_STDIO_FDS    3       /* stdin, stdout and stderr */
+
+struct clone_args;
+
+/* start a zygote server keeping pool_size parked containers of image
+ * (NULL for root_fs), with the syscall filter when has_seccomp is set */
+void zygote_serve(int pool_size, int has_userns, int has_seccomp,
+    char *image);
+
+/* run the entrypoint in a container handed out by the zygote server,
+ * returns the exit status of the entrypoint */
+int zygote_request(char **entrypoint, size_t entrypoint_size);
+
+/* park the calling child until an entrypoint is received, then fill
+ * args->command with it and install the client stdio */
+void zygote_wait_command(struct clone_args *args);
@@ -0,0 +1,393 @@
+/* netpps.c
+
+   Packet rate benchmark of the network modes.
+
+   For every mode (see src/namespaces/network/netspec.h) two network
+   namespaces get their interface from the pool of the runtime, through
+   the same net_pool_acquire()/prepare_netns() path as the containers. One
+   sends UDP datagrams to the other for a few seconds with sendmmsg(), the
+   other counts them with recvmmsg(). The packets per second sent and
+   received of each mode are printed side by side, with the received rate
+   relative to the first mode, the bridge by default.
+
+   A mode runs in a process of its own: the pool serves a single mode per
+   process.
+
+   Usage: sudo ./netpps [-d seconds] [-s size] [-m mode]... [-p parent]
+                        [-S subnet] [-f file]
+*/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include "../src/helpers/helpers.h"
+#include "../src/namespaces/network/network.h"
+
+#define DEFAULT_DURATION    5
+#define MAX_DURATION        60
+#define DEFAULT_SIZE        64          /* UDP payload */
+#define MIN_SIZE            16
+#define MAX_SIZE            1472
+#define PPS_PORT            9000
+#define PPS_BATCH           64          /* datagrams per syscall */
+#define END_MARKERS         16          /* 1 byte datagrams closing a run */
+
+struct pps_result {
+	int failed;
+	unsigned long long sent;
+	unsigned long long sent_ns;
+	unsigned long long received;
+	unsigned long long received_ns; /* from the first to the last one */
+};
+
+static long duration = DEFAULT_DURATION;
+static long size = DEFAULT_SIZE;
+static char *parent = NULL;
+static char *subnet = NULL;
+
+static void usage(char *pname)
+{
+	fprintf(stderr, "Usage: sudo %s [options]\n\n", pname);
+	fprintf(stderr, "Options can be:\n");
+	fprintf(stderr, "\t-d <seconds>\tsending time of each mode "
+		"[1-%d]\tdefault: %d\n", MAX_DURATION, DEFAULT_DURATION);
+	fprintf(stderr, "\t-s <bytes>\tUDP payload [%d-%d]\tdefault: %d\n",
+		MIN_SIZE, MAX_SIZE, DEFAULT_SIZE);
+	fprintf(stderr, "\t-m <mode>\tbridge, macvlan, ipvlan-l2 or "
+		"ipvlan-l3, repeatable\tdefault: all of them\n");
+	fprintf(stderr, "\t-p <dev>\tparent of the macvlan and ipvlan "
+		"interfaces\tdefault: " NET_PARENT "\n");
+	fprintf(stderr, "\t-S <a.b.c.d/len>\tsubnet of the pool\tdefault: "
+		NET_SUBNET "\n");
+	fprintf(stderr, "\t-f <file>\twrite the report to file\n");
+	exit(EXIT_FAILURE);
+}
+
+static unsigned long long now_ns()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void receive(int ctl, int sock)
+{
+	struct pps_result result = { 0 };
+	struct mmsghdr msgs[PPS_BATCH];
+	struct iovec iovs[PPS_BATCH];
+	static char bufs[PPS_BATCH][MAX_SIZE];
+	struct timeval timeout = { .tv_sec = 1 };
+	unsigned long long first = 0, last = 0;
+	int n, i, idle = 0;
+
+	for (i = 0; i < PPS_BATCH; ++i) {
+		iovs[i].iov_base = bufs[i];
+		iovs[i].iov_len = MAX_SIZE;
+		memset(&msgs[i].msg_hdr, 0, sizeof(msgs[i].msg_hdr));
+		msgs[i].msg_hdr.msg_iov = &iovs[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+	for (;;) {
+		if ((n = recvmmsg(sock, msgs, PPS_BATCH, 0, NULL)) == -1) {
+			if (errno == EINTR)
+				continue;
+
+			/* the end markers can be lost too */
+			if (errno == EAGAIN && (first || ++idle > duration + 2))
+				break;
+			if (errno != EAGAIN)
+				printErr("recvmmsg");
+			continue;
+		}
+
+		for (i = 0; i < n && msgs[i].msg_len > 1; ++i)
+			;
+
+		if (i) {
+			last = now_ns();
+			if (!first)
+				first = last;
+			result.received += i;
+		}
+
+		if (i < n)
+			break;
+	}
+
+	result.received_ns = last - first;
+	write(ctl, &result, sizeof(result));
+}
+
+static void send_to(int ctl, int sock, struct net_lease *target)
+{
+	struct pps_result result = { 0 };
+	struct mmsghdr msgs[PPS_BATCH];
+	struct iovec iov;
+	struct sockaddr_in addr = {
+		.sin_family = AF_INET,
+		.sin_port = htons(PPS_PORT),
+	};
+	static char buf[MAX_SIZE];
+	unsigned long long start, end;
+	int n, i;
+
+	inet_pton(AF_INET, target->child_ip, &addr.sin_addr);
+	if (connect(sock, (struct sockaddr *) &addr, sizeof(addr)) == -1)
+		printErr("connect");
+
+	iov.iov_base = buf;
+	iov.iov_len = size;
+	for (i = 0; i < PPS_BATCH; ++i) {
+		memset(&msgs[i].msg_hdr, 0, sizeof(msgs[i].msg_hdr));
+		msgs[i].msg_hdr.msg_iov = &iov;
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	start = now_ns();
+	end = start + duration * 1000000000ULL;
+
+	/* a full queue of the device only loses the datagrams */
+	while (now_ns() < end) {
+		if ((n = sendmmsg(sock, msgs, PPS_BATCH, 0)) > 0)
+			result.sent += n;
+	}
+
+	result.sent_ns = now_ns() - start;
+
+	iov.iov_len = 1;
+	for (i = 0; i < END_MARKERS; ++i) {
+		send(sock, buf, 1, 0);
+		usleep(1000);
+	}
+
+	write(ctl, &result, sizeof(result));
+}
+
+/* A process in a network namespace of its own, with its socket ready,
+ * waiting for its interface before receiving, or sending to target. */
+static pid_t spawn_peer(int *ctl, struct net_lease *target)
+{
+	struct sockaddr_in addr = {
+		.sin_family = AF_INET,
+		.sin_port = htons(PPS_PORT),
+		.sin_addr.s_addr = INADDR_ANY,
+	};
+	int fds[2], sock, bufsize = 4 << 20;
+	char go;
+	pid_t pid;
+
+	if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) == -1)
+		printErr("socketpair");
+
+	if ((pid = fork()) == -1)
+		printErr("fork");
+
+	if (pid) {
+		close(fds[1]);
+		*ctl = fds[0];
+
+		if (read(*ctl, &go, 1) != 1)
+			printErr("peer setup");
+		return pid;
+	}
+
+	close(fds[0]);
+
+	if (unshare(CLONE_NEWNET) == -1)
+		printErr("unshare");
+
+	if ((sock = socket(AF_INET, SOCK_DGRAM, 0)) == -1)
+		printErr("socket");
+
+	if (!target) {
+		setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &bufsize, sizeof(bufsize));
+		if (bind(sock, (struct sockaddr *) &addr, sizeof(addr)) == -1)
+			printErr("bind");
+	}
+
+	write(fds[1], "r", 1);
+	if (read(fds[1], &go, 1) != 1)
+		_exit(EXIT_FAILURE);
+
+	if (target)
+		send_to(fds[1], sock, target);
+	else
+		receive(fds[1], sock);
+
+	_exit(EXIT_SUCCESS);
+}
+
+static void run_mode(enum net_mode mode, int result_fd)
+{
+	struct net_spec spec = { 0 };
+	struct net_lease rx_lease, tx_lease;
+	struct pps_result result = { 0 }, peer;
+	int rx_ctl, tx_ctl;
+	pid_t rx, tx;
+
+	spec.mode = mode;
+	if (parent)
+		snprintf(spec.parent, sizeof(spec.parent), "%s", parent);
+
+	net_pool_open(subnet, &spec, 2);
+	net_pool_acquire(&rx_lease);
+	net_pool_acquire(&tx_lease);
+
+	rx = spawn_peer(&rx_ctl, NULL);
+	tx = spawn_peer(&tx_ctl, &rx_lease);
+
+	prepare_netns(rx, &rx_lease);
+	prepare_netns(tx, &tx_lease);
+
+	write(rx_ctl, "g", 1);
+	write(tx_ctl, "g", 1);
+
+	if (read(tx_ctl, &peer, sizeof(peer)) != sizeof(peer))
+		printErr("sender result");
+	result.sent = peer.sent;
+	result.sent_ns = peer.sent_ns;
+
+	if (read(rx_ctl, &peer, sizeof(peer)) != sizeof(peer))
+		printErr("receiver result");
+	result.received = peer.received;
+	result.received_ns = peer.received_ns;
+
+	waitpid(rx, NULL, 0);
+	waitpid(tx, NULL, 0);
+
+	net_pool_release(&rx_lease);
+	net_pool_release(&tx_lease);
+
+	write(result_fd, &result, sizeof(result));
+}
+
+/* a mode fails without killing the benchmark, ipvlan may be missing */
+static void measure(enum net_mode mode, struct pps_result *result)
+{
+	int fds[2], status;
+	pid_t pid;
+
+	if (pipe2(fds, O_CLOEXEC) == -1)
+		printErr("pipe");
+
+	if ((pid = fork()) == -1)
+		printErr("fork");
+
+	if (!pid) {
+		close(fds[0]);
+		run_mode(mode, fds[1]);
+		_exit(EXIT_SUCCESS);
+	}
+
+	close(fds[1]);
+	memset(result, 0, sizeof(*result));
+
+	if (read(fds[0], result, sizeof(*result)) != sizeof(*result))
+		result->failed = 1;
+
+	close(fds[0]);
+
+	if (waitpid(pid, &status, 0) == -1 || !WIFEXITED(status)
+			|| WEXITSTATUS(status))
+		result->failed = 1;
+}
+
+static double rate(unsigned long long packets, unsigned long long ns)
+{
+	return ns ? packets * 1e9 / ns : 0;
+}
+
+int main(int argc, char *argv[])
+{
+	struct pps_result results[N_NET_MODES];
+	enum net_mode modes[N_NET_MODES];
+	double base = 0, received;
+	int n_modes = 0, mode, option, i;
+	char *report = NULL;
+	FILE *out = stdout;
+
+	while ((option = getopt(argc, argv, "d:s:m:p:S:f:h")) != -1) {
+		switch (option) {
+		case 'd':
+			duration = strtol(optarg, NULL, 10);
+			if (duration < 1 || duration > MAX_DURATION)
+				usage(argv[0]);
+			break;
+		case 's':
+			size = strtol(optarg, NULL, 10);
+			if (size < MIN_SIZE || size > MAX_SIZE)
+				usage(argv[0]);
+			break;
+		case 'm':
+			if ((mode = net_mode_parse(optarg)) == -1
+					|| n_modes == N_NET_MODES)
+				usage(argv[0]);
+			modes[n_modes++] = mode;
+			break;
+		case 'p':
+			if (strlen(optarg) >= IFNAMSIZ)
+				usage(argv[0]);
+			parent = optarg;
+			break;
+		case 'S':
+			subnet = optarg;
+			break;
+		case 'f':
+			report = optarg;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (!n_modes) {
+		for (mode = 0; mode < N_NET_MODES; ++mode)
+			modes[n_modes++] = mode;
+	}
+
+	for (i = 0; i < n_modes; ++i) {
+		fprintf(stderr, "=> %s...\n", net_mode_name(modes[i]));
+		measure(modes[i], &results[i]);
+	}
+
+	if (report && !(out = fopen(report, "w")))
+		printErr("fopen report");
+
+	fprintf(out, "\n%ld s of %ld byte UDP datagrams per mode\n\n", duration,
+		size);
+	fprintf(out, "%-12s %14s %14s %8s %8s\n", "mode", "sent pps",
+		"received pps", "loss", "ratio");
+
+	for (i = 0; i < n_modes; ++i) {
+		if (results[i].failed) {
+			fprintf(out, "%-12s %14s\n", net_mode_name(modes[i]), "failed");
+			continue;
+		}
+
+		received = rate(results[i].received, results[i].received_ns);
+		if (!base)
+			base = received;
+
+		fprintf(out, "%-12s %14.0f %14.0f %7.1f%% %8.2f\n",
+			net_mode_name(modes[i]),
+			rate(results[i].sent, results[i].sent_ns), received,
+			results[i].sent ? 100.0 - results[i].received * 100.0
+				/ results[i].sent : 0,
+			base ? received / base : 0);
+	}
+
+	if (out != stdout)
+		fclose(out);
+
+	exit(EXIT_SUCCESS);
+}
@@ -1,308 +1,255 @@
-       /* userns_child_exec.c
-
-          Licensed under GNU General Public License v2 or later
-
-          Create a child process that executes a shell command in new
-          namespace(s); allow UID and GID mappings to be specified when
-          creating a user namespace.
-       */
-       #define _GNU_SOURCE
-       #include <sched.h>
-       #include <unistd.h>
-       #include <stdlib.h>
-       #include <sys/wait.h>
-       #include <signal.h>
-       #include <fcntl.h>
-       #include <stdio.h>
-       #include <string.h>
-       #include <limits.h>
-       #include <errno.h>
-       #include <time.h>
-
-       /* A simple error-handling function: print an error message based
-          on the value in 'errno' and terminate the calling process */
-
-       #define errExit(msg)    do { perror(msg); exit(EXIT_FAILURE); \
-                               } while (0)
-
-       struct child_args {
-           char **argv;        /* Command to be executed by child, with args */
-           int    pipe_fd[2];  /* Pipe used to synchronize parent and child */
-       };
-
-       static int verbose;
-
-       static void
-       usage(char *pname)
-       {
-           fprintf(stderr, "Usage: %s [options] cmd [arg...]\n\n", pname);
-           fprintf(stderr, "Create a child process that executes a shell "
-                   "command in a new user namespace,\n"
-                   "and possibly also other new namespace(s).\n\n");
-           fprintf(stderr, "Options can be:\n\n");
-       #define fpe(str) fprintf(stderr, "    %s", str);
-           fpe("-i          New IPC namespace\n");
-           fpe("-m          New mount namespace\n");
-           fpe("-n          New network namespace\n");
-           fpe("-p          New PID namespace\n");
-           fpe("-u          New UTS namespace\n");
-           fpe("-U          New user namespace\n");
-           fpe("-M uid_map  Specify UID map for user namespace\n");
-           fpe("-G gid_map  Specify GID map for user namespace\n");
-           fpe("-z          Map user's UID and GID to 0 in user namespace\n");
-           fpe("            (equivalent to: -M '0 <uid> 1' -G '0 <gid> 1')\n");
-           fpe("-v          Display verbose messages\n");
-           fpe("\n");
-           fpe("If -z, -M, or -G is specified, -U is required.\n");
-           fpe("It is not permitted to specify both -z and either -M or -G.\n");
-           fpe("\n");
-           fpe("Map strings for -M and -G consist of records of the form:\n");
-           fpe("\n");
-           fpe("    ID-inside-ns   ID-outside-ns   len\n");
-           fpe("\n");
-           fpe("A map string can contain multiple records, separated"
-               " by commas;\n");
-           fpe("the commas are replaced by newlines before writing"
-               " to map files.\n");
-
-           exit(EXIT_FAILURE);
-       }
-
-       /* Update the mapping file 'map_file', with the value provided in
-          'mapping', a string that defines a UID or GID mapping. A UID or
-          GID mapping consists of one or more newline-delimited records
-          of the form:
-
-              ID_inside-ns    ID-outside-ns   length
-
-          Requiring the user to supply a string that contains newlines is
-          of course inconvenient for command-line use. Thus, we permit the
-          use of commas to delimit records in this string, and replace them
-          with newlines before writing the string to the file. */
-
-       static void
-       update_map(char *mapping, char *map_file)
-       {
-           int fd, j;
-           size_t map_len;     /* Length of 'mapping' */
-
-           /* Replace commas in mapping string with newlines */
-
-           map_len = strlen(mapping);
-           for (j = 0; j < map_len; j++)
-               if (mapping[j] == ',')
-                   mapping[j] = '\n';
-
-           fd = open(map_file, O_RDWR);
-           if (fd == -1) {
-               fprintf(stderr, "ERROR: open %s: %s\n", map_file,
-                       strerror(errno));
-               exit(EXIT_FAILURE);
-           }
-
-           if (write(fd, mapping, map_len) != map_len) {
-               fprintf(stderr, "ERROR: write %s: %s\n", map_file,
-                       strerror(errno));
-               exit(EXIT_FAILURE);
-           }
-
-           close(fd);
-       }
-
-       /* Linux 3.19 made a change in the handling of setgroups(2) and the
-          'gid_map' file to address a security issue. The issue allowed
-          *unprivileged* users to employ user namespaces in order to drop
-          The upshot of the 3.19 changes is that in order to update the
-          'gid_maps' file, use of the setgroups() system call in this
-          user namespace must first be disabled by writing "deny" to one of
-          the /proc/PID/setgroups files for this namespace.  That is the
-          purpose of the following function. */
-
-       static void
-       proc_setgroups_write(pid_t child_pid, char *str)
-       {
-           char setgroups_path[PATH_MAX];
-           int fd;
-
-           snprintf(setgroups_path, PATH_MAX, "/proc/%ld/setgroups",
-                   (long) child_pid);
-
-           fd = open(setgroups_path, O_RDWR);
-           if (fd == -1) {
-
-               /* We may be on a system that doesn't support
-                  /proc/PID/setgroups. In that case, the file won't exist,
-                  and the system won't impose the restrictions that Linux 3.19
-                  added. That's fine: we don't need to do anything in order
-                  to permit 'gid_map' to be updated.
-
-                  However, if the error from open() was something other than
-                  the ENOENT error that is expected for that case,  let the
-                  user know. */
-
-               if (errno != ENOENT)
-                   fprintf(stderr, "ERROR: open %s: %s\n", setgroups_path,
-                       strerror(errno));
-               return;
-           }
-
-           if (write(fd, str, strlen(str)) == -1)
-               fprintf(stderr, "ERROR: write %s: %s\n", setgroups_path,
-                   strerror(errno));
-
-           close(fd);
-       }
-
-       static int              /* Start function for cloned child */
-       childFunc(void *arg)
-       {
-           struct child_args *args = (struct child_args *) arg;
-           char ch;
-
-           /* Wait until the parent has updated the UID and GID mappings.
-              See the comment in main(). We wait for end of file on a
-              pipe that will be closed by the parent process once it has
-              updated the mappings. */
-
-           close(args->pipe_fd[1]);    /* Close our descriptor for the write
-                                          end of the pipe so that we see EOF
-                                          when parent closes its descriptor */
-           if (read(args->pipe_fd[0], &ch, 1) != 0) {
-               fprintf(stderr,
-                       "Failure in child: read from pipe returned != 0\n");
-               exit(EXIT_FAILURE);
-           }
-
-           close(args->pipe_fd[0]);
-
-           /* Execute a shell command */
-
-           printf("About to exec %s\n", args->argv[0]);
-           execvp(args->argv[0], args->argv);
-           errExit("execvp");
-       }
-
-       #define STACK_SIZE (1024 * 1024)
-
-       static char child_stack[STACK_SIZE];    /* Space for child's stack */
-
-       int
-       main(int argc, char *argv[])
-       {
-           int flags, opt, map_zero;
-           pid_t child_pid;
-           struct child_args args;
-           char *uid_map, *gid_map;
-           const int MAP_BUF_SIZE = 100;
-           char map_buf[MAP_BUF_SIZE];
-           char map_path[PATH_MAX];
-	   struct timeval tv_start;
-	   struct timeval tv_end;
-           unsigned long start = 0;
-     	   unsigned long end = 0;
-           /* Parse command-line options. The initial '+' character in
-              the final getopt() argument prevents GNU-style permutation
-              of command-line options. That's useful, since sometimes
-              the 'command' to be executed by this program itself
-              has command-line options. We don't want getopt() to treat
-              those as options to this program. */
-
-           flags = 0;
-           verbose = 0;
-           gid_map = NULL;
-           uid_map = NULL;
-           map_zero = 0;
-           while ((opt = getopt(argc, argv, "+imnpuUM:G:zv")) != -1) {
-               switch (opt) {
-               case 'i': flags |= CLONE_NEWIPC;        break;
-               case 'm': flags |= CLONE_NEWNS;         break;
-               case 'n': flags |= CLONE_NEWNET;        break;
-               case 'p': flags |= CLONE_NEWPID;        break;
-               case 'u': flags |= CLONE_NEWUTS;        break;
-               case 'v': verbose = 1;                  break;
-               case 'z': map_zero = 1;                 break;
-               case 'M': uid_map = optarg;             break;
-               case 'G': gid_map = optarg;             break;
-               case 'U': flags |= CLONE_NEWUSER;       break;
-               default:  usage(argv[0]);
-               }
-           }
-
-           /* -M or -G without -U is nonsensical */
-
-           if (((uid_map != NULL || gid_map != NULL || map_zero) &&
-                       !(flags & CLONE_NEWUSER)) ||
-                   (map_zero && (uid_map != NULL || gid_map != NULL)))
-               usage(argv[0]);
-
-           args.argv = &argv[optind];
-
-           /* We use a pipe to synchronize the parent and child, in order to
-              ensure that the parent sets the UID and GID maps before the child
-              calls execve(). This ensures that the child maintains its
-              capabilities during the execve() in the common case where we
-              want to map the child's effective user ID to 0 in the new user
-              namespace. Without this synchronization, the child would lose
-              its capabilities if it performed an execve() with nonzero
-              user IDs (see the capabilities(7) man page for details of the
-              transformation of a process's capabilities during execve()). */
-
-           if (pipe(args.pipe_fd) == -1)
-               errExit("pipe");
-
-           /* Create the child in new namespace(s) */
-	
-   	   gettimeofday(&tv_start, NULL);	   
-           child_pid = clone(childFunc, child_stack + STACK_SIZE,
-                             flags | SIGCHLD, &args);
-	   gettimeofday(&tv_end, NULL);
-	   start = 1000000 * tv_start.tv_sec + tv_start.tv_usec;
-	   end = 1000000 * tv_end.tv_sec + tv_end.tv_usec;
-	   printf("Start time: %lu\nEnd time: %lu\nDifference: %lu\n", start, end, end-start);
-           if (child_pid == -1)
-               errExit("clone");
-
-           /* Parent falls through to here */
-
-           if (verbose)
-               printf("%s: PID of child created by clone() is %ld\n",
-                       argv[0], (long) child_pid);
-
-           /* Update the UID and GID maps in the child */
-
-           if (uid_map != NULL || map_zero) {
-               snprintf(map_path, PATH_MAX, "/proc/%ld/uid_map",
-                       (long) child_pid);
-               if (map_zero) {
-                   snprintf(map_buf, MAP_BUF_SIZE, "0 %ld 1", (long) getuid());
-                   uid_map = map_buf;
-               }
-               update_map(uid_map, map_path);
-           }
-
-           if (gid_map != NULL || map_zero) {
-               proc_setgroups_write(child_pid, "deny");
-
-               snprintf(map_path, PATH_MAX, "/proc/%ld/gid_map",
-                       (long) child_pid);
-               if (map_zero) {
-                   snprintf(map_buf, MAP_BUF_SIZE, "0 %ld 1", (long) getgid());
-                   gid_map = map_buf;
-               }
-               update_map(gid_map, map_path);
-           }
-
-           /* Close the write end of the pipe, to signal to the child that we
-              have updated the UID and GID maps */
-
-           close(args.pipe_fd[1]);
-
-           if (waitpid(child_pid, NULL, 0) == -1)      /* Wait for child */
-               errExit("waitpid");
-
-           if (verbose)
-               printf("%s: terminating\n", argv[0]);
-
-           exit(EXIT_SUCCESS);
-       }
-
+/* startuptime.c
+
+   Startup latency benchmark.
+
+   Drives the real runc() path N times and records the duration of every
+   startup phase (see src/helpers/phases.h). At the end the p50/p95/p99 of
+   each phase are printed, optionally followed by a CSV or JSON dump of
+   every sample so that regressions can be tracked per phase.
+
+   Usage: sudo ./startuptime [-n iterations] [-U] [-c] [-i image] [-o csv|json]
+                             [-f file] [entrypoint]
+*/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "../src/runc.h"
+#include "../src/helpers/helpers.h"
+#include "../src/helpers/phases.h"
+#include "../src/seccomp/seccomp_config.h"
+#include "../src/namespaces/cgroup/cgroup.h"
+
+#define DEFAULT_ITERATIONS  100
+#define MAX_ITERATIONS      100000
+#define N_COLUMNS           (N_PHASES + 1)  /* every phase plus the total */
+
+enum dump_format { DUMP_NONE, DUMP_CSV, DUMP_JSON };
+
+static char *default_entrypoint[] = { "/bin/true", NULL };
+
+static void usage(char *pname)
+{
+	fprintf(stderr, "Usage: sudo %s [options] [entrypoint]\n\n", pname);
+	fprintf(stderr, "Options can be:\n");
+	fprintf(stderr, "\t-n <iterations>\tnumber of containers to start "
+		"[1-%d]\tdefault: %d\n", MAX_ITERATIONS, DEFAULT_ITERATIONS);
+	fprintf(stderr, "\t-U\t\tuse a user namespace\n");
+	fprintf(stderr, "\t-s\t\tinstall the seccomp filter\n");
+	fprintf(stderr, "\t-S <profile>\tinstall the filter of a seccomp "
+		"profile\n");
+	fprintf(stderr, "\t-c\t\tapply the default cgroup limits\n");
+	fprintf(stderr, "\t-i <image>\trun an image of the layer store\n");
+	fprintf(stderr, "\t-o <csv|json>\tdump every sample\n");
+	fprintf(stderr, "\t-f <file>\twrite the report to file\n");
+	fprintf(stderr, "\nThe default entrypoint is /bin/true\n");
+	exit(EXIT_FAILURE);
+}
+
+static const char *column_name(int column)
+{
+	return column == N_PHASES ? "total" : phase_name(column);
+}
+
+static int compare_ull(const void *a, const void *b)
+{
+	unsigned long long x = *(const unsigned long long *) a;
+	unsigned long long y = *(const unsigned long long *) b;
+
+	return (x > y) - (x < y);
+}
+
+/* nearest-rank percentile of a sorted array */
+static unsigned long long percentile(unsigned long long *sorted, long n,
+		int pct)
+{
+	long rank = (pct * n + 99) / 100;
+
+	return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+/* store the duration of every phase of the last run, in ns */
+static void collect_sample(unsigned long long *row)
+{
+	struct phase_times *times = phase_timing_get();
+	unsigned long long first = 0, last = 0;
+
+	for (int p = 0; p < N_PHASES; ++p) {
+		if (!times->begin[p] || !times->end[p]) {
+			row[p] = 0;
+			continue;
+		}
+
+		row[p] = times->end[p] - times->begin[p];
+
+		if (!first || times->begin[p] < first)
+			first = times->begin[p];
+		if (times->end[p] > last)
+			last = times->end[p];
+	}
+
+	row[N_PHASES] = last - first;
+}
+
+static void print_summary(FILE *out, unsigned long long *samples, long n)
+{
+	unsigned long long *sorted = malloc(n * sizeof(unsigned long long));
+
+	if (!sorted)
+		printErr("malloc at print_summary");
+
+	fprintf(out, "%-12s %12s %12s %12s %12s\n", "phase (us)",
+		"p50", "p95", "p99", "max");
+
+	for (int c = 0; c < N_COLUMNS; ++c) {
+		for (long i = 0; i < n; ++i)
+			sorted[i] = samples[i * N_COLUMNS + c];
+
+		qsort(sorted, n, sizeof(unsigned long long), compare_ull);
+
+		fprintf(out, "%-12s %12.1f %12.1f %12.1f %12.1f\n", column_name(c),
+			percentile(sorted, n, 50) / 1000.0,
+			percentile(sorted, n, 95) / 1000.0,
+			percentile(sorted, n, 99) / 1000.0,
+			sorted[n - 1] / 1000.0);
+	}
+
+	free(sorted);
+}
+
+static void dump_csv(FILE *out, unsigned long long *samples, long n)
+{
+	fprintf(out, "iteration");
+	for (int c = 0; c < N_COLUMNS; ++c)
+		fprintf(out, ",%s_ns", column_name(c));
+	fprintf(out, "\n");
+
+	for (long i = 0; i < n; ++i) {
+		fprintf(out, "%ld", i);
+		for (int c = 0; c < N_COLUMNS; ++c)
+			fprintf(out, ",%llu", samples[i * N_COLUMNS + c]);
+		fprintf(out, "\n");
+	}
+}
+
+static void dump_json(FILE *out, unsigned long long *samples, long n)
+{
+	fprintf(out, "{\n  \"unit\": \"ns\",\n  \"phases\": {\n");
+
+	for (int c = 0; c < N_COLUMNS; ++c) {
+		fprintf(out, "    \"%s\": [", column_name(c));
+		for (long i = 0; i < n; ++i)
+			fprintf(out, "%s%llu", i ? ", " : "", samples[i * N_COLUMNS + c]);
+		fprintf(out, "]%s\n", c == N_COLUMNS - 1 ? "" : ",");
+	}
+
+	fprintf(out, "  }\n}\n");
+}
+
+int main(int argc, char *argv[])
+{
+	enum dump_format format = DUMP_NONE;
+	long iterations = DEFAULT_ITERATIONS;
+	struct cgroup_args *resources = NULL;
+	struct runc_args runc_arguments;
+	unsigned long long *samples;
+	bool cgroup_flag = false;
+	int has_userns = 0;
+	int has_seccomp = 0;
+	char *report = NULL;
+	char *image = NULL;
+	FILE *out = stdout;
+	int option;
+
+	while ((option = getopt(argc, argv, "+n:UsS:ci:o:f:h")) != -1) {
+		switch (option) {
+		case 'n':
+			iterations = strtol(optarg, NULL, 10);
+			if (iterations < 1 || iterations > MAX_ITERATIONS)
+				usage(argv[0]);
+			break;
+		case 'U':
+			has_userns = 1;
+			break;
+		case 's':
+			has_seccomp = 1;
+			break;
+		case 'S':
+			sys_filter_set_profile(optarg);
+			has_seccomp = 1;
+			break;
+		case 'c':
+			cgroup_flag = true;
+			break;
+		case 'i':
+			image = optarg;
+			break;
+		case 'o':
+			if (!strcmp(optarg, "csv"))
+				format = DUMP_CSV;
+			else if (!strcmp(optarg, "json"))
+				format = DUMP_JSON;
+			else
+				usage(argv[0]);
+			break;
+		case 'f':
+			report = optarg;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	samples = calloc(iterations * N_COLUMNS, sizeof(unsigned long long));
+	if (!samples)
+		printErr("calloc samples");
+
+	if (optind < argc) {
+		runc_arguments.child_entrypoint = &argv[optind];
+		runc_arguments.child_entrypoint_size = argc - optind;
+	} else {
+		runc_arguments.child_entrypoint = default_entrypoint;
+		runc_arguments.child_entrypoint_size = 1;
+	}
+
+	/* the same defaults used by MyDocker -c */
+	init_resources(cgroup_flag, cgroup_flag, cgroup_flag, cgroup_flag,
+			cgroup_flag, strtol(PIDS, NULL, 10),
+			strtol(MEMORY, NULL, 10), strtol(WEIGHT, NULL, 10),
+			25, &resources);
+
+	runc_arguments.resources = resources;
+	runc_arguments.has_userns = has_userns;
+	runc_arguments.image = image;
+	runc_arguments.has_seccomp = has_seccomp;
+	runc_arguments.syscall_profile = NULL;
+
+	phase_timing_enable();
+
+	for (long i = 0; i < iterations; ++i) {
+		phase_timing_reset();
+		runc(&runc_arguments);
+		collect_sample(&samples[i * N_COLUMNS]);
+	}
+
+	if (report && !(out = fopen(report, "w")))
+		printErr("fopen report");
+
+	fprintf(out, "\n%ld containers started\n\n", iterations);
+	print_summary(out, samples, iterations);
+
+	if (format == DUMP_CSV) {
+		fprintf(out, "\n");
+		dump_csv(out, samples, iterations);
+	} else if (format == DUMP_JSON) {
+		fprintf(out, "\n");
+		dump_json(out, samples, iterations);
+	}
+
+	if (out != stdout)
+		fclose(out);
+
+	free(samples);
+	exit(EXIT_SUCCESS);
+}